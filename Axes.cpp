@@ -30,17 +30,23 @@ void Axes::affineMap(const QMatrix4x4 &M) {
   axes.push_back(QVector3D(origin + rotation.column(1)));
   axes.push_back(QVector3D(origin));
   axes.push_back(QVector3D(origin + rotation.column(2)));
+  lines.clear();
 }
 
 void Axes::draw(const RenderCamera &renderer, const QColor &color,
                 float lineWidth) const {
-  QColor c = color;
-  c.toHsv();
-  renderer.renderLine(axes[0], axes[1], c, lineWidth);
+  if (lines.empty() || linesColor != color) {
+    lines.clear();
+    QColor c = color;
+    c.toHsv();
+    lines.addLine(axes[0], axes[1], c);
 
-  c.setHsv(c.hue() + 120, c.saturation(), c.value());
-  renderer.renderLine(axes[2], axes[3], c, lineWidth);
+    c.setHsv(c.hue() + 120, c.saturation(), c.value());
+    lines.addLine(axes[2], axes[3], c);
 
-  c.setHsv(c.hue() + 120, c.saturation(), c.value());
-  renderer.renderLine(axes[4], axes[5], c, lineWidth);
+    c.setHsv(c.hue() + 120, c.saturation(), c.value());
+    lines.addLine(axes[4], axes[5], c);
+    linesColor = color;
+  }
+  lines.draw(renderer, lineWidth);
 }
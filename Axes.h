@@ -7,6 +7,7 @@
 //
 #pragma once
 
+#include "LineBatch.h"
 #include "SceneObject.h"
 
 #include <QMatrix4x4>
@@ -32,6 +33,10 @@ private:
   QMatrix4x4 rotation;
   QVector4D origin;
 
+  // the three axes, rebuilt by draw after affineMap or for another colour
+  mutable LineBatch lines;
+  mutable QColor linesColor;
+
 public:
   Axes(const QVector4D &origin = E0, const QMatrix4x4 &rotation = QMatrix4x4());
   virtual ~Axes() override {}
@@ -0,0 +1,404 @@
+#include "BundleAdjustment.h"
+#include "Parallel.h"
+
+#include <Eigen/SparseCholesky>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+using Matrix26 = Eigen::Matrix<double, 2, 6>;
+using Matrix23 = Eigen::Matrix<double, 2, 3>;
+using Matrix63 = Eigen::Matrix<double, 6, 3>;
+using Matrix6 = Eigen::Matrix<double, 6, 6>;
+using Vector6 = Eigen::Matrix<double, 6, 1>;
+
+// observation indices grouped by camera or point (CSR)
+struct Groups {
+  std::vector<int> start, items;
+
+  template <typename Key>
+  Groups(int count, std::size_t observations, Key key)
+      : start(count + 1, 0), items(observations) {
+    for (std::size_t o = 0; o < observations; ++o)
+      ++start[key(o) + 1];
+    for (int g = 0; g < count; ++g)
+      start[g + 1] += start[g];
+    std::vector<int> next(start.begin(), start.end() - 1);
+    for (std::size_t o = 0; o < observations; ++o)
+      items[next[key(o)]++] = int(o);
+  }
+};
+
+// robust loss rho of a squared residual s, and its derivative, which is
+// the weight of the residual in the reweighted least squares
+double robustLoss(const BundleAdjustmentParameters &parameters, double s,
+                  double *weight) {
+  const double k = parameters.lossScale, k2 = k * k;
+  double rho = s, w = 1.0;
+  switch (parameters.loss) {
+  case RobustLoss::RL_NONE:
+    break;
+  case RobustLoss::RL_HUBER:
+    if (s > k2) {
+      double r = std::sqrt(s);
+      rho = 2.0 * k * r - k2;
+      w = k / r;
+    }
+    break;
+  case RobustLoss::RL_CAUCHY:
+    rho = k2 * std::log1p(s / k2);
+    w = 1.0 / (1.0 + s / k2);
+    break;
+  }
+  if (weight)
+    *weight = w;
+  return rho;
+}
+
+Eigen::Vector2d residual(const BundleCamera &c, const Eigen::Vector3d &X,
+                         const BundleObservation &o) {
+  Eigen::Vector3d p = c.R * X + c.t;
+  return c.principalPoint + c.focal * p.head<2>() / p.z() - o.image;
+}
+
+struct Cost {
+  double robust = 0.0, squared = 0.0;
+};
+
+Cost evaluate(const std::vector<BundleCamera> &cameras,
+              const std::vector<Eigen::Vector3d> &points,
+              const std::vector<BundleObservation> &observations,
+              const BundleAdjustmentParameters &parameters) {
+  const std::size_t n = observations.size();
+  std::vector<Cost> partial(parallelChunkCount(n));
+  parallelChunks(n, [&](std::size_t b, std::size_t e, unsigned c) {
+    for (std::size_t o = b; o < e; ++o) {
+      const BundleObservation &ob = observations[o];
+      double s =
+          residual(cameras[ob.camera], points[ob.point], ob).squaredNorm();
+      partial[c].robust += 0.5 * robustLoss(parameters, s, nullptr);
+      partial[c].squared += s;
+    }
+  });
+  Cost total;
+  for (const Cost &c : partial) {
+    total.robust += c.robust;
+    total.squared += c.squared;
+  }
+  return total;
+}
+
+Eigen::Matrix3d skew(const Eigen::Vector3d &v) {
+  Eigen::Matrix3d S;
+  S << 0.0, -v.z(), v.y(), v.z(), 0.0, -v.x(), -v.y(), v.x(), 0.0;
+  return S;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+} // namespace
+
+BundleCamera bundleCamera(const PerspectiveCamera &camera) {
+  BundleCamera b;
+  for (int r = 0; r < 3; ++r)
+    for (int c = 0; c < 3; ++c)
+      b.R(r, c) = camera.pose(c, r);
+  Eigen::Vector3d center(camera.center.x(), camera.center.y(),
+                         camera.center.z());
+  b.t = -b.R * center;
+  b.focal = camera.imagePlaneDistance;
+  b.principalPoint = Eigen::Vector2d(camera.imagePrincipalPoint.x(),
+                                     camera.imagePrincipalPoint.y());
+  return b;
+}
+
+void setCameraPose(PerspectiveCamera &camera, const BundleCamera &b) {
+  Eigen::Vector3d center = b.center();
+  camera.center = QVector4D(center.x(), center.y(), center.z(), 1.0f);
+  camera.pose.setToIdentity();
+  for (int r = 0; r < 3; ++r)
+    for (int c = 0; c < 3; ++c)
+      camera.pose(c, r) = float(b.R(r, c));
+  camera.updateCamera();
+}
+
+BundleAdjustmentResult
+bundleAdjust(std::vector<BundleCamera> &cameras,
+             std::vector<Eigen::Vector3d> &points,
+             const std::vector<BundleObservation> &observations,
+             const BundleAdjustmentParameters &parameters) {
+  auto start = std::chrono::steady_clock::now();
+  const int nc = int(cameras.size()), np = int(points.size());
+  const std::size_t no = observations.size();
+  for (const BundleObservation &o : observations)
+    if (o.camera < 0 || o.camera >= nc || o.point < 0 || o.point >= np)
+      throw std::runtime_error("observation of an unknown camera or point");
+
+  const Groups byCamera(nc, no,
+                        [&](std::size_t o) { return observations[o].camera; });
+  // variables: the cameras that are not fixed, 6 unknowns each; cameras
+  // without observations have no equations and stay as they are
+  std::vector<int> var(nc, -1), cameraOf;
+  for (int j = 0; j < nc; ++j)
+    if (!cameras[j].fixed && byCamera.start[j] < byCamera.start[j + 1]) {
+      var[j] = int(cameraOf.size());
+      cameraOf.push_back(j);
+    }
+  const int nv = int(cameraOf.size());
+  const Groups byPoint(np, no,
+                       [&](std::size_t o) { return observations[o].point; });
+
+  // Lower block pattern of the reduced camera system: cameras k <= j that
+  // share a point. slot[rowStart[j] + s] is block (j, rowCols[...]).
+  std::vector<std::vector<int>> rows(nv);
+  for (int i = 0; i < np; ++i)
+    for (int a = byPoint.start[i]; a < byPoint.start[i + 1]; ++a)
+      for (int b = byPoint.start[i]; b < byPoint.start[i + 1]; ++b) {
+        int j = var[observations[byPoint.items[a]].camera];
+        int k = var[observations[byPoint.items[b]].camera];
+        if (j >= 0 && k >= 0 && k <= j)
+          rows[j].push_back(k);
+      }
+  std::vector<int> rowStart(nv + 1, 0), rowCols;
+  for (int j = 0; j < nv; ++j) {
+    rows[j].push_back(j);
+    std::sort(rows[j].begin(), rows[j].end());
+    rows[j].erase(std::unique(rows[j].begin(), rows[j].end()), rows[j].end());
+    rowStart[j + 1] = rowStart[j] + int(rows[j].size());
+    rowCols.insert(rowCols.end(), rows[j].begin(), rows[j].end());
+    std::vector<int>().swap(rows[j]);
+  }
+  // the sparse matrix is built once; every block element keeps the index of
+  // its value, or -1 above the diagonal
+  Eigen::SparseMatrix<double> S(6 * nv, 6 * nv);
+  std::vector<int> valueIndex(std::size_t(rowCols.size()) * 36, -1);
+  {
+    std::vector<Eigen::Triplet<double>> triplets;
+    for (int j = 0; j < nv; ++j)
+      for (int s = rowStart[j]; s < rowStart[j + 1]; ++s)
+        for (int a = 0; a < 6; ++a)
+          for (int b = 0; b < 6; ++b)
+            if (rowCols[s] < j || b <= a)
+              triplets.emplace_back(6 * j + a, 6 * rowCols[s] + b, 0.0);
+    S.setFromTriplets(triplets.begin(), triplets.end());
+    S.makeCompressed();
+    for (int j = 0; j < nv; ++j)
+      for (int s = rowStart[j]; s < rowStart[j + 1]; ++s)
+        for (int a = 0; a < 6; ++a)
+          for (int b = 0; b < 6; ++b)
+            if (rowCols[s] < j || b <= a)
+              valueIndex[std::size_t(s) * 36 + a * 6 + b] = int(
+                  &S.coeffRef(6 * j + a, 6 * rowCols[s] + b) - S.valuePtr());
+  }
+  Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> solver;
+  solver.analyzePattern(S);
+
+  BundleAdjustmentResult result;
+  Cost cost = evaluate(cameras, points, observations, parameters);
+  result.initialCost = result.finalCost = cost.robust;
+  result.initialRmse = result.finalRmse =
+      no ? std::sqrt(cost.squared / no) : 0.0;
+
+  // per observation: Jacobians and residual scaled by the square root of
+  // the robust weight, and the camera-point block W = Jc^T Jp
+  std::vector<Matrix26> Jc(no);
+  std::vector<Matrix23> Jp(no);
+  std::vector<Eigen::Vector2d> r(no);
+  std::vector<Matrix63> W(no);
+  std::vector<Matrix6> U(nv);
+  std::vector<Vector6> gc(nv);
+  std::vector<Eigen::Matrix3d> V(np), Vinv(np);
+  std::vector<Eigen::Vector3d> gp(np), dp(np);
+  Eigen::VectorXd rhs(6 * nv), dc(6 * nv);
+  double lambda = parameters.initialLambda;
+
+  for (int it = 0; it < parameters.maxIterations && nv + np > 0; ++it) {
+    result.iterations = it + 1;
+    // residuals and Jacobians: rotation (left-multiplied), translation,
+    // point
+    parallelFor(no, [&](std::size_t o) {
+      const BundleObservation &ob = observations[o];
+      const BundleCamera &c = cameras[ob.camera];
+      const Eigen::Vector3d RX = c.R * points[ob.point];
+      const Eigen::Vector3d p = RX + c.t;
+      const double iz = 1.0 / p.z();
+      Matrix23 A; // of the projection, w.r.t. p
+      A << c.focal * iz, 0.0, -c.focal * p.x() * iz * iz, 0.0, c.focal * iz,
+          -c.focal * p.y() * iz * iz;
+      const Eigen::Vector2d e =
+          c.principalPoint + c.focal * p.head<2>() * iz - ob.image;
+      double w;
+      robustLoss(parameters, e.squaredNorm(), &w);
+      A *= std::sqrt(w);
+      Jc[o].leftCols<3>().noalias() = -A * skew(RX);
+      Jc[o].rightCols<3>() = A;
+      Jp[o].noalias() = A * c.R;
+      r[o] = std::sqrt(w) * e;
+      W[o].noalias() = Jc[o].transpose() * Jp[o];
+    });
+    parallelFor(
+        std::size_t(nc),
+        [&](std::size_t j) {
+          if (var[j] < 0)
+            return;
+          Matrix6 u = Matrix6::Zero();
+          Vector6 g = Vector6::Zero();
+          for (int a = byCamera.start[j]; a < byCamera.start[j + 1]; ++a) {
+            const int o = byCamera.items[a];
+            u.noalias() += Jc[o].transpose() * Jc[o];
+            g.noalias() += Jc[o].transpose() * r[o];
+          }
+          U[var[j]] = u;
+          gc[var[j]] = g;
+        },
+        16);
+    parallelFor(
+        std::size_t(np),
+        [&](std::size_t i) {
+          Eigen::Matrix3d v = Eigen::Matrix3d::Zero();
+          Eigen::Vector3d g = Eigen::Vector3d::Zero();
+          for (int a = byPoint.start[i]; a < byPoint.start[i + 1]; ++a) {
+            const int o = byPoint.items[a];
+            v.noalias() += Jp[o].transpose() * Jp[o];
+            g.noalias() += Jp[o].transpose() * r[o];
+          }
+          V[i] = v;
+          gp[i] = g;
+        },
+        1024);
+
+    // damped steps from this linearisation until one lowers the cost
+    bool accepted = false, converged = false;
+    while (!accepted && !converged && lambda < 1e16) {
+      parallelFor(
+          std::size_t(np),
+          [&](std::size_t i) {
+            Eigen::Matrix3d v = V[i];
+            v.diagonal() *= 1.0 + lambda;
+            v.diagonal().array() += 1e-12;
+            Vinv[i] = v.inverse();
+          },
+          1024);
+      // Schur complement S = U - sum W V^-1 W^T, block row by block row
+      double *values = S.valuePtr();
+      parallelChunks(
+          std::size_t(nv),
+          [&](std::size_t b, std::size_t e, unsigned) {
+            std::vector<int> slotOf(nv, -1);
+            std::vector<Matrix6> blocks;
+            for (int jv = int(b); jv < int(e); ++jv) {
+              const int first = rowStart[jv], count = rowStart[jv + 1] - first;
+              blocks.assign(count, Matrix6::Zero());
+              for (int s = 0; s < count; ++s)
+                slotOf[rowCols[first + s]] = s;
+              Matrix6 &diagonal = blocks[slotOf[jv]];
+              diagonal = U[jv];
+              diagonal.diagonal() *= 1.0 + lambda;
+              diagonal.diagonal().array() += 1e-12;
+              Vector6 g = -gc[jv];
+              const int j = cameraOf[jv];
+              for (int a = byCamera.start[j]; a < byCamera.start[j + 1]; ++a) {
+                const int o = byCamera.items[a];
+                const int i = observations[o].point;
+                const Matrix63 Y = W[o] * Vinv[i];
+                g.noalias() += Y * gp[i];
+                for (int c = byPoint.start[i]; c < byPoint.start[i + 1]; ++c) {
+                  const int q = byPoint.items[c];
+                  const int kv = var[observations[q].camera];
+                  if (kv >= 0 && kv <= jv)
+                    blocks[slotOf[kv]].noalias() -= Y * W[q].transpose();
+                }
+              }
+              rhs.segment<6>(6 * jv) = g;
+              for (int s = 0; s < count; ++s) {
+                const int *index = &valueIndex[std::size_t(first + s) * 36];
+                for (int a = 0; a < 6; ++a)
+                  for (int c = 0; c < 6; ++c)
+                    if (index[a * 6 + c] >= 0)
+                      values[index[a * 6 + c]] = blocks[s](a, c);
+                slotOf[rowCols[first + s]] = -1;
+              }
+            }
+          },
+          16);
+      if (nv > 0) {
+        solver.factorize(S);
+        if (solver.info() != Eigen::Success) {
+          lambda *= 10.0;
+          ++result.rejectedSteps;
+          continue;
+        }
+        dc = solver.solve(rhs);
+      }
+      // back substitution of the point steps
+      parallelFor(
+          std::size_t(np),
+          [&](std::size_t i) {
+            Eigen::Vector3d g = -gp[i];
+            for (int a = byPoint.start[i]; a < byPoint.start[i + 1]; ++a) {
+              const int o = byPoint.items[a];
+              const int jv = var[observations[o].camera];
+              if (jv >= 0)
+                g.noalias() -= W[o].transpose() * dc.segment<6>(6 * jv);
+            }
+            dp[i] = Vinv[i] * g;
+          },
+          1024);
+
+      std::vector<BundleCamera> newCameras = cameras;
+      std::vector<Eigen::Vector3d> newPoints = points;
+      double step2 = 0.0, size2 = 0.0;
+      for (int j = 0; j < nc; ++j) {
+        if (var[j] < 0)
+          continue;
+        const Vector6 d = dc.segment<6>(6 * var[j]);
+        const Eigen::Vector3d omega = d.head<3>();
+        if (omega.norm() > 0.0)
+          newCameras[j].R =
+              Eigen::AngleAxisd(omega.norm(), omega.normalized()) *
+              cameras[j].R;
+        newCameras[j].t += d.tail<3>();
+        step2 += d.squaredNorm();
+        size2 += cameras[j].t.squaredNorm();
+      }
+      for (int i = 0; i < np; ++i) {
+        newPoints[i] += dp[i];
+        step2 += dp[i].squaredNorm();
+        size2 += points[i].squaredNorm();
+      }
+      if (std::sqrt(step2) <=
+          parameters.parameterTolerance * (std::sqrt(size2) + 1.0)) {
+        converged = true;
+        break;
+      }
+      Cost newCost = evaluate(newCameras, newPoints, observations, parameters);
+      if (!(newCost.robust < cost.robust)) {
+        lambda *= 10.0;
+        ++result.rejectedSteps;
+        continue;
+      }
+      accepted = true;
+      converged = cost.robust - newCost.robust <=
+                  parameters.functionTolerance * cost.robust;
+      cameras.swap(newCameras);
+      points.swap(newPoints);
+      cost = newCost;
+      lambda = std::max(lambda / 10.0, 1e-12);
+    }
+    if (converged || !accepted) {
+      result.converged = converged;
+      break;
+    }
+  }
+  result.finalCost = cost.robust;
+  result.finalRmse = no ? std::sqrt(cost.squared / no) : 0.0;
+  result.seconds = secondsSince(start);
+  return result;
+}
@@ -0,0 +1,74 @@
+//
+//  Sparse bundle adjustment: joint refinement of camera poses and 3d points
+//  from their image observations
+//
+#pragma once
+
+#include "PerspectiveCamera.h"
+
+#include <Eigen/Dense>
+#include <vector>
+
+// pose of a PerspectiveCamera with its (fixed) intrinsics; a world point X
+// is seen at principalPoint + focal * (x, y) / z with (x, y, z) = R X + t
+struct BundleCamera {
+  Eigen::Matrix3d R = Eigen::Matrix3d::Identity(); // rows: the camera axes
+  Eigen::Vector3d t = Eigen::Vector3d::Zero();
+  double focal = 1.0; // imagePlaneDistance
+  Eigen::Vector2d principalPoint = Eigen::Vector2d::Zero();
+  bool fixed = false; // kept constant, at least one fixes the gauge
+
+  Eigen::Vector3d center() const { return -R.transpose() * t; }
+};
+
+BundleCamera bundleCamera(const PerspectiveCamera &camera);
+// writes the pose (centre and axes) of b to camera
+void setCameraPose(PerspectiveCamera &camera, const BundleCamera &b);
+
+// point seen by camera at image plane coordinates image, without
+// distortion (see UndistortionLUT)
+struct BundleObservation {
+  int camera, point;
+  Eigen::Vector2d image;
+};
+
+enum class RobustLoss {
+  RL_NONE,  // squared error
+  RL_HUBER, // quadratic up to lossScale, linear beyond
+  RL_CAUCHY // log(1 + r^2 / lossScale^2)
+};
+
+struct BundleAdjustmentParameters {
+  RobustLoss loss = RobustLoss::RL_HUBER;
+  double lossScale = 1e-3; // image plane units
+  int maxIterations = 50;
+  double initialLambda = 1e-4; // Levenberg-Marquardt damping
+  // convergence: the cost decreases by less than this fraction ...
+  double functionTolerance = 1e-8;
+  // ... or the step is smaller than this relative to the parameters
+  double parameterTolerance = 1e-10;
+};
+
+struct BundleAdjustmentResult {
+  double initialCost = 0.0, finalCost = 0.0; // robust cost, 1/2 sum rho
+  double initialRmse = 0.0, finalRmse = 0.0; // reprojection, unweighted
+  int iterations = 0;
+  int rejectedSteps = 0; // that increased the cost and raised the damping
+  bool converged = false;
+  double seconds = 0.0;
+};
+
+// Levenberg-Marquardt over the camera poses (rotations as left-multiplied
+// rotation vectors) and the points, with analytic Jacobians and the robust
+// loss applied as iteratively reweighted least squares. The points are
+// eliminated by the Schur complement: the reduced camera system is
+// assembled block row by block row in parallel into a fixed sparsity
+// pattern, factorised by a sparse LDL^T decomposition, and the point
+// updates are back-substituted point by point in parallel. Cameras without
+// observations are left unchanged, like fixed ones.
+BundleAdjustmentResult
+bundleAdjust(std::vector<BundleCamera> &cameras,
+             std::vector<Eigen::Vector3d> &points,
+             const std::vector<BundleObservation> &observations,
+             const BundleAdjustmentParameters &parameters =
+                 BundleAdjustmentParameters());
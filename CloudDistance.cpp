@@ -0,0 +1,141 @@
+#include "CloudDistance.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+// non-negative floats order like their bit patterns, so an atomic maximum
+// of squared distances can be kept as an integer
+std::uint32_t bits(float f) {
+  std::uint32_t u;
+  std::memcpy(&u, &f, sizeof u);
+  return u;
+}
+
+float fromBits(std::uint32_t u) {
+  float f;
+  std::memcpy(&f, &u, sizeof f);
+  return f;
+}
+
+void atomicMax(std::atomic<std::uint32_t> &a, float f) {
+  std::uint32_t value = bits(f), current = a.load();
+  while (value > current && !a.compare_exchange_weak(current, value))
+    ;
+}
+
+} // namespace
+
+DistanceStatistics cloudToCloudDistance(PointCloud &cloud,
+                                        const KdTree &target,
+                                        const std::string &name) {
+  const std::size_t n = cloud.size();
+  std::vector<float> &distance = cloud.attribute(name);
+  const QVector4D *queries = cloud.constData();
+
+  struct Sums {
+    double sum = 0.0, sum2 = 0.0;
+    float max = 0.0f;
+  };
+  std::vector<Sums> partial(parallelChunkCount(n));
+  parallelChunks(n, [&](std::size_t b, std::size_t e, unsigned c) {
+    const std::size_t batch = 1024;
+    int indices[batch];
+    float dist2[batch];
+    for (std::size_t i = b; i < e; i += batch) {
+      const std::size_t m = std::min(batch, e - i);
+      target.nearestBatch(queries + i, m, indices, dist2);
+      for (std::size_t j = 0; j < m; ++j) {
+        float d = std::sqrt(dist2[j]);
+        distance[i + j] = d;
+        partial[c].sum += d;
+        partial[c].sum2 += double(dist2[j]);
+        partial[c].max = std::max(partial[c].max, d);
+      }
+    }
+  });
+
+  DistanceStatistics statistics;
+  statistics.count = n;
+  if (n == 0)
+    return statistics;
+  Sums total;
+  for (const Sums &s : partial) {
+    total.sum += s.sum;
+    total.sum2 += s.sum2;
+    total.max = std::max(total.max, s.max);
+  }
+  statistics.mean = total.sum / n;
+  statistics.rms = std::sqrt(total.sum2 / n);
+  statistics.max = total.max;
+  // one copy, successive selections on shrinking upper ranges
+  std::vector<float> sorted(distance);
+  auto select = [&](double p, std::size_t from) {
+    std::size_t k = std::min(n - 1, std::size_t(p * (n - 1) + 0.5));
+    std::nth_element(sorted.begin() + std::min(from, k), sorted.begin() + k,
+                     sorted.end());
+    return k;
+  };
+  std::size_t k = select(0.5, 0);
+  statistics.median = sorted[k];
+  k = select(0.95, k);
+  statistics.p95 = sorted[k];
+  k = select(0.99, k);
+  statistics.p99 = sorted[k];
+  return statistics;
+}
+
+float distancePercentile(const std::vector<float> &distances, double p) {
+  if (distances.empty())
+    return 0.0f;
+  std::vector<float> copy(distances);
+  std::size_t k =
+      std::size_t(std::clamp(p, 0.0, 1.0) * (copy.size() - 1) + 0.5);
+  std::nth_element(copy.begin(), copy.begin() + k, copy.end());
+  return copy[k];
+}
+
+float directedHausdorffDistance(const KdTree &source, const KdTree &target,
+                                float lowerBound) {
+  const PointCloud &cloud = source.cloud();
+  const std::size_t n = cloud.size();
+  const QVector4D *queries = cloud.constData();
+  std::atomic<std::uint32_t> maxDist2(bits(lowerBound * lowerBound));
+
+  // exact distances of an evenly strided sample as the starting maximum
+  const std::size_t samples = std::min<std::size_t>(n, 1024);
+  for (std::size_t s = 0; s < samples; ++s) {
+    float d2;
+    target.nearest(QVector3D(queries[s * n / samples]), &d2);
+    atomicMax(maxDist2, d2);
+  }
+
+  // a search that ends early found a point within the maximum, so it cannot
+  // raise it; one that does not is exact
+  parallelChunks(n, [&](std::size_t b, std::size_t e, unsigned) {
+    const std::size_t batch = 256;
+    int indices[batch];
+    float dist2[batch];
+    for (std::size_t i = b; i < e; i += batch) {
+      const std::size_t m = std::min(batch, e - i);
+      const float bound = fromBits(maxDist2.load(std::memory_order_relaxed));
+      target.nearestBatch(queries + i, m, indices, dist2, bound);
+      float batchMax = 0.0f;
+      for (std::size_t j = 0; j < m; ++j)
+        batchMax = std::max(batchMax, dist2[j]);
+      if (batchMax > bound)
+        atomicMax(maxDist2, batchMax);
+    }
+  });
+  return std::sqrt(fromBits(maxDist2.load()));
+}
+
+float hausdorffDistance(const KdTree &a, const KdTree &b) {
+  // the first direction's result bounds the second one from below
+  return directedHausdorffDistance(b, a, directedHausdorffDistance(a, b));
+}
@@ -0,0 +1,44 @@
+//
+//  Cloud-to-cloud distances: per-point nearest distances, their summary
+//  statistics and the Hausdorff distance, e.g. to check a registration or to
+//  compare scans from different epochs
+//
+#pragma once
+
+#include "KdTree.h"
+
+#include <string>
+#include <vector>
+
+struct DistanceStatistics {
+  std::size_t count = 0;
+  double mean = 0.0;
+  double rms = 0.0;
+  float median = 0.0f;
+  float p95 = 0.0f; // 95th percentile
+  float p99 = 0.0f;
+  float max = 0.0f; // the one-sided Hausdorff distance
+};
+
+// Distance from every point of cloud to its nearest point in target, written
+// to the attribute column name of cloud. The queries run as parallel
+// KdTree::nearestBatch calls over chunks of cloud, which are coherent if
+// cloud is in a tree's order.
+DistanceStatistics cloudToCloudDistance(PointCloud &cloud,
+                                        const KdTree &target,
+                                        const std::string &name = "distance");
+
+// p-quantile (p in [0, 1]) of the distances, by selection on a copy
+float distancePercentile(const std::vector<float> &distances, double p);
+
+// One-sided Hausdorff distance max_a min_b |a - b| of the points of
+// source.cloud() to target.cloud(). A point's search stops as soon as it
+// finds a target point closer than the maximum so far (Taha and Hanbury), so
+// most points cost a single distance to their predecessor's neighbour; the
+// maximum starts from an exactly computed sample and is shared between the
+// threads. Returns lowerBound if that is larger.
+float directedHausdorffDistance(const KdTree &source, const KdTree &target,
+                                float lowerBound = 0.0f);
+
+// symmetric Hausdorff distance, the larger of both one-sided ones
+float hausdorffDistance(const KdTree &a, const KdTree &b);
@@ -0,0 +1,222 @@
+#include "Clustering.h"
+#include "KdTree.h"
+#include "Parallel.h"
+#include "SpatialHashGrid.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace {
+
+// Lock-free disjoint sets: roots are linked larger index under smaller one
+// by compare-and-swap, so concurrent unions never form cycles; finds halve
+// their paths on the way.
+class ConcurrentUnionFind {
+public:
+  explicit ConcurrentUnionFind(std::size_t n)
+      : parent(new std::atomic<int>[n]) {
+    parallelFor(n, [&](std::size_t i) {
+      parent[i].store(int(i), std::memory_order_relaxed);
+    });
+  }
+
+  int find(int x) const {
+    for (;;) {
+      int p = parent[x].load(std::memory_order_acquire);
+      if (p == x)
+        return x;
+      int gp = parent[p].load(std::memory_order_acquire);
+      if (p != gp) // halving: a lost race only skips the shortcut
+        parent[x].compare_exchange_weak(p, gp, std::memory_order_release,
+                                        std::memory_order_relaxed);
+      x = gp;
+    }
+  }
+
+  void unite(int a, int b) {
+    for (;;) {
+      a = find(a);
+      b = find(b);
+      if (a == b)
+        return;
+      if (a < b)
+        std::swap(a, b);
+      int expected = a; // a is still a root if the exchange succeeds
+      if (parent[a].compare_exchange_strong(expected, b,
+                                            std::memory_order_acq_rel))
+        return;
+    }
+  }
+
+private:
+  std::unique_ptr<std::atomic<int>[]> parent;
+};
+
+// labels point i with the component of representative[i] (-1: none); the
+// components are numbered in the order of their first point and dropped if
+// their size is outside [minSize, maxSize]
+ClusteringResult label(const PointCloud &cloud, const ConcurrentUnionFind &uf,
+                       const std::vector<int> &representative, int minSize,
+                       int maxSize) {
+  const std::size_t n = cloud.size();
+  std::vector<int> root(n);
+  parallelFor(n, [&](std::size_t i) {
+    root[i] = representative[i] < 0 ? -1 : uf.find(representative[i]);
+  });
+
+  std::vector<int> count(n, 0);
+  for (std::size_t i = 0; i < n; ++i)
+    if (root[i] >= 0)
+      ++count[root[i]];
+
+  ClusteringResult result;
+  result.labels.assign(n, -1);
+  std::vector<int> id(n, -1);
+  const QVector4D *pts = cloud.constData();
+  for (std::size_t i = 0; i < n; ++i) {
+    int r = root[i];
+    if (r < 0 || count[r] < minSize || count[r] > maxSize)
+      continue;
+    QVector3D p(pts[i]);
+    if (id[r] < 0) {
+      id[r] = result.clusterCount();
+      result.sizes.push_back(0);
+      result.min.push_back(p);
+      result.max.push_back(p);
+    }
+    int c = id[r];
+    result.labels[i] = c;
+    ++result.sizes[c];
+    for (int k = 0; k < 3; ++k) {
+      result.min[c][k] = std::min(result.min[c][k], p[k]);
+      result.max[c][k] = std::max(result.max[c][k], p[k]);
+    }
+  }
+  return result;
+}
+
+} // namespace
+
+template <typename Index>
+ClusteringResult euclideanClusters(const Index &index, float tolerance,
+                                   int minSize, int maxSize) {
+  const PointCloud &cloud = index.cloud();
+  const std::size_t n = cloud.size();
+  ConcurrentUnionFind uf(n);
+  parallelChunks(
+      n,
+      [&](std::size_t b, std::size_t e, unsigned) {
+        std::vector<int> neighbours;
+        for (std::size_t i = b; i < e; ++i) {
+          index.radiusSearch(QVector3D(cloud.constData()[i]), tolerance,
+                             neighbours);
+          for (int j : neighbours)
+            if (j > int(i))
+              uf.unite(int(i), j);
+        }
+      },
+      256);
+
+  std::vector<int> representative(n);
+  for (std::size_t i = 0; i < n; ++i)
+    representative[i] = int(i);
+  return label(cloud, uf, representative, minSize, maxSize);
+}
+
+template <typename Index>
+ClusteringResult dbscan(const Index &index, float eps, int minPoints) {
+  const PointCloud &cloud = index.cloud();
+  const QVector4D *pts = cloud.constData();
+  const std::size_t n = cloud.size();
+
+  std::vector<std::uint8_t> core(n);
+  parallelChunks(
+      n,
+      [&](std::size_t b, std::size_t e, unsigned) {
+        std::vector<int> neighbours;
+        for (std::size_t i = b; i < e; ++i) {
+          index.radiusSearch(QVector3D(pts[i]), eps, neighbours);
+          core[i] = int(neighbours.size()) >= minPoints;
+        }
+      },
+      256);
+
+  // core points merge with their core neighbours, border points remember
+  // their nearest core neighbour
+  ConcurrentUnionFind uf(n);
+  std::vector<int> representative(n, -1);
+  parallelChunks(
+      n,
+      [&](std::size_t b, std::size_t e, unsigned) {
+        std::vector<int> neighbours;
+        std::vector<float> dist2;
+        for (std::size_t i = b; i < e; ++i) {
+          index.radiusSearch(QVector3D(pts[i]), eps, neighbours, &dist2);
+          if (core[i]) {
+            representative[i] = int(i);
+            for (int j : neighbours)
+              if (j > int(i) && core[j])
+                uf.unite(int(i), j);
+            continue;
+          }
+          float best = std::numeric_limits<float>::max();
+          for (std::size_t k = 0; k < neighbours.size(); ++k)
+            if (core[neighbours[k]] && dist2[k] < best) {
+              best = dist2[k];
+              representative[i] = neighbours[k];
+            }
+        }
+      },
+      256);
+  return label(cloud, uf, representative, 1, std::numeric_limits<int>::max());
+}
+
+template ClusteringResult euclideanClusters(const KdTree &, float, int, int);
+template ClusteringResult euclideanClusters(const SpatialHashGrid &, float,
+                                            int, int);
+template ClusteringResult dbscan(const KdTree &, float, int);
+template ClusteringResult dbscan(const SpatialHashGrid &, float, int);
+
+ClusterBoxes::ClusterBoxes(const ClusteringResult &clusters)
+    : m_min(clusters.min), m_max(clusters.max) {
+  type = SceneObjectType::ST_CLUSTER_BOXES;
+}
+
+void ClusterBoxes::affineMap(const QMatrix4x4 &M) {
+  // the boxes stay axis aligned: they enclose their mapped corners
+  for (std::size_t c = 0; c < m_min.size(); ++c) {
+    QVector3D mn, mx;
+    for (int corner = 0; corner < 8; ++corner) {
+      QVector3D p(corner & 1 ? m_max[c].x() : m_min[c].x(),
+                  corner & 2 ? m_max[c].y() : m_min[c].y(),
+                  corner & 4 ? m_max[c].z() : m_min[c].z());
+      p = M.map(p);
+      for (int k = 0; k < 3; ++k) {
+        mn[k] = corner ? std::min(mn[k], p[k]) : p[k];
+        mx[k] = corner ? std::max(mx[k], p[k]) : p[k];
+      }
+    }
+    m_min[c] = mn;
+    m_max[c] = mx;
+  }
+}
+
+void ClusterBoxes::draw(const RenderCamera &renderer, const QColor &colour,
+                        float lineWidth) const {
+  // 12 wire-frame edges per box: from the corners with bit k clear along k
+  for (std::size_t c = 0; c < m_min.size(); ++c)
+    for (int corner = 0; corner < 8; ++corner)
+      for (int k = 0; k < 3; ++k) {
+        if (corner & (1 << k))
+          continue;
+        int other = corner | (1 << k);
+        auto point = [&](int i) {
+          return QVector4D(i & 1 ? m_max[c].x() : m_min[c].x(),
+                           i & 2 ? m_max[c].y() : m_min[c].y(),
+                           i & 4 ? m_max[c].z() : m_min[c].z(), 1.0f);
+        };
+        renderer.renderLine(point(corner), point(other), colour, lineWidth);
+      }
+}
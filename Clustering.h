@@ -0,0 +1,51 @@
+//
+//  Euclidean cluster extraction and DBSCAN on top of radius queries
+//
+//  Neighbourhoods are merged concurrently in a lock-free union-find, so both
+//  run in parallel over the points. They work with any spatial index that
+//  offers cloud() and radiusSearch() like KdTree and SpatialHashGrid.
+//
+#pragma once
+
+#include "PointCloud.h"
+#include "SceneObject.h"
+
+#include <limits>
+#include <vector>
+
+struct ClusteringResult {
+  std::vector<int> labels; // per point of the index' cloud, -1 for none
+  std::vector<int> sizes;  // per cluster
+  std::vector<QVector3D> min, max; // per cluster AABB
+
+  int clusterCount() const { return int(sizes.size()); }
+};
+
+// Connected components of the graph joining points closer than tolerance.
+// Components outside [minSize, maxSize] are labelled -1. Clusters are
+// numbered in the order of their first point.
+template <typename Index>
+ClusteringResult
+euclideanClusters(const Index &index, float tolerance, int minSize = 1,
+                  int maxSize = std::numeric_limits<int>::max());
+
+// DBSCAN: points with at least minPoints neighbours within eps (themselves
+// included) are core points; core points within eps of each other share a
+// cluster. A border point joins the cluster of its nearest core neighbour,
+// which makes the result independent of the thread schedule. Noise is -1.
+template <typename Index>
+ClusteringResult dbscan(const Index &index, float eps, int minPoints);
+
+// the cluster AABBs as a scene object, drawn like the KdTree boxes
+class ClusterBoxes : public SceneObject {
+public:
+  explicit ClusterBoxes(const ClusteringResult &clusters);
+
+  void affineMap(const QMatrix4x4 &M) override;
+  void draw(const RenderCamera &renderer,
+            const QColor &colour = QColorConstants::Magenta,
+            float lineWidth = 1.5f) const override;
+
+private:
+  std::vector<QVector3D> m_min, m_max;
+};
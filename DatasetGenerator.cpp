@@ -0,0 +1,404 @@
+#include "DatasetGenerator.h"
+#include "Parallel.h"
+#include "PointRasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+namespace {
+
+const char MAGIC[4] = {'S', 'D', 'S', '1'};
+const std::uint32_t VERSION = 1;
+
+// random albedo in [0.2, 1] per point, independent of the thread schedule
+float albedo(int point, unsigned seed) {
+  std::uint64_t x =
+      (std::uint64_t(point) << 32 | seed) * 0x9e3779b97f4a7c15ULL;
+  x ^= x >> 29;
+  return 0.2f + 0.8f * float(x >> 40) / float(1 << 24);
+}
+
+// a grey image from the visible point indices and their shading
+Image<std::uint8_t> shade(const RasterImages &raster, float scale,
+                          unsigned seed, float noise, std::mt19937 &rng) {
+  const int W = raster.index.width(), H = raster.index.height();
+  Image<std::uint8_t> image(W, H, 0);
+  std::normal_distribution<float> gauss(0.0f, noise);
+  for (int y = 0; y < H; ++y)
+    for (int x = 0; x < W; ++x) {
+      int point = raster.index(x, y);
+      float grey = point < 0 ? 0.0f
+                             : 255.0f * std::min(raster.intensity(x, y) *
+                                                     scale, 1.0f) *
+                                   albedo(point, seed);
+      if (noise > 0.0f)
+        grey += gauss(rng);
+      image(x, y) = std::uint8_t(std::clamp(std::lround(grey), 0L, 255L));
+    }
+  return image;
+}
+
+void addNoise(Image<float> &depth, float noise, std::mt19937 &rng) {
+  if (noise <= 0.0f)
+    return;
+  std::normal_distribution<float> gauss(0.0f, noise);
+  float *d = depth.data();
+  for (std::size_t i = 0, n = std::size_t(depth.width()) * depth.height();
+       i < n; ++i)
+    if (std::isfinite(d[i]))
+      d[i] += gauss(rng);
+}
+
+class Writer {
+public:
+  explicit Writer(const std::string &path)
+      : m_file(path, std::ios::binary) {
+    if (!m_file)
+      throw std::runtime_error("cannot open " + path + " for writing");
+  }
+  template <typename T> void put(const T &value) { put(&value, 1); }
+  template <typename T> void put(const T *values, std::size_t n) {
+    m_file.write(reinterpret_cast<const char *>(values),
+                 std::streamsize(n * sizeof(T)));
+    if (!m_file)
+      throw std::runtime_error("writing the dataset failed");
+  }
+  void put(const QVector3D &v) {
+    float f[3] = {v.x(), v.y(), v.z()};
+    put(f, 3);
+  }
+  void put(const QVector2D &v) {
+    float f[2] = {v.x(), v.y()};
+    put(f, 2);
+  }
+
+private:
+  std::ofstream m_file;
+};
+
+class Reader {
+public:
+  explicit Reader(const std::string &path) : m_file(path, std::ios::binary) {
+    if (!m_file)
+      throw std::runtime_error("cannot open " + path);
+  }
+  template <typename T> T get() {
+    T value;
+    get(&value, 1);
+    return value;
+  }
+  template <typename T> void get(T *values, std::size_t n) {
+    m_file.read(reinterpret_cast<char *>(values),
+                std::streamsize(n * sizeof(T)));
+    if (!m_file)
+      throw std::runtime_error("truncated dataset");
+  }
+  QVector3D vector3D() {
+    float f[3];
+    get(f, 3);
+    return QVector3D(f[0], f[1], f[2]);
+  }
+  QVector2D vector2D() {
+    float f[2];
+    get(f, 2);
+    return QVector2D(f[0], f[1]);
+  }
+
+private:
+  std::ifstream m_file;
+};
+
+} // namespace
+
+std::unique_ptr<PerspectiveCamera> Dataset::camera(std::size_t rig,
+                                                   bool right) const {
+  const DatasetRig &r = rigs.at(rig);
+  auto camera = std::make_unique<PerspectiveCamera>(
+      QVector4D(right ? r.rightCenter : r.leftCenter, 1.0f), r.pose,
+      imagePlaneSize, imagePlaneDistance, principalPoint);
+  camera->distortion = distortion;
+  return camera;
+}
+
+Dataset generateDataset(const PointCloud &cloud,
+                        const DatasetParameters &parameters) {
+  if (parameters.rigs <= 0 || parameters.width <= 0 ||
+      parameters.height <= 0 || !(parameters.distance > 1.0f))
+    throw std::runtime_error("invalid dataset parameters");
+  if (cloud.isEmpty())
+    throw std::runtime_error("cannot render an empty cloud");
+
+  Dataset dataset;
+  dataset.width = parameters.width;
+  dataset.height = parameters.height;
+  dataset.imagePlaneSize = parameters.imagePlaneSize;
+  dataset.imagePlaneDistance = parameters.imagePlaneDistance;
+  dataset.principalPoint = parameters.principalPoint;
+  dataset.distortion = parameters.distortion;
+  dataset.rigs.resize(parameters.rigs);
+
+  QVector3D mn, mx;
+  cloud.boundingBox(mn, mx);
+  const QVector3D centre = 0.5f * (mn + mx);
+  const float radius = std::max(0.5f * (mx - mn).length(), 1e-6f);
+
+  RasterParameters raster;
+  raster.width = parameters.width;
+  raster.height = parameters.height;
+  raster.splatRadius = parameters.splatRadius;
+  raster.intensity = parameters.intensity;
+  float scale = 1.0f;
+  if (const std::vector<float> *column =
+          cloud.findAttribute(parameters.intensity)) {
+    float maximum = *std::max_element(column->begin(), column->end());
+    scale = maximum > 0.0f ? 1.0f / maximum : 1.0f;
+  }
+
+  const float elevation = parameters.elevation * float(M_PI) / 180.0f;
+  const QVector4D *points = cloud.constData();
+  const int W = parameters.width, H = parameters.height;
+  for (int r = 0; r < parameters.rigs; ++r) {
+    DatasetRig &rig = dataset.rigs[r];
+    std::mt19937 rng(parameters.seed + unsigned(r));
+
+    // looking at the centre, image y as close to world y as possible
+    const float azimuth = 2.0f * float(M_PI) * r / parameters.rigs;
+    const float d = parameters.distance * radius;
+    rig.leftCenter =
+        centre + d * QVector3D(std::cos(elevation) * std::sin(azimuth),
+                               std::sin(elevation),
+                               std::cos(elevation) * std::cos(azimuth));
+    QVector3D forward = (centre - rig.leftCenter).normalized();
+    QVector3D right =
+        QVector3D::crossProduct(forward, QVector3D(0, 1, 0)).normalized();
+    QVector3D up = QVector3D::crossProduct(right, forward);
+    rig.pose.setColumn(0, QVector4D(right, 0));
+    rig.pose.setColumn(1, QVector4D(up, 0));
+    rig.pose.setColumn(2, QVector4D(forward, 0));
+    rig.pose.setColumn(3, QVector4D(0, 0, 0, 1));
+    rig.rightCenter = rig.leftCenter + parameters.baseline * radius * right;
+
+    auto left = dataset.camera(r, false), rightCamera = dataset.camera(r, true);
+    RasterImages leftRaster = rasterize(cloud, *left, raster);
+    RasterImages rightRaster = rasterize(cloud, *rightCamera, raster);
+    rig.leftImage =
+        shade(leftRaster, scale, parameters.seed, parameters.imageNoise, rng);
+    rig.rightImage =
+        shade(rightRaster, scale, parameters.seed, parameters.imageNoise, rng);
+
+    // candidates are the points rendered in the left view; they correspond
+    // where the projections in both views are not occluded
+    std::vector<char> seen(cloud.size(), 0);
+    const int *index = leftRaster.index.data();
+    for (std::size_t p = 0, n = std::size_t(W) * H; p < n; ++p)
+      if (index[p] >= 0)
+        seen[index[p]] = 1;
+    std::vector<int> candidates;
+    for (std::size_t i = 0; i < seen.size(); ++i)
+      if (seen[i])
+        candidates.push_back(int(i));
+
+    const float tolerance = 1.0f + parameters.occlusionTolerance;
+    auto visible = [&](const PerspectiveCamera &camera,
+                       const Image<float> &depth, const QVector3D &world,
+                       QVector2D &pixel) {
+      QVector3D c = camera.toCamera(world);
+      if (c.z() <= 0.0f)
+        return false;
+      pixel = camera.toPixel(c, W, H);
+      int x = int(std::lround(pixel.x())), y = int(std::lround(pixel.y()));
+      return depth.contains(x, y) && c.z() <= depth(x, y) * tolerance;
+    };
+    std::vector<DatasetCorrespondence> found(candidates.size());
+    std::vector<char> valid(candidates.size(), 0);
+    parallelFor(candidates.size(), [&](std::size_t k) {
+      DatasetCorrespondence &c = found[k];
+      c.point = candidates[k];
+      c.world = QVector3D(points[c.point]);
+      valid[k] = visible(*left, leftRaster.depth, c.world, c.left) &&
+                 visible(*rightCamera, rightRaster.depth, c.world, c.right);
+    });
+    for (std::size_t k = 0; k < found.size(); ++k)
+      if (valid[k])
+        rig.correspondences.push_back(found[k]);
+
+    auto &correspondences = rig.correspondences;
+    if (parameters.maxCorrespondences > 0 &&
+        correspondences.size() > std::size_t(parameters.maxCorrespondences)) {
+      std::shuffle(correspondences.begin(), correspondences.end(), rng);
+      correspondences.resize(parameters.maxCorrespondences);
+      std::sort(correspondences.begin(), correspondences.end(),
+                [](const DatasetCorrespondence &a,
+                   const DatasetCorrespondence &b) {
+                  return a.point < b.point;
+                });
+    }
+    if (parameters.correspondenceNoise > 0.0f) {
+      std::normal_distribution<float> gauss(0.0f,
+                                            parameters.correspondenceNoise);
+      for (auto &c : correspondences) {
+        c.left += QVector2D(gauss(rng), gauss(rng));
+        c.right += QVector2D(gauss(rng), gauss(rng));
+      }
+    }
+
+    rig.leftDepth = std::move(leftRaster.depth);
+    rig.rightDepth = std::move(rightRaster.depth);
+    addNoise(rig.leftDepth, parameters.depthNoise, rng);
+    addNoise(rig.rightDepth, parameters.depthNoise, rng);
+  }
+  return dataset;
+}
+
+void Dataset::save(const std::string &path) const {
+  Writer out(path);
+  out.put(MAGIC, 4);
+  out.put(VERSION);
+  out.put(std::int32_t(width));
+  out.put(std::int32_t(height));
+  out.put(std::int32_t(rigs.size()));
+  const float intrinsics[9] = {imagePlaneSize,    imagePlaneDistance,
+                               principalPoint.x(), principalPoint.y(),
+                               distortion.k1,     distortion.k2,
+                               distortion.k3,     distortion.p1,
+                               distortion.p2};
+  out.put(intrinsics, 9);
+
+  const std::size_t pixels = std::size_t(width) * height;
+  for (const DatasetRig &rig : rigs) {
+    if (rig.leftImage.width() != width || rig.leftImage.height() != height ||
+        rig.rightImage.width() != width ||
+        rig.rightImage.height() != height ||
+        rig.leftDepth.width() != width || rig.leftDepth.height() != height ||
+        rig.rightDepth.width() != width || rig.rightDepth.height() != height)
+      throw std::runtime_error("rig images do not match the dataset size");
+    out.put(rig.leftCenter);
+    out.put(rig.rightCenter);
+    for (int c = 0; c < 3; ++c)
+      out.put(QVector3D(rig.pose.column(c)));
+    out.put(rig.leftImage.data(), pixels);
+    out.put(rig.rightImage.data(), pixels);
+    out.put(rig.leftDepth.data(), pixels);
+    out.put(rig.rightDepth.data(), pixels);
+    out.put(std::uint32_t(rig.correspondences.size()));
+    for (const DatasetCorrespondence &c : rig.correspondences) {
+      out.put(std::int32_t(c.point));
+      out.put(c.world);
+      out.put(c.left);
+      out.put(c.right);
+    }
+  }
+}
+
+Dataset Dataset::load(const std::string &path) {
+  Reader in(path);
+  char magic[4];
+  in.get(magic, 4);
+  if (std::memcmp(magic, MAGIC, 4) != 0)
+    throw std::runtime_error(path + " is not a dataset");
+  if (in.get<std::uint32_t>() != VERSION)
+    throw std::runtime_error("unsupported dataset version");
+
+  Dataset dataset;
+  dataset.width = in.get<std::int32_t>();
+  dataset.height = in.get<std::int32_t>();
+  const std::int32_t rigCount = in.get<std::int32_t>();
+  if (dataset.width <= 0 || dataset.height <= 0 || rigCount < 0)
+    throw std::runtime_error("corrupt dataset header");
+  float intrinsics[9];
+  in.get(intrinsics, 9);
+  dataset.imagePlaneSize = intrinsics[0];
+  dataset.imagePlaneDistance = intrinsics[1];
+  dataset.principalPoint = QVector2D(intrinsics[2], intrinsics[3]);
+  dataset.distortion = {intrinsics[4], intrinsics[5], intrinsics[6],
+                        intrinsics[7], intrinsics[8]};
+
+  const int W = dataset.width, H = dataset.height;
+  const std::size_t pixels = std::size_t(W) * H;
+  dataset.rigs.resize(rigCount);
+  for (DatasetRig &rig : dataset.rigs) {
+    rig.leftCenter = in.vector3D();
+    rig.rightCenter = in.vector3D();
+    for (int c = 0; c < 3; ++c)
+      rig.pose.setColumn(c, QVector4D(in.vector3D(), 0));
+    rig.pose.setColumn(3, QVector4D(0, 0, 0, 1));
+    rig.leftImage = Image<std::uint8_t>(W, H);
+    rig.rightImage = Image<std::uint8_t>(W, H);
+    rig.leftDepth = Image<float>(W, H);
+    rig.rightDepth = Image<float>(W, H);
+    in.get(rig.leftImage.data(), pixels);
+    in.get(rig.rightImage.data(), pixels);
+    in.get(rig.leftDepth.data(), pixels);
+    in.get(rig.rightDepth.data(), pixels);
+    rig.correspondences.resize(in.get<std::uint32_t>());
+    for (DatasetCorrespondence &c : rig.correspondences) {
+      c.point = in.get<std::int32_t>();
+      c.world = in.vector3D();
+      c.left = in.vector2D();
+      c.right = in.vector2D();
+    }
+  }
+  return dataset;
+}
+
+PointCloud sampleSurface(const TriangleMesh &mesh, std::size_t count,
+                         unsigned seed) {
+  const std::size_t triangles = mesh.triangleCount();
+  const auto &v = mesh.vertices;
+  const auto &t = mesh.indices;
+  // cumulative areas; the normals are the unnormalised cross products
+  std::vector<double> area(triangles + 1, 0.0);
+  std::vector<QVector3D> normal(triangles);
+  for (std::size_t i = 0; i < triangles; ++i) {
+    normal[i] = QVector3D::crossProduct(v[t[3 * i + 1]] - v[t[3 * i]],
+                                        v[t[3 * i + 2]] - v[t[3 * i]]);
+    area[i + 1] = area[i] + 0.5 * normal[i].length();
+    normal[i].normalize();
+  }
+  if (!(area[triangles] > 0.0))
+    throw std::runtime_error("cannot sample a mesh without area");
+
+  QVector<QVector4D> samples(static_cast<qsizetype>(count));
+  std::vector<float> nx(count), ny(count), nz(count);
+  QVector4D *points = samples.data();
+
+  // blocks of fixed size with their own random streams, so the samples do
+  // not depend on the thread count
+  const std::size_t block = 1 << 16, blocks = (count + block - 1) / block;
+  parallelFor(
+      blocks,
+      [&](std::size_t b) {
+        std::mt19937 rng(seed * 0x9e3779b9u + unsigned(b));
+        std::uniform_real_distribution<double> uniform(0.0, area[triangles]);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (std::size_t i = b * block; i < std::min(count, (b + 1) * block);
+             ++i) {
+          std::size_t tri =
+              std::upper_bound(area.begin() + 1, area.end(), uniform(rng)) -
+              area.begin() - 1;
+          tri = std::min(tri, triangles - 1);
+          // uniform barycentric coordinates
+          float s = std::sqrt(unit(rng)), r = unit(rng);
+          QVector3D p = (1.0f - s) * v[t[3 * tri]] +
+                        s * (1.0f - r) * v[t[3 * tri + 1]] +
+                        s * r * v[t[3 * tri + 2]];
+          points[i] = QVector4D(p, 1.0f);
+          nx[i] = normal[tri].x();
+          ny[i] = normal[tri].y();
+          nz[i] = normal[tri].z();
+        }
+      },
+      1);
+  PointCloud cloud;
+  cloud.setPoints(samples);
+  cloud.attribute("nx") = std::move(nx);
+  cloud.attribute("ny") = std::move(ny);
+  cloud.attribute("nz") = std::move(nz);
+  cloud.computeBounds();
+  return cloud;
+}
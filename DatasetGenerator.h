@@ -0,0 +1,98 @@
+//
+//  Synthetic stereo and multi-view datasets with ground truth: rigs of two
+//  PerspectiveCameras on a ring around a point cloud (or samples of a mesh
+//  surface), rendered with rasterize() into grey images and depth maps,
+//  plus the exact correspondences of the points visible in both views
+//
+#pragma once
+
+#include "Image.h"
+#include "LensDistortion.h"
+#include "PerspectiveCamera.h"
+#include "PointCloud.h"
+#include "TriangleMesh.h"
+
+#include <QMatrix4x4>
+#include <QVector2D>
+#include <QVector3D>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct DatasetParameters {
+  int rigs = 8;            // evenly spaced on a ring around the scene
+  float distance = 3.0f;   // ring radius, in bounding sphere radii
+  float elevation = 20.0f; // of the cameras above the scene centre, degrees
+  float baseline = 0.1f;   // in bounding sphere radii
+  // intrinsics shared by all cameras, see PerspectiveCamera and toPixel
+  int width = 640, height = 480;
+  float imagePlaneSize = 1.0f, imagePlaneDistance = 2.0f;
+  QVector2D principalPoint;
+  LensDistortion distortion;
+  int splatRadius = 1; // see RasterParameters
+  // Gaussian noise (standard deviations) on the grey values, on the depth
+  // maps (scene units) and on the correspondences (pixels)
+  float imageNoise = 0.0f;
+  float depthNoise = 0.0f;
+  float correspondenceNoise = 0.0f;
+  // correspondences kept per rig, a random subset; 0 keeps all
+  int maxCorrespondences = 0;
+  // a point counts as visible if it is at most this fraction of its depth
+  // behind the rendered surface, so that splat overlaps do not hide it
+  float occlusionTolerance = 0.01f;
+  // attribute column shading the images, see RasterParameters
+  std::string intensity = "intensity";
+  unsigned seed = 1;
+};
+
+struct DatasetCorrespondence {
+  int point;       // index into the cloud
+  QVector3D world; // its position
+  QVector2D left, right; // pixel coordinates, see PerspectiveCamera::toPixel
+};
+
+// Two cameras with a common pose, the right one displaced by the baseline
+// along the image x axis, so that disparities are positive.
+struct DatasetRig {
+  QVector3D leftCenter, rightCenter;
+  QMatrix4x4 pose; // columns: image x, image y, viewing direction
+  Image<std::uint8_t> leftImage, rightImage;
+  Image<float> leftDepth, rightDepth; // +inf where empty
+  std::vector<DatasetCorrespondence> correspondences;
+};
+
+struct Dataset {
+  int width = 0, height = 0;
+  float imagePlaneSize = 1.0f, imagePlaneDistance = 1.0f;
+  QVector2D principalPoint;
+  LensDistortion distortion;
+  std::vector<DatasetRig> rigs;
+
+  // a camera of a rig as it was rendered with
+  std::unique_ptr<PerspectiveCamera> camera(std::size_t rig,
+                                            bool right) const;
+
+  // Binary layout, host byte order: the magic "SDS1" and a uint32 version,
+  // int32 width, height and rig count, float image plane size and distance,
+  // principal point and k1 k2 k3 p1 p2; then per rig the float centres (2x3)
+  // and pose axes (3x3, column by column), the uint8 left and right images,
+  // the float left and right depth maps, a uint32 correspondence count and
+  // per correspondence an int32 point index and floats world (3), left (2)
+  // and right (2). Both throw std::runtime_error on I/O or format errors.
+  void save(const std::string &path) const;
+  static Dataset load(const std::string &path);
+};
+
+// Renders the rigs one after another; every rig has its own random stream,
+// so the result depends only on the cloud and the parameters. Images are
+// shaded by the intensity column (scaled to its maximum) times a per-point
+// random albedo, which gives stereo matchers texture to work with.
+Dataset generateDataset(const PointCloud &cloud,
+                        const DatasetParameters &parameters =
+                            DatasetParameters());
+
+// count points spread uniformly over the mesh surface, with the face
+// normals as attributes "nx", "ny", "nz"
+PointCloud sampleSurface(const TriangleMesh &mesh, std::size_t count,
+                         unsigned seed = 1);
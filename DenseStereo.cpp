@@ -0,0 +1,451 @@
+#include "DenseStereo.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+constexpr int LANES = StereoMatcher::LANES;
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// 9x7 census signature: one bit per window pixel brighter than the centre,
+// 62 bits; the window is clamped at the image border
+void census(const Image<std::uint8_t> &image,
+            std::vector<std::uint64_t> &out) {
+  const int W = image.width(), H = image.height();
+  out.resize(std::size_t(W) * H);
+  parallelChunks(
+      std::size_t(H),
+      [&](std::size_t b, std::size_t e, unsigned) {
+        std::vector<std::uint8_t> padded(W + 8);
+        for (int y = int(b); y < int(e); ++y) {
+          std::uint64_t *signature = &out[std::size_t(y) * W];
+          std::fill(signature, signature + W, 0);
+          const std::uint8_t *centre = image.row(y);
+          for (int k = -3; k <= 3; ++k) {
+            const std::uint8_t *row = image.row(std::clamp(y + k, 0, H - 1));
+            std::copy(row, row + W, padded.begin() + 4);
+            std::fill_n(padded.begin(), 4, row[0]);
+            std::fill_n(padded.begin() + W + 4, 4, row[W - 1]);
+            for (int j = -4; j <= 4; ++j) {
+              if (k == 0 && j == 0)
+                continue;
+              const std::uint8_t *shifted = padded.data() + 4 + j;
+              for (int x = 0; x < W; ++x)
+                signature[x] =
+                    signature[x] << 1 | std::uint64_t(shifted[x] > centre[x]);
+            }
+          }
+        }
+      },
+      8);
+}
+
+// penalties and the saturation of the 16-bit path costs
+struct PathCosts {
+  int P1, P2;
+  int cap; // path costs stay below 65535 / paths, so that their sum fits
+  int stride; // disparities per pixel
+};
+
+PathCosts pathCosts(const StereoMatcherParameters &p, int stride) {
+  const int area = p.blockSize * p.blockSize;
+  return PathCosts{p.P1 * area, p.P2 * area, 65535 / p.paths - p.P2 * area,
+                   stride};
+}
+
+// One step of a semi-global matching path over LANES disparities, written
+// branch-free on local copies with a fixed trip count, so that the
+// vectoriser needs no alias checks; returns the minimum of the new costs.
+// previous[-1] and previous[LANES] must be readable.
+int pathStep(const std::uint16_t *c, const std::int16_t *previous,
+             std::int16_t *current, std::uint16_t *sum, std::int16_t P1,
+             std::int16_t jump, std::int16_t base) {
+  auto min16 = [](std::int16_t a, std::int16_t b) { return a < b ? a : b; };
+  std::int16_t p[LANES + 2], cost[LANES], out[LANES];
+  std::uint16_t total[LANES];
+  std::copy_n(previous - 1, LANES + 2, p);
+  std::copy_n(c, LANES, cost); // at most the cap, see boxFilter
+  std::copy_n(sum, LANES, total);
+  for (int k = 0; k < LANES; ++k) {
+    std::int16_t step = std::int16_t(min16(p[k], p[k + 2]) + P1);
+    std::int16_t best = min16(min16(p[k + 1], step), jump);
+    out[k] = std::int16_t(cost[k] + best - base);
+    total[k] = std::uint16_t(total[k] + out[k]);
+  }
+  std::copy_n(out, LANES, current);
+  std::copy_n(total, LANES, sum);
+  std::int16_t minimum = out[0];
+  for (int k = 1; k < LANES; ++k)
+    minimum = min16(minimum, out[k]);
+  return minimum;
+}
+
+// Path costs of one pixel from those of its predecessor on the path (null
+// at the path start), added to sum; returns their minimum.
+//   L(p, d) = C(p, d) + min(L(p-r, d), L(p-r, d+-1) + P1,
+//                          min L(p-r) + P2) - min L(p-r)
+// The path cost vectors carry a sentinel cap on either side.
+int pathPixel(const std::uint16_t *c, const std::int16_t *previous,
+              int previousMin, std::int16_t *current, std::uint16_t *sum,
+              const PathCosts &costs) {
+  const int jump = previous ? previousMin + costs.P2 : 0;
+  const int base = previous ? previousMin : 0;
+  if (!previous)
+    previous = current; // unused, every candidate is capped by jump = 0
+  int currentMin = costs.cap;
+  for (int k = 0; k < costs.stride; k += LANES)
+    currentMin = std::min(
+        currentMin, pathStep(c + k, previous + k, current + k, sum + k,
+                             std::int16_t(costs.P1), std::int16_t(jump),
+                             std::int16_t(base)));
+  return currentMin;
+}
+
+} // namespace
+
+StereoMatcher::StereoMatcher(const StereoMatcherParameters &parameters)
+    : m_parameters(parameters) {
+  const StereoMatcherParameters &p = m_parameters;
+  if (p.disparities < 1 || p.minDisparity < 0)
+    throw std::runtime_error("invalid disparity range");
+  if (p.blockSize < 1 || p.blockSize > 15 || p.blockSize % 2 == 0)
+    throw std::runtime_error("block size must be odd and at most 15");
+  if (p.paths != 4 && p.paths != 8)
+    throw std::runtime_error("semi-global matching uses 4 or 8 paths");
+  if (p.P1 < 0 || p.P2 < p.P1 ||
+      p.P2 * p.blockSize * p.blockSize >= 65535 / p.paths / 2)
+    throw std::runtime_error("penalties must satisfy 0 <= P1 <= P2 and fit "
+                             "the 16-bit path costs");
+  m_stride = (p.disparities + LANES - 1) / LANES * LANES;
+}
+
+Image<float> StereoMatcher::compute(const Image<std::uint8_t> &left,
+                                    const Image<std::uint8_t> &right) {
+  if (left.width() != right.width() || left.height() != right.height())
+    throw std::runtime_error("stereo images differ in size");
+  m_width = left.width();
+  m_height = left.height();
+  const std::size_t cells = std::size_t(m_width) * m_height * m_stride;
+
+  auto start = std::chrono::steady_clock::now();
+  m_cost.resize(cells);
+  pixelCosts(left, right);
+  if (m_parameters.blockSize > 1)
+    boxFilter();
+  m_timing.cost = secondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  if (m_parameters.semiGlobal) {
+    m_aggregated.assign(cells, 0);
+    aggregateRows();
+    aggregateSweep(1);
+    aggregateSweep(-1);
+  }
+  m_timing.aggregation = secondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  Image<float> disparity =
+      select(m_parameters.semiGlobal ? m_aggregated : m_cost);
+  m_timing.selection = secondsSince(start);
+  return disparity;
+}
+
+void StereoMatcher::pixelCosts(const Image<std::uint8_t> &left,
+                               const Image<std::uint8_t> &right) {
+  const int W = m_width, D = m_parameters.disparities, S = m_stride;
+  const int d0 = m_parameters.minDisparity;
+  const bool useCensus = m_parameters.cost == StereoCost::SC_CENSUS;
+  if (useCensus) {
+    census(left, m_censusLeft);
+    census(right, m_censusRight);
+  }
+  // disparities whose match would lie left of the image, and the padding,
+  // get the worst cost
+  const std::uint16_t worst = useCensus ? 62 : 255;
+  parallelChunks(
+      std::size_t(m_height),
+      [&](std::size_t b, std::size_t e, unsigned) {
+        for (int y = int(b); y < int(e); ++y) {
+          const std::uint8_t *l = left.row(y), *r = right.row(y);
+          const std::uint64_t *cl =
+              useCensus ? &m_censusLeft[std::size_t(y) * W] : nullptr;
+          const std::uint64_t *cr =
+              useCensus ? &m_censusRight[std::size_t(y) * W] : nullptr;
+          for (int x = 0; x < W; ++x) {
+            std::uint16_t *c = &m_cost[(std::size_t(y) * W + x) * S];
+            const int valid = std::clamp(x - d0 + 1, 0, D); // x - d >= 0
+            if (useCensus)
+              for (int k = 0; k < valid; ++k)
+                c[k] = std::uint16_t(std::popcount(cl[x] ^ cr[x - d0 - k]));
+            else
+              for (int k = 0; k < valid; ++k)
+                c[k] = std::uint16_t(std::abs(l[x] - r[x - d0 - k]));
+            std::fill(c + valid, c + S, worst);
+          }
+        }
+      },
+      8);
+}
+
+void StereoMatcher::boxFilter() {
+  const int W = m_width, H = m_height, S = m_stride;
+  const int radius = m_parameters.blockSize / 2;
+  // block costs saturate where semi-global matching needs it
+  const std::uint16_t cap = std::uint16_t(
+      m_parameters.semiGlobal ? pathCosts(m_parameters, S).cap : 0xffff);
+  // Horizontal running sums per row into m_rowSums, then vertical ones back
+  // into m_cost, over all disparities of a pixel at once. The block sums fit
+  // 16 bits, so the running sums may wrap in between.
+  const std::size_t span = std::size_t(W) * S;
+  m_rowSums.resize(m_cost.size());
+  parallelChunks(
+      std::size_t(H),
+      [&](std::size_t b, std::size_t e, unsigned) {
+        std::vector<std::uint16_t> sum(S);
+        for (int y = int(b); y < int(e); ++y) {
+          const std::uint16_t *c = &m_cost[std::size_t(y) * span];
+          std::uint16_t *out = &m_rowSums[std::size_t(y) * span];
+          std::fill(sum.begin(), sum.end(), 0);
+          auto at = [&](int x) {
+            return c + std::size_t(std::clamp(x, 0, W - 1)) * S;
+          };
+          for (int x = -radius; x <= radius; ++x)
+            for (int k = 0; k < S; ++k)
+              sum[k] += at(x)[k];
+          for (int x = 0; x < W; ++x, out += S) {
+            const std::uint16_t *add = at(x + radius + 1);
+            const std::uint16_t *sub = at(x - radius);
+            for (int k0 = 0; k0 < S; k0 += LANES)
+              for (int k = k0; k < k0 + LANES; ++k) {
+                out[k] = sum[k];
+                sum[k] += add[k] - sub[k];
+              }
+          }
+        }
+      },
+      8);
+
+  parallelChunks(
+      std::size_t(H),
+      [&](std::size_t b, std::size_t e, unsigned) {
+        auto at = [&](int y) {
+          return &m_rowSums[std::size_t(std::clamp(y, 0, H - 1)) * span];
+        };
+        std::vector<std::uint16_t> sum(span, 0);
+        for (int y = int(b) - radius; y <= int(b) + radius; ++y)
+          for (std::size_t k = 0; k < span; ++k)
+            sum[k] += at(y)[k];
+        for (int y = int(b); y < int(e); ++y) {
+          std::uint16_t *out = &m_cost[std::size_t(y) * span];
+          const std::uint16_t *add = at(y + radius + 1);
+          const std::uint16_t *sub = at(y - radius);
+          for (std::size_t k0 = 0; k0 < span; k0 += LANES)
+            for (std::size_t k = k0; k < k0 + LANES; ++k) {
+              out[k] = std::min(sum[k], cap);
+              sum[k] += add[k] - sub[k];
+            }
+        }
+      },
+      8);
+}
+
+void StereoMatcher::aggregateRows() {
+  const int W = m_width, S = m_stride;
+  const PathCosts costs = pathCosts(m_parameters, S);
+  parallelChunks(
+      std::size_t(m_height),
+      [&](std::size_t b, std::size_t e, unsigned) {
+        std::vector<std::int16_t> buffers(2 * (S + 2), std::int16_t(costs.cap));
+        std::int16_t *previous = buffers.data() + 1;
+        std::int16_t *current = buffers.data() + S + 3;
+        for (int y = int(b); y < int(e); ++y)
+          for (int dx : {1, -1}) {
+            int previousMin = 0;
+            for (int i = 0; i < W; ++i) {
+              const int x = dx > 0 ? i : W - 1 - i;
+              const std::size_t cell = (std::size_t(y) * W + x) * S;
+              previousMin =
+                  pathPixel(&m_cost[cell], i ? previous : nullptr, previousMin,
+                            current, &m_aggregated[cell], costs);
+              std::swap(previous, current);
+            }
+          }
+      },
+      8);
+}
+
+void StereoMatcher::aggregateSweep(int dy) {
+  const int W = m_width, H = m_height, S = m_stride;
+  const PathCosts costs = pathCosts(m_parameters, S);
+  std::vector<int> directions = {0}; // dx of the paths
+  if (m_parameters.paths == 8)
+    directions = {-1, 0, 1};
+  const int paths = int(directions.size());
+
+  // Rows are visited in order, keeping the path costs of the last two rows.
+  // Columns are split into one band per thread, which run as a wavefront: a
+  // band starts row i once its neighbours have finished row i - 1, as the
+  // diagonal paths read across the band borders and the row buffers are
+  // reused every other row.
+  const std::size_t rowSize = std::size_t(W) * (S + 2);
+  std::vector<std::int16_t> rows(2 * paths * rowSize, std::int16_t(costs.cap));
+  std::vector<int> minima(2 * paths * W);
+  auto row = [&](int parity, int path) {
+    return rows.data() + (parity * paths + path) * rowSize + 1;
+  };
+  auto rowMin = [&](int parity, int path) {
+    return minima.data() + (parity * paths + path) * W;
+  };
+
+  const int bands =
+      int(std::clamp<unsigned>(unsigned(W / 32), 1, parallelThreadCount()));
+  std::unique_ptr<std::atomic<int>[]> done(new std::atomic<int>[bands]);
+  for (int t = 0; t < bands; ++t)
+    done[t] = 0;
+  parallelChunks(
+      std::size_t(bands),
+      [&](std::size_t b, std::size_t, unsigned) {
+        const int t = int(b);
+        const int x0 = t * W / bands, x1 = (t + 1) * W / bands;
+        for (int i = 0; i < H; ++i) {
+          for (int n : {t - 1, t + 1})
+            while (n >= 0 && n < bands && done[n].load() < i)
+              std::this_thread::yield();
+          const int y = dy > 0 ? i : H - 1 - i, parity = i & 1;
+          for (int x = x0; x < x1; ++x) {
+            const std::size_t cell = (std::size_t(y) * W + x) * S;
+            for (int path = 0; path < paths; ++path) {
+              const int px = x - directions[path];
+              const bool start = i == 0 || px < 0 || px >= W;
+              const std::int16_t *previous =
+                  start ? nullptr : row(parity ^ 1, path) + px * (S + 2);
+              const int previousMin = start ? 0 : rowMin(parity ^ 1, path)[px];
+              rowMin(parity, path)[x] =
+                  pathPixel(&m_cost[cell], previous, previousMin,
+                            row(parity, path) + x * (S + 2),
+                            &m_aggregated[cell], costs);
+            }
+          }
+          done[t] = i + 1;
+        }
+      },
+      1);
+}
+
+Image<float>
+StereoMatcher::select(const std::vector<std::uint16_t> &volume) const {
+  const int W = m_width, H = m_height, S = m_stride;
+  const int D = m_parameters.disparities;
+  const int d0 = m_parameters.minDisparity;
+  const int uniqueness = m_parameters.uniqueness;
+  const int maxDifference = m_parameters.maxLeftRightDifference;
+  Image<float> disparity(W, H, INVALID);
+
+  parallelChunks(
+      std::size_t(H),
+      [&](std::size_t b, std::size_t e, unsigned) {
+        std::vector<int> rightBest(W);
+        std::vector<std::uint16_t> rightCost(W);
+        for (int y = int(b); y < int(e); ++y) {
+          const std::uint16_t *row = &volume[std::size_t(y) * W * S];
+          // winners of the right image along the diagonals of the volume:
+          // right pixel xr matches left pixel xr + d at disparity d
+          if (maxDifference >= 0)
+            for (int xr = 0; xr < W; ++xr) {
+              rightBest[xr] = -1;
+              rightCost[xr] = 0xffff;
+              const std::uint16_t *c = row + std::size_t(xr + d0) * S;
+              for (int k = 0; k < D && xr + d0 + k < W; ++k, c += S)
+                if (c[k] < rightCost[xr]) {
+                  rightCost[xr] = c[k];
+                  rightBest[xr] = k;
+                }
+            }
+
+          float *out = disparity.row(y);
+          for (int x = 0; x < W; ++x) {
+            const std::uint16_t *c = row + std::size_t(x) * S;
+            const int valid = std::clamp(x - d0 + 1, 0, D);
+            if (valid == 0)
+              continue;
+            std::uint16_t minCost = 0xffff;
+            for (int k = 0; k < valid; ++k)
+              minCost = std::min(minCost, c[k]);
+            const int best = int(std::find(c, c + valid, minCost) - c);
+            // best outside the neighbours of the winner
+            std::uint16_t second = 0xffff;
+            for (int k = 0; k < best - 1; ++k)
+              second = std::min(second, c[k]);
+            for (int k = best + 2; k < valid; ++k)
+              second = std::min(second, c[k]);
+            if (second * 100 <= minCost * (100 + uniqueness))
+              continue;
+            if (maxDifference >= 0 &&
+                std::abs(rightBest[x - d0 - best] - best) > maxDifference)
+              continue;
+            float d = float(best);
+            if (m_parameters.subpixel && best > 0 && best + 1 < valid) {
+              float a = c[best - 1], m = c[best], z = c[best + 1];
+              float denominator = a - 2.0f * m + z;
+              if (denominator > 0.0f)
+                d += 0.5f * (a - z) / denominator;
+            }
+            out[x] = float(d0) + d;
+          }
+        }
+      },
+      8);
+  return disparity;
+}
+
+PointCloud reprojectDisparity(const Image<float> &disparity,
+                              const StereoCamera &rig, float maxDepth) {
+  const PerspectiveCamera &camera = rig.leftCamera();
+  const int W = disparity.width(), H = disparity.height();
+  const float pitch = 2.0f * camera.imagePlaneSize / float(W);
+  const float fB = rig.focal() * rig.baseline();
+
+  std::vector<std::vector<QVector4D>> rows(std::size_t(std::max(H, 0)));
+  parallelFor(
+      std::size_t(H),
+      [&](std::size_t y) {
+        const float *d = disparity.row(int(y));
+        for (int x = 0; x < W; ++x) {
+          if (!(d[x] > 0.0f))
+            continue;
+          float depth = fB / (d[x] * pitch);
+          if (depth > maxDepth)
+            continue;
+          // the disparity map is of rectified pinhole images, whose
+          // distortion has already been removed
+          QVector3D p = camera.toWorld(
+              camera.fromPixel(float(x), float(y), depth, W, H, false));
+          rows[y].push_back(QVector4D(p, 1.0f));
+        }
+      },
+      8);
+  std::size_t count = 0;
+  for (const auto &row : rows)
+    count += row.size();
+  QVector<QVector4D> points(static_cast<qsizetype>(count));
+  QVector4D *out = points.data();
+  for (const auto &row : rows)
+    out = std::copy(row.begin(), row.end(), out);
+  PointCloud cloud;
+  cloud.setPoints(points);
+  cloud.computeBounds();
+  return cloud;
+}
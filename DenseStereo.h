@@ -0,0 +1,89 @@
+//
+//  Dense disparity estimation for rectified stereo pairs: block matching
+//  with SAD or census costs and semi-global matching (Hirschmueller 2008)
+//
+#pragma once
+
+#include "Image.h"
+#include "PointCloud.h"
+#include "StereoCamera.h"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+enum class StereoCost {
+  SC_SAD,   // absolute intensity differences
+  SC_CENSUS // Hamming distance of 9x7 census signatures, robust to gain
+};
+
+struct StereoMatcherParameters {
+  // disparities x_left - x_right in [minDisparity, minDisparity + disparities)
+  int minDisparity = 0;
+  int disparities = 64;
+  StereoCost cost = StereoCost::SC_CENSUS;
+  int blockSize = 5; // odd, at most 15: window the pixel costs are summed over
+  bool semiGlobal = true;
+  int paths = 8; // 4 or 8 aggregation directions
+  // Smoothness penalties for disparity steps of 1 and of more, per pixel of
+  // the block, i.e. in the units of the pixel cost. The path costs are kept
+  // in 16 bits: block costs saturate at 65535 / paths / 2 and P2 times the
+  // block area must stay below that.
+  int P1 = 4;
+  int P2 = 32;
+  int uniqueness = 10; // % by which the best cost must beat non-neighbours
+  int maxLeftRightDifference = 1; // left-right consistency, < 0 disables
+  bool subpixel = true;            // parabola through the neighbouring costs
+};
+
+struct StereoTiming {
+  double cost = 0.0, aggregation = 0.0, selection = 0.0; // seconds
+
+  double total() const { return cost + aggregation + selection; }
+};
+
+// Keeps its cost volumes between calls, so that consecutive frames of the
+// same size do not reallocate. Every stage runs in parallel over rows or
+// scanlines. The disparities of a pixel are contiguous and padded to a
+// multiple of LANES, and the inner loops run over fixed blocks of LANES
+// 16-bit values, which the compiler turns into SIMD code.
+class StereoMatcher {
+public:
+  static constexpr float INVALID = -1.0f;
+  static constexpr int LANES = 16;
+
+  explicit StereoMatcher(
+      const StereoMatcherParameters &parameters = StereoMatcherParameters());
+
+  // disparity of every left pixel, INVALID where no reliable match exists;
+  // both images must have the same size
+  Image<float> compute(const Image<std::uint8_t> &left,
+                       const Image<std::uint8_t> &right);
+
+  const StereoMatcherParameters &parameters() const { return m_parameters; }
+  const StereoTiming &timing() const { return m_timing; } // of the last call
+
+private:
+  StereoMatcherParameters m_parameters;
+  StereoTiming m_timing;
+  int m_width = 0, m_height = 0;
+  int m_stride; // disparities padded to a multiple of LANES
+  std::vector<std::uint64_t> m_censusLeft, m_censusRight;
+  std::vector<std::uint16_t> m_cost;       // width x height x m_stride
+  std::vector<std::uint16_t> m_rowSums;    // box filter, horizontal pass
+  std::vector<std::uint16_t> m_aggregated; // summed path costs, SGM only
+
+  void pixelCosts(const Image<std::uint8_t> &left,
+                  const Image<std::uint8_t> &right);
+  void boxFilter();
+  void aggregateRows();        // the paths along rows, parallel over rows
+  void aggregateSweep(int dy); // the paths coming from the row above/below
+  Image<float> select(const std::vector<std::uint16_t> &volume) const;
+};
+
+// Points of the valid disparities, seen by the rig's left camera: a disparity
+// of d pixels in an image of the disparity map's width is d * 2 *
+// imagePlaneSize / width on the image plane, so the depth is f * B over that.
+PointCloud
+reprojectDisparity(const Image<float> &disparity, const StereoCamera &rig,
+                   float maxDepth = std::numeric_limits<float>::max());
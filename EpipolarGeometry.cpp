@@ -0,0 +1,284 @@
+#include "EpipolarGeometry.h"
+#include "Parallel.h"
+#include "Triangulation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+namespace {
+
+// similarity moving the points to their centroid and scaling their mean
+// distance from it to sqrt(2)
+Eigen::Matrix3d normalization(const Eigen::Vector2d *p, int n) {
+  Eigen::Vector2d mean = Eigen::Vector2d::Zero();
+  for (int i = 0; i < n; ++i)
+    mean += p[i];
+  mean /= n;
+  double distance = 0.0;
+  for (int i = 0; i < n; ++i)
+    distance += (p[i] - mean).norm();
+  double s = distance > 0.0 ? std::sqrt(2.0) * n / distance : 1.0;
+  Eigen::Matrix3d T;
+  T << s, 0.0, -s * mean.x(), 0.0, s, -s * mean.y(), 0.0, 0.0, 1.0;
+  return T;
+}
+
+Eigen::Matrix3d skew(const Eigen::Vector3d &v) {
+  Eigen::Matrix3d S;
+  S << 0.0, -v.z(), v.y(), v.z(), 0.0, -v.x(), -v.y(), v.x(), 0.0;
+  return S;
+}
+
+// a matrix hypothesis and its score over the correspondences
+struct Hypothesis {
+  Eigen::Matrix3d matrix = Eigen::Matrix3d::Zero();
+  int inliers = 0;
+  double sumError = 0.0;
+
+  bool betterThan(const Hypothesis &h) const {
+    return inliers > h.inliers ||
+           (inliers == h.inliers && sumError < h.sumError);
+  }
+};
+
+// image plane coordinates of a pixel, see PerspectiveCamera::toPixel
+Eigen::Vector2d planeFromPixel(double u, double v, double size, int width,
+                               int height) {
+  return Eigen::Vector2d((u + 0.5) / width * 2.0 * size - size,
+                         size - (v + 0.5) / height * 2.0 * size);
+}
+
+Eigen::Matrix3d intrinsics(float imagePlaneDistance,
+                           const QVector2D &principalPoint) {
+  Eigen::Matrix3d K = Eigen::Matrix3d::Identity();
+  K(0, 0) = K(1, 1) = imagePlaneDistance;
+  K(0, 2) = principalPoint.x();
+  K(1, 2) = principalPoint.y();
+  return K;
+}
+
+Eigen::Matrix3d axes(const QMatrix4x4 &pose) {
+  Eigen::Matrix3d R;
+  for (int r = 0; r < 3; ++r)
+    for (int c = 0; c < 3; ++c)
+      R(r, c) = pose(r, c);
+  return R;
+}
+
+} // namespace
+
+Eigen::Matrix3d fundamentalEightPoint(const Eigen::Vector2d *a,
+                                      const Eigen::Vector2d *b, int n) {
+  const Eigen::Matrix3d Ta = normalization(a, n), Tb = normalization(b, n);
+  // the normal equations of the n x 9 system are enough for its null vector
+  Eigen::Matrix<double, 9, 9> AtA = Eigen::Matrix<double, 9, 9>::Zero();
+  for (int i = 0; i < n; ++i) {
+    Eigen::Vector3d p = Ta * a[i].homogeneous(), q = Tb * b[i].homogeneous();
+    Eigen::Matrix<double, 9, 1> row;
+    row << q.x() * p, q.y() * p, p;
+    AtA.selfadjointView<Eigen::Lower>().rankUpdate(row);
+  }
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 9, 9>> eigen(
+      AtA.selfadjointView<Eigen::Lower>());
+  Eigen::Matrix<double, 9, 1> f = eigen.eigenvectors().col(0);
+  Eigen::Matrix3d F;
+  F << f(0), f(1), f(2), f(3), f(4), f(5), f(6), f(7), f(8);
+
+  Eigen::JacobiSVD<Eigen::Matrix3d> svd(F, Eigen::ComputeFullU |
+                                               Eigen::ComputeFullV);
+  Eigen::Vector3d sigma = svd.singularValues();
+  sigma.z() = 0.0;
+  F = Tb.transpose() * svd.matrixU() * sigma.asDiagonal() *
+      svd.matrixV().transpose() * Ta;
+  return F / F.norm();
+}
+
+Eigen::Matrix3d closestEssentialMatrix(const Eigen::Matrix3d &M) {
+  Eigen::JacobiSVD<Eigen::Matrix3d> svd(M, Eigen::ComputeFullU |
+                                               Eigen::ComputeFullV);
+  double s = 0.5 * (svd.singularValues().x() + svd.singularValues().y());
+  return svd.matrixU() * Eigen::Vector3d(s, s, 0.0).asDiagonal() *
+         svd.matrixV().transpose();
+}
+
+double sampsonError(const Eigen::Matrix3d &F, const Eigen::Vector2d &a,
+                    const Eigen::Vector2d &b) {
+  Eigen::Vector3d Fa = F * a.homogeneous();
+  Eigen::Vector3d Ftb = F.transpose() * b.homogeneous();
+  double r = b.homogeneous().dot(Fa);
+  double g2 = Fa.head<2>().squaredNorm() + Ftb.head<2>().squaredNorm();
+  return g2 > 0.0 ? r * r / g2 : 0.0;
+}
+
+Eigen::Matrix3d fundamentalMatrix(const PerspectiveCamera &a,
+                                  const PerspectiveCamera &b) {
+  // F = [e_b]x P_b P_a^+, e_b the image of a's centre in b
+  const Matrix34d Pa = cameraMatrix(a), Pb = cameraMatrix(b);
+  Eigen::Matrix<double, 4, 3> PaPlus =
+      Pa.transpose() * (Pa * Pa.transpose()).inverse();
+  Eigen::Vector4d ca(a.center.x(), a.center.y(), a.center.z(), 1.0);
+  Eigen::Matrix3d F = skew(Pb * ca) * Pb * PaPlus;
+  return F / F.norm();
+}
+
+Eigen::Vector2d normalizedCoordinates(const PerspectiveCamera &camera,
+                                      const QVector2D &p) {
+  return Eigen::Vector2d(p.x() - camera.imagePrincipalPoint.x(),
+                         p.y() - camera.imagePrincipalPoint.y()) /
+         camera.imagePlaneDistance;
+}
+
+EpipolarResult
+estimateEpipolarGeometry(const std::vector<Eigen::Vector2d> &a,
+                         const std::vector<Eigen::Vector2d> &b,
+                         const EpipolarParameters &parameters) {
+  auto start = std::chrono::steady_clock::now();
+  EpipolarResult result;
+  const int m = int(std::min(a.size(), b.size()));
+  result.inliers.assign(m, false);
+  if (m < 8)
+    return result;
+
+  const double threshold2 = parameters.threshold * parameters.threshold;
+  auto estimate = [&](const Eigen::Vector2d *p, const Eigen::Vector2d *q,
+                      int n) {
+    Eigen::Matrix3d F = fundamentalEightPoint(p, q, n);
+    return parameters.essential ? closestEssentialMatrix(F) : F;
+  };
+  auto score = [&](const Eigen::Matrix3d &F) {
+    Hypothesis h;
+    h.matrix = F;
+    for (int k = 0; k < m; ++k) {
+      double e = sampsonError(F, a[k], b[k]);
+      if (e <= threshold2) {
+        ++h.inliers;
+        h.sumError += e;
+      }
+    }
+    return h;
+  };
+
+  // RANSAC: every thread draws samples until the shared iteration budget,
+  // lowered as better hypotheses are found, is used up
+  const double logFailure = std::log(1.0 - parameters.confidence);
+  std::atomic<int> drawn{0}, budget{parameters.maxIterations};
+  const unsigned threads = parallelThreadCount();
+  std::vector<Hypothesis> best(threads);
+  parallelChunks(
+      threads,
+      [&](std::size_t, std::size_t, unsigned c) {
+        std::mt19937 rng(parameters.seed + c);
+        std::uniform_int_distribution<int> pick(0, m - 1);
+        int s[8];
+        Eigen::Vector2d p[8], q[8];
+        while (drawn.fetch_add(1) < budget.load()) {
+          for (int k = 0; k < 8; ++k) {
+            s[k] = pick(rng);
+            for (int j = 0; j < k; ++j)
+              if (s[j] == s[k]) {
+                s[k] = pick(rng);
+                j = -1; // redraw until distinct
+              }
+            p[k] = a[s[k]];
+            q[k] = b[s[k]];
+          }
+          Hypothesis h = score(estimate(p, q, 8));
+          if (!h.betterThan(best[c]))
+            continue;
+          best[c] = h;
+          // samples needed to draw an all-inlier octuple with the confidence
+          double w = double(h.inliers) / m;
+          double miss =
+              std::log(std::clamp(1.0 - std::pow(w, 8), 1e-12, 1.0 - 1e-12));
+          int needed = int(std::min<double>(parameters.maxIterations,
+                                            std::ceil(logFailure / miss)));
+          int current = budget.load();
+          while (needed < current &&
+                 !budget.compare_exchange_weak(current, needed))
+            ;
+        }
+      },
+      1);
+  Hypothesis winner;
+  for (const Hypothesis &h : best)
+    if (h.betterThan(winner))
+      winner = h;
+  result.iterations = std::min(drawn.load(), budget.load());
+
+  // refit to the inliers, kept if it does not lose any
+  if (winner.inliers >= 8) {
+    std::vector<Eigen::Vector2d> p, q;
+    for (int k = 0; k < m; ++k)
+      if (sampsonError(winner.matrix, a[k], b[k]) <= threshold2) {
+        p.push_back(a[k]);
+        q.push_back(b[k]);
+      }
+    Hypothesis refit = score(estimate(p.data(), q.data(), int(p.size())));
+    if (refit.inliers >= winner.inliers)
+      winner = refit;
+  }
+  result.matrix = winner.matrix;
+  result.inlierCount = winner.inliers;
+  for (int k = 0; k < m; ++k)
+    result.inliers[k] = winner.inliers &&
+                        sampsonError(winner.matrix, a[k], b[k]) <= threshold2;
+  result.seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  return result;
+}
+
+StereoRectification rectifyStereo(const PerspectiveCamera &left,
+                                  const PerspectiveCamera &right, int width,
+                                  int height) {
+  const Eigen::Vector3d cl(left.center.x(), left.center.y(), left.center.z());
+  const Eigen::Vector3d cr(right.center.x(), right.center.y(),
+                           right.center.z());
+  const Eigen::Matrix3d Rl = axes(left.pose), Rr = axes(right.pose);
+
+  // new axes: x along the baseline, y orthogonal to it and the old left
+  // viewing direction, z completing the right-handed frame
+  Eigen::Matrix3d R;
+  R.col(0) = (cr - cl).normalized();
+  R.col(1) = Rl.col(2).cross(R.col(0)).normalized();
+  R.col(2) = R.col(0).cross(R.col(1));
+
+  StereoRectification rect;
+  rect.pose.setToIdentity();
+  for (int r = 0; r < 3; ++r)
+    for (int c = 0; c < 3; ++c)
+      rect.pose(r, c) = float(R(r, c));
+
+  // x_new ~ K R^T R_old K_old^-1 x_old
+  const Eigen::Matrix3d K =
+      intrinsics(left.imagePlaneDistance, left.imagePrincipalPoint);
+  rect.left = K * R.transpose() * Rl *
+              intrinsics(left.imagePlaneDistance, left.imagePrincipalPoint)
+                  .inverse();
+  rect.right = K * R.transpose() * Rr *
+               intrinsics(right.imagePlaneDistance, right.imagePrincipalPoint)
+                   .inverse();
+
+  // the original pixel of every rectified one, through the distortion
+  auto table = [&](const Eigen::Matrix3d &H, const PerspectiveCamera &camera) {
+    const Eigen::Matrix3d Kinv =
+        intrinsics(camera.imagePlaneDistance, camera.imagePrincipalPoint)
+            .inverse();
+    const Eigen::Matrix3d M = Kinv * H.inverse();
+    const double size = left.imagePlaneSize;
+    return RemapTable(width, height, width, height, [&](int u, int v) {
+      Eigen::Vector3d ray =
+          M * planeFromPixel(u, v, size, width, height).homogeneous();
+      if (!(ray.z() > 0.0)) // behind the original camera
+        return QVector2D(-1.0f, -1.0f);
+      return camera.toPixel(QVector3D(ray.x(), ray.y(), ray.z()), width,
+                            height);
+    });
+  };
+  rect.leftMap = table(rect.left, left);
+  rect.rightMap = table(rect.right, right);
+  return rect;
+}
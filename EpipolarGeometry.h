@@ -0,0 +1,84 @@
+//
+//  Epipolar geometry of two views from point correspondences, and the
+//  rectification of calibrated stereo pairs for dense matching along rows
+//
+#pragma once
+
+#include "PerspectiveCamera.h"
+#include "RemapTable.h"
+
+#include <Eigen/Dense>
+#include <vector>
+
+// Fundamental matrix F with b^T F a = 0 for the n >= 8 correspondences
+// (a, b), by the normalised eight-point algorithm (Hartley) with rank 2
+// enforced. Given normalised coordinates, see normalizedCoordinates, its
+// projection by closestEssentialMatrix is the essential matrix.
+Eigen::Matrix3d fundamentalEightPoint(const Eigen::Vector2d *a,
+                                      const Eigen::Vector2d *b, int n);
+
+// nearest matrix with singular values (s, s, 0), s their mean
+Eigen::Matrix3d closestEssentialMatrix(const Eigen::Matrix3d &M);
+
+// first-order geometric (Sampson) error of (a, b) under F, squared
+double sampsonError(const Eigen::Matrix3d &F, const Eigen::Vector2d &a,
+                    const Eigen::Vector2d &b);
+
+// F of two cameras for their image plane coordinates, see
+// PerspectiveCamera::project
+Eigen::Matrix3d fundamentalMatrix(const PerspectiveCamera &a,
+                                  const PerspectiveCamera &b);
+
+// image plane coordinates p of the camera with K removed
+Eigen::Vector2d normalizedCoordinates(const PerspectiveCamera &camera,
+                                      const QVector2D &p);
+
+struct EpipolarParameters {
+  // the correspondences are normalised coordinates: estimate an essential
+  // matrix instead of a fundamental one
+  bool essential = false;
+  // pairs with a Sampson error below this, in the units of the
+  // coordinates, are inliers
+  double threshold = 1e-3;
+  int maxIterations = 10000;
+  double confidence = 0.999; // of having drawn an all-inlier sample
+  unsigned seed = 1;
+};
+
+struct EpipolarResult {
+  Eigen::Matrix3d matrix = Eigen::Matrix3d::Zero(); // F or E
+  std::vector<bool> inliers;
+  int inlierCount = 0;
+  int iterations = 0; // RANSAC samples drawn
+  double seconds = 0.0;
+};
+
+// F (or E) by RANSAC over eight-point samples scored by their Sampson
+// inliers; the threads draw samples concurrently until the adaptive
+// iteration count for the confidence is reached, and the best matrix is
+// refit to all its inliers.
+EpipolarResult
+estimateEpipolarGeometry(const std::vector<Eigen::Vector2d> &a,
+                         const std::vector<Eigen::Vector2d> &b,
+                         const EpipolarParameters &parameters =
+                             EpipolarParameters());
+
+struct StereoRectification {
+  // common pose of both rectified cameras, which keep their centres and
+  // the imagePlaneDistance and principal point of the left camera
+  QMatrix4x4 pose;
+  // homographies from original to rectified image plane coordinates
+  Eigen::Matrix3d left, right;
+  // rectified pixel -> original pixel, see PerspectiveCamera::toPixel
+  RemapTable leftMap, rightMap;
+};
+
+// Rectification of a calibrated pair (Fusiello, Trucco and Verri): both
+// cameras are rotated about their centres so that their x axes run along
+// the baseline and they share the viewing direction closest to the left
+// camera's, which makes epipolar lines image rows. The remap tables are
+// for width x height images of both cameras and also undo their
+// distortion. The homographies and estimators work on pinhole coordinates.
+StereoRectification rectifyStereo(const PerspectiveCamera &left,
+                                  const PerspectiveCamera &right, int width,
+                                  int height);
@@ -0,0 +1,236 @@
+#include "FPFH.h"
+#include "Parallel.h"
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+namespace {
+
+constexpr int BINS = 11; // per angle
+
+// neighbour lists of one chunk of points, as compressed rows
+struct Neighbourhoods {
+  std::vector<int> start; // per point of the chunk, plus one
+  std::vector<int> indices;
+  std::vector<float> dist;
+};
+
+// Adds the angle triple of the pair (p1, n1), (p2, n2) to the SPFH
+// histogram h, see Rusu et al.: the Darboux frame sits at the point whose
+// normal is closer to the connecting line.
+void addPair(const Eigen::Vector3f &p1, const Eigen::Vector3f &n1,
+             const Eigen::Vector3f &p2, const Eigen::Vector3f &n2,
+             float increment, float *h) {
+  Eigen::Vector3f d = p2 - p1;
+  float length = d.norm();
+  if (length <= 0.0f)
+    return;
+  d /= length;
+  const Eigen::Vector3f *u = &n1, *t = &n2;
+  if (std::fabs(n1.dot(d)) < std::fabs(n2.dot(d))) {
+    std::swap(u, t);
+    d = -d;
+  }
+  float phi = u->dot(d);
+  Eigen::Vector3f v = d.cross(*u);
+  float vNorm = v.norm();
+  if (vNorm <= 0.0f)
+    return;
+  v /= vNorm;
+  Eigen::Vector3f w = u->cross(v);
+  float alpha = v.dot(*t);
+  float theta = std::atan2(w.dot(*t), u->dot(*t));
+
+  auto bin = [](float x) { return std::clamp(int(x * BINS), 0, BINS - 1); };
+  h[bin((theta + float(M_PI)) / (2.0f * float(M_PI)))] += increment;
+  h[BINS + bin((alpha + 1.0f) * 0.5f)] += increment;
+  h[2 * BINS + bin((phi + 1.0f) * 0.5f)] += increment;
+}
+
+} // namespace
+
+std::vector<FPFHDescriptor> computeFPFH(const KdTree &tree, float radius) {
+  const PointCloud &cloud = tree.cloud();
+  const std::vector<float> *nx = cloud.findAttribute("nx");
+  const std::vector<float> *ny = cloud.findAttribute("ny");
+  const std::vector<float> *nz = cloud.findAttribute("nz");
+  if (!nx || !ny || !nz)
+    throw std::runtime_error("FPFH needs normals");
+  if (!(radius > 0.0f))
+    throw std::runtime_error("FPFH radius must be positive");
+
+  const std::size_t n = cloud.size();
+  const QVector4D *pts = cloud.constData();
+  auto point = [&](int i) {
+    return Eigen::Vector3f(pts[i].x(), pts[i].y(), pts[i].z());
+  };
+  auto normal = [&](int i) {
+    return Eigen::Vector3f((*nx)[i], (*ny)[i], (*nz)[i]);
+  };
+
+  // SPFH of every point; the neighbourhoods are kept for the second pass,
+  // which splits [0, n) into the same chunks
+  const std::size_t minChunk = 256;
+  std::vector<Neighbourhoods> hoods(parallelChunkCount(n, minChunk));
+  std::vector<FPFHDescriptor> spfh(n);
+  parallelChunks(
+      n,
+      [&](std::size_t b, std::size_t e, unsigned c) {
+        Neighbourhoods &hood = hoods[c];
+        std::vector<int> indices;
+        std::vector<float> dist2;
+        for (std::size_t i = b; i < e; ++i) {
+          hood.start.push_back(int(hood.indices.size()));
+          FPFHDescriptor &h = spfh[i];
+          h.fill(0.0f);
+          tree.radiusSearch(QVector3D(pts[i]), radius, indices, &dist2);
+          const int count = int(indices.size()) - 1; // without i itself
+          if (count <= 0)
+            continue;
+          const Eigen::Vector3f p = point(int(i)), np = normal(int(i));
+          const float increment = 100.0f / float(count);
+          for (std::size_t k = 0; k < indices.size(); ++k) {
+            const int j = indices[k];
+            if (j == int(i))
+              continue;
+            hood.indices.push_back(j);
+            hood.dist.push_back(std::sqrt(dist2[k]));
+            addPair(p, np, point(j), normal(j), increment, h.data());
+          }
+        }
+        hood.start.push_back(int(hood.indices.size()));
+      },
+      minChunk);
+
+  std::vector<FPFHDescriptor> fpfh(n);
+  parallelChunks(
+      n,
+      [&](std::size_t b, std::size_t e, unsigned c) {
+        const Neighbourhoods &hood = hoods[c];
+        for (std::size_t i = b; i < e; ++i) {
+          FPFHDescriptor &f = fpfh[i];
+          f = spfh[i];
+          const int begin = hood.start[i - b], end = hood.start[i - b + 1];
+          if (begin == end)
+            continue;
+          const float scale = 1.0f / float(end - begin);
+          for (int k = begin; k < end; ++k) {
+            const float w = scale / std::max(hood.dist[k], 1e-12f);
+            const FPFHDescriptor &s = spfh[hood.indices[k]];
+            for (int d = 0; d < 3 * BINS; ++d)
+              f[d] += w * s[d];
+          }
+          for (int a = 0; a < 3; ++a) {
+            float *h = f.data() + a * BINS;
+            float sum = std::accumulate(h, h + BINS, 0.0f);
+            if (sum > 0.0f)
+              for (int d = 0; d < BINS; ++d)
+                h[d] *= 100.0f / sum;
+          }
+        }
+      },
+      minChunk);
+  return fpfh;
+}
+
+FPFHTree::FPFHTree(const std::vector<FPFHDescriptor> &descriptors,
+                   int leafSize)
+    : m_points(descriptors), m_order(descriptors.size()),
+      m_leafSize(std::max(1, leafSize)) {
+  std::iota(m_order.begin(), m_order.end(), 0);
+  if (!m_points.empty())
+    build(0, int(m_points.size()));
+  std::vector<FPFHDescriptor> sorted(m_points.size());
+  for (std::size_t i = 0; i < m_order.size(); ++i)
+    sorted[i] = descriptors[m_order[i]];
+  m_points.swap(sorted);
+}
+
+int FPFHTree::build(int begin, int end) {
+  const int id = int(m_nodes.size());
+  m_nodes.push_back(Node{begin, end});
+  if (end - begin <= m_leafSize)
+    return id;
+
+  // widest dimension of the node's descriptors (m_points is still in the
+  // original order during the build)
+  FPFHDescriptor lo, hi;
+  lo.fill(std::numeric_limits<float>::max());
+  hi.fill(-std::numeric_limits<float>::max());
+  for (int i = begin; i < end; ++i) {
+    const FPFHDescriptor &p = m_points[m_order[i]];
+    for (int d = 0; d < 33; ++d) {
+      lo[d] = std::min(lo[d], p[d]);
+      hi[d] = std::max(hi[d], p[d]);
+    }
+  }
+  int dim = 0;
+  for (int d = 1; d < 33; ++d)
+    if (hi[d] - lo[d] > hi[dim] - lo[dim])
+      dim = d;
+  if (hi[dim] <= lo[dim])
+    return id; // all equal
+
+  const int mid = (begin + end) / 2;
+  std::nth_element(m_order.begin() + begin, m_order.begin() + mid,
+                   m_order.begin() + end, [&](int a, int b) {
+                     return m_points[a][dim] < m_points[b][dim];
+                   });
+  m_nodes[id].dim = dim;
+  m_nodes[id].split = m_points[m_order[mid]][dim];
+  const int left = build(begin, mid);
+  const int right = build(mid, end);
+  m_nodes[id].left = left;
+  m_nodes[id].right = right;
+  return id;
+}
+
+int FPFHTree::nearest(const FPFHDescriptor &q, float *dist2) const {
+  int best = -1;
+  float bestDist2 = std::numeric_limits<float>::max();
+  FPFHDescriptor offset;
+  offset.fill(0.0f);
+  if (!m_nodes.empty())
+    nearestNode(0, q, 0.0f, offset, best, bestDist2);
+  if (dist2)
+    *dist2 = bestDist2;
+  return best < 0 ? -1 : m_order[best];
+}
+
+void FPFHTree::nearestNode(int node, const FPFHDescriptor &q, float boxDist2,
+                           FPFHDescriptor &offset, int &best,
+                           float &bestDist2) const {
+  const Node &n = m_nodes[node];
+  if (n.dim < 0) {
+    for (int i = n.begin; i < n.end; ++i) {
+      const FPFHDescriptor &p = m_points[i];
+      // partial sums in blocks of 11, leaving early once they exceed the best
+      float d2 = 0.0f;
+      for (int a = 0; a < 3 && d2 < bestDist2; ++a)
+        for (int d = a * BINS; d < (a + 1) * BINS; ++d)
+          d2 += (p[d] - q[d]) * (p[d] - q[d]);
+      if (d2 < bestDist2) {
+        bestDist2 = d2;
+        best = i;
+      }
+    }
+    return;
+  }
+  // the far side's lower bound replaces this dimension's offset in the
+  // squared distance to the query's cell (Arya and Mount)
+  const float diff = q[n.dim] - n.split;
+  nearestNode(diff < 0.0f ? n.left : n.right, q, boxDist2, offset, best,
+              bestDist2);
+  const float old = offset[n.dim];
+  const float farDist2 = boxDist2 - old * old + diff * diff;
+  if (farDist2 < bestDist2) {
+    offset[n.dim] = diff;
+    nearestNode(diff < 0.0f ? n.right : n.left, q, farDist2, offset, best,
+                bestDist2);
+    offset[n.dim] = old;
+  }
+}
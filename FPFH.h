@@ -0,0 +1,49 @@
+//
+//  Fast Point Feature Histograms (Rusu et al. 2009): 33-bin descriptors of
+//  the surface around every point, for matching points between clouds
+//
+#pragma once
+
+#include "KdTree.h"
+
+#include <array>
+#include <vector>
+
+using FPFHDescriptor = std::array<float, 33>;
+
+// Descriptors of all points of tree.cloud(), in its order, from the normals
+// (attributes "nx", "ny", "nz", see estimateNormals) and the neighbours
+// within radius. The simplified histograms (SPFH) of the angles between every
+// point and its neighbours are computed in parallel first; each FPFH is then
+// the point's SPFH plus the inverse-distance weighted mean of its
+// neighbours'. Each of the three 11-bin sub-histograms sums to 100.
+std::vector<FPFHDescriptor> computeFPFH(const KdTree &tree, float radius);
+
+// Kd-tree over descriptors for exact nearest-neighbour matching in the 33-D
+// descriptor space. Nodes split at the median of their widest dimension; the
+// descriptors are copied in leaf order.
+class FPFHTree {
+public:
+  explicit FPFHTree(const std::vector<FPFHDescriptor> &descriptors,
+                    int leafSize = 16);
+
+  // index into the descriptors the tree was built from, -1 if it is empty
+  int nearest(const FPFHDescriptor &q, float *dist2 = nullptr) const;
+
+private:
+  struct Node {
+    int begin, end;    // range of m_points
+    int dim = -1;      // split dimension, -1 for leaves
+    float split = 0.0f;
+    int left = -1, right = -1;
+  };
+
+  std::vector<FPFHDescriptor> m_points; // in leaf order
+  std::vector<int> m_order;             // original index per m_points entry
+  std::vector<Node> m_nodes;            // m_nodes[0] is the root
+  int m_leafSize;
+
+  int build(int begin, int end);
+  void nearestNode(int node, const FPFHDescriptor &q, float boxDist2,
+                   FPFHDescriptor &offset, int &best, float &bestDist2) const;
+};
@@ -0,0 +1,86 @@
+//
+//  Open-addressing hash map from 64-bit keys (e.g. voxel or cell codes) to
+//  plain values; a flat table keeps each lookup to one or two cache lines
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+template <typename Value> class FlatHashMap {
+public:
+  // reserved key marking empty slots, it cannot be stored
+  static constexpr std::uint64_t EMPTY = ~std::uint64_t(0);
+
+  explicit FlatHashMap(std::size_t capacity = 1024) { rehash(2 * capacity); }
+
+  // value for key, default constructed on first access
+  Value &operator[](std::uint64_t key) {
+    std::size_t i = slot(key);
+    while (keys[i] != key) {
+      if (keys[i] == EMPTY) {
+        if (2 * (count + 1) > keys.size()) {
+          rehash(2 * keys.size());
+          return (*this)[key];
+        }
+        keys[i] = key;
+        ++count;
+        break;
+      }
+      i = (i + 1) & mask;
+    }
+    return values[i];
+  }
+
+  const Value *find(std::uint64_t key) const {
+    for (std::size_t i = slot(key); keys[i] != EMPTY; i = (i + 1) & mask)
+      if (keys[i] == key)
+        return &values[i];
+    return nullptr;
+  }
+
+  std::size_t size() const { return count; }
+
+  // calls f(key, value) for every stored entry
+  template <typename F> void forEach(F &&f) {
+    for (std::size_t i = 0; i < keys.size(); ++i)
+      if (keys[i] != EMPTY)
+        f(keys[i], values[i]);
+  }
+  template <typename F> void forEach(F &&f) const {
+    for (std::size_t i = 0; i < keys.size(); ++i)
+      if (keys[i] != EMPTY)
+        f(keys[i], values[i]);
+  }
+
+  // frees the table; the map must not be used afterwards
+  void release() {
+    std::vector<std::uint64_t>().swap(keys);
+    std::vector<Value>().swap(values);
+  }
+
+private:
+  std::vector<std::uint64_t> keys;
+  std::vector<Value> values;
+  std::size_t mask = 0, count = 0;
+
+  std::size_t slot(std::uint64_t key) const {
+    return std::size_t((key * 0x9e3779b97f4a7c15ULL) >> 20) & mask;
+  }
+
+  void rehash(std::size_t capacity) {
+    std::size_t size = 16;
+    while (size < capacity)
+      size *= 2;
+    std::vector<std::uint64_t> oldKeys(size, EMPTY);
+    std::vector<Value> oldValues(size);
+    oldKeys.swap(keys);
+    oldValues.swap(values);
+    mask = size - 1;
+    count = 0;
+    for (std::size_t i = 0; i < oldKeys.size(); ++i)
+      if (oldKeys[i] != EMPTY)
+        (*this)[oldKeys[i]] = oldValues[i];
+  }
+};
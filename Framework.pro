@@ -37,7 +37,37 @@ HEADERS += ./glwidget.h \
     PerspectiveCamera.h \
     StereoCamera.h \
     KdTree.h \
-    OctTree.h
+    OctTree.h \
+    Parallel.h \
+    VoxelGrid.h \
+    Ray.h \
+    FlatHashMap.h \
+    SpatialHashGrid.h \
+    ICP.h \
+    NormalEstimation.h \
+    OutlierRemoval.h \
+    PlaneSegmentation.h \
+    Clustering.h \
+    Sampling.h \
+    Image.h \
+    TriangleMesh.h \
+    TSDFVolume.h \
+    FPFH.h \
+    GlobalRegistration.h \
+    CloudDistance.h \
+    DenseStereo.h \
+    Triangulation.h \
+    RemapTable.h \
+    EpipolarGeometry.h \
+    PointRasterizer.h \
+    LensDistortion.h \
+    BundleAdjustment.h \
+    DatasetGenerator.h \
+    GLBufferCache.h \
+    LineBatch.h \
+    RenderBenchmark.h \
+    RenderList.h \
+    SceneWorker.h
 
 SOURCES += ./glwidget.cpp \
      ./mainwindow.cpp \
@@ -55,6 +85,31 @@ SOURCES += ./glwidget.cpp \
     PerspectiveCamera.cpp \
     StereoCamera.cpp \
     KdTree.cpp \
-    OctTree.cpp
+    OctTree.cpp \
+    VoxelGrid.cpp \
+    SpatialHashGrid.cpp \
+    ICP.cpp \
+    NormalEstimation.cpp \
+    OutlierRemoval.cpp \
+    PlaneSegmentation.cpp \
+    Clustering.cpp \
+    Sampling.cpp \
+    TSDFVolume.cpp \
+    FPFH.cpp \
+    GlobalRegistration.cpp \
+    CloudDistance.cpp \
+    DenseStereo.cpp \
+    Triangulation.cpp \
+    RemapTable.cpp \
+    EpipolarGeometry.cpp \
+    PointRasterizer.cpp \
+    LensDistortion.cpp \
+    BundleAdjustment.cpp \
+    DatasetGenerator.cpp \
+    GLBufferCache.cpp \
+    LineBatch.cpp \
+    RenderBenchmark.cpp \
+    RenderList.cpp \
+    SceneWorker.cpp
 
 FORMS += ./mainwindow.ui
@@ -0,0 +1,172 @@
+#include "GLBufferCache.h"
+#include "LineBatch.h"
+#include "PointCloud.h"
+
+#include <algorithm>
+#include <cstddef>
+
+namespace {
+
+// GLSL 1.20 to match the compatibility profile of the immediate-mode code;
+// the points are stored as they are, homogeneous coordinate included
+const char *pointVertexShader = R"(#version 120
+attribute vec4 position;
+uniform mat4 renderMatrix;
+uniform float pointSize;
+void main() {
+  gl_Position = renderMatrix * vec4(position.xyz, 1.0);
+  gl_PointSize = pointSize;
+}
+)";
+
+const char *pointFragmentShader = R"(#version 120
+uniform vec4 color;
+void main() { gl_FragColor = color; }
+)";
+
+const char *lineVertexShader = R"(#version 120
+attribute vec3 position;
+attribute vec4 color;
+uniform mat4 renderMatrix;
+varying vec4 vertexColor;
+void main() {
+  gl_Position = renderMatrix * vec4(position, 1.0);
+  vertexColor = color;
+}
+)";
+
+const char *lineFragmentShader = R"(#version 120
+varying vec4 vertexColor;
+void main() { gl_FragColor = vertexColor; }
+)";
+
+bool build(QOpenGLShaderProgram &program, const char *vertex,
+           const char *fragment) {
+  return program.addShaderFromSourceCode(QOpenGLShader::Vertex, vertex) &&
+         program.addShaderFromSourceCode(QOpenGLShader::Fragment, fragment) &&
+         program.link();
+}
+
+} // namespace
+
+GLBufferCache::GLBufferCache() {
+  m_valid = build(m_pointProgram, pointVertexShader, pointFragmentShader) &&
+            build(m_lineProgram, lineVertexShader, lineFragmentShader);
+  if (!m_valid)
+    return;
+  m_pointPosition = m_pointProgram.attributeLocation("position");
+  m_pointMatrix = m_pointProgram.uniformLocation("renderMatrix");
+  m_pointColor = m_pointProgram.uniformLocation("color");
+  m_pointSize = m_pointProgram.uniformLocation("pointSize");
+  m_linePosition = m_lineProgram.attributeLocation("position");
+  m_lineColor = m_lineProgram.attributeLocation("color");
+  m_lineMatrix = m_lineProgram.uniformLocation("renderMatrix");
+}
+
+GLBufferCache::~GLBufferCache() = default;
+
+bool GLBufferCache::prepare(Entries &entries, std::uint64_t id,
+                            std::size_t n, int vertexSize, Entry *&entry) {
+  std::unique_ptr<Entry> &slot = entries[id];
+  if (!slot)
+    slot = std::make_unique<Entry>();
+  entry = slot.get();
+  entry->used = true;
+  if (!entry->buffer.isCreated()) {
+    entry->buffer.create();
+    entry->buffer.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+  }
+  entry->buffer.bind();
+  if (n <= entry->capacity)
+    return false;
+  // headroom, so that growing objects upload only their new vertices
+  entry->capacity = std::max(n, entry->capacity + entry->capacity / 2);
+  entry->buffer.allocate(int(entry->capacity * vertexSize));
+  return true;
+}
+
+void GLBufferCache::upload(Entry &entry, std::size_t begin, std::size_t end,
+                           const void *vertices, int vertexSize) {
+  if (begin >= end)
+    return;
+  entry.buffer.write(int(begin * vertexSize),
+                     static_cast<const char *>(vertices) + begin * vertexSize,
+                     int((end - begin) * vertexSize));
+  m_uploadedBytes += (end - begin) * vertexSize;
+}
+
+void GLBufferCache::draw(const PointCloud &cloud,
+                         const QMatrix4x4 &renderMatrix, const QColor &color,
+                         float pointSize) {
+  const std::size_t n = std::size_t(cloud.size());
+  if (n == 0)
+    return;
+  const int stride = int(sizeof(QVector4D));
+  Entry *entry;
+  const std::uint64_t revision = cloud.revision();
+  std::size_t begin = 0, end = n;
+  if (!prepare(m_points, cloud.id(), n, stride, entry) &&
+      !cloud.changedSince(entry->revision, begin, end)) {
+    begin = 0; // too many edits since the upload
+    end = n;
+  }
+  upload(*entry, begin, end, cloud.constData(), stride);
+  entry->count = n;
+  entry->revision = revision;
+
+  m_pointProgram.bind();
+  m_pointProgram.setUniformValue(m_pointMatrix, renderMatrix);
+  m_pointProgram.setUniformValue(m_pointColor, color);
+  m_pointProgram.setUniformValue(m_pointSize, std::max(1.0f, pointSize));
+  m_pointProgram.enableAttributeArray(m_pointPosition);
+  m_pointProgram.setAttributeBuffer(m_pointPosition, GL_FLOAT, 0, 4, stride);
+  glDrawArrays(GL_POINTS, 0, GLsizei(n));
+  m_pointProgram.disableAttributeArray(m_pointPosition);
+  m_pointProgram.release();
+  entry->buffer.release();
+}
+
+void GLBufferCache::draw(const LineBatch &lines,
+                         const QMatrix4x4 &renderMatrix, float lineWidth,
+                         std::size_t lineCount) {
+  const std::vector<LineBatch::Vertex> &vertices = lines.vertices();
+  const std::size_t n = vertices.size();
+  if (n == 0)
+    return;
+  const int stride = int(sizeof(LineBatch::Vertex));
+  Entry *entry;
+  if (prepare(m_lines, lines.id(), n, stride, entry) ||
+      entry->revision < lines.clearRevision())
+    upload(*entry, 0, n, vertices.data(), stride);
+  else if (entry->revision != lines.revision()) // appended to only
+    upload(*entry, entry->count, n, vertices.data(), stride);
+  entry->count = n;
+  entry->revision = lines.revision();
+
+  glLineWidth(std::max(1.0f, lineWidth));
+  m_lineProgram.bind();
+  m_lineProgram.setUniformValue(m_lineMatrix, renderMatrix);
+  m_lineProgram.enableAttributeArray(m_linePosition);
+  m_lineProgram.enableAttributeArray(m_lineColor);
+  m_lineProgram.setAttributeBuffer(m_linePosition, GL_FLOAT, 0, 3, stride);
+  // normalised by Qt, so the bytes arrive as colours in [0, 1]
+  m_lineProgram.setAttributeBuffer(m_lineColor, GL_UNSIGNED_BYTE,
+                                   offsetof(LineBatch::Vertex, r), 4, stride);
+  glDrawArrays(GL_LINES, 0, GLsizei(std::min(n, 2 * lineCount)));
+  m_lineProgram.disableAttributeArray(m_lineColor);
+  m_lineProgram.disableAttributeArray(m_linePosition);
+  m_lineProgram.release();
+  entry->buffer.release();
+}
+
+void GLBufferCache::releaseUnused() {
+  for (Entries *entries : {&m_points, &m_lines})
+    for (auto it = entries->begin(); it != entries->end();) {
+      if (!it->second->used) {
+        it = entries->erase(it); // QOpenGLBuffer frees the GL buffer
+        continue;
+      }
+      it->second->used = false;
+      ++it;
+    }
+}
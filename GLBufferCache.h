@@ -0,0 +1,70 @@
+//
+//  GPU copies of point clouds and line batches for retained-mode rendering:
+//  every object is kept in a vertex buffer and transformed by a vertex
+//  shader, so a redraw costs no CPU work per vertex. A buffer is updated
+//  only when the object's revision has changed; for point clouds only the
+//  points changed since the upload (see PointCloud::changedSince) are
+//  uploaded. Buffers belong to object ids, so an object and its snapshots
+//  share one.
+//
+//  All methods need the OpenGL context that the buffers belong to.
+//
+#pragma once
+
+#include <QColor>
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QOpenGLShaderProgram>
+#include <cstdint>
+#include <map>
+#include <memory>
+
+class LineBatch;
+class PointCloud;
+
+class GLBufferCache {
+public:
+  GLBufferCache();
+  ~GLBufferCache();
+
+  // false if the shaders could not be built; nothing must be drawn then
+  bool valid() const { return m_valid; }
+
+  void draw(const PointCloud &cloud, const QMatrix4x4 &renderMatrix,
+            const QColor &color, float pointSize);
+  // the first lineCount lines of the batch
+  void draw(const LineBatch &lines, const QMatrix4x4 &renderMatrix,
+            float lineWidth, std::size_t lineCount);
+
+  // frees the buffers of objects not drawn since the last call
+  void releaseUnused();
+
+  // bytes uploaded by the draw() calls, e.g. for benchmarks
+  std::size_t uploadedBytes() const { return m_uploadedBytes; }
+  void resetStatistics() { m_uploadedBytes = 0; }
+
+private:
+  struct Entry {
+    QOpenGLBuffer buffer{QOpenGLBuffer::VertexBuffer};
+    std::size_t capacity = 0; // in vertices
+    std::size_t count = 0;    // uploaded vertices
+    std::uint64_t revision = 0;
+    bool used = false;
+  };
+  using Entries = std::map<std::uint64_t, std::unique_ptr<Entry>>; // by id
+
+  QOpenGLShaderProgram m_pointProgram, m_lineProgram;
+  bool m_valid = false;
+  int m_pointPosition = -1, m_pointMatrix = -1, m_pointColor = -1,
+      m_pointSize = -1;
+  int m_linePosition = -1, m_lineColor = -1, m_lineMatrix = -1;
+  Entries m_points, m_lines;
+  std::size_t m_uploadedBytes = 0;
+
+  // the bound buffer of an object with n vertices of the given size; true
+  // if it was (re)allocated and must be filled completely
+  bool prepare(Entries &entries, std::uint64_t id, std::size_t n,
+               int vertexSize, Entry *&entry);
+  void upload(Entry &entry, std::size_t begin, std::size_t end,
+              const void *vertices, int vertexSize);
+};
@@ -0,0 +1,188 @@
+#include "GlobalRegistration.h"
+#include "ICP.h"
+#include "Parallel.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// a transform hypothesis and its score over the matches
+struct Hypothesis {
+  Eigen::Matrix4f transform = Eigen::Matrix4f::Identity();
+  int inliers = 0;
+  double sumDist2 = 0.0;
+
+  bool betterThan(const Hypothesis &h) const {
+    return inliers > h.inliers ||
+           (inliers == h.inliers && sumDist2 < h.sumDist2);
+  }
+};
+
+// least-squares rigid transform of the matches selected by pick
+template <typename Pick>
+Eigen::Matrix4f fit(const std::vector<Eigen::Vector3f> &p,
+                    const std::vector<Eigen::Vector3f> &q, int count,
+                    Pick pick) {
+  Eigen::Vector3d meanP = Eigen::Vector3d::Zero();
+  Eigen::Vector3d meanQ = Eigen::Vector3d::Zero();
+  Eigen::Matrix3d sumPQ = Eigen::Matrix3d::Zero();
+  for (int k = 0; k < count; ++k) {
+    const int i = pick(k);
+    Eigen::Vector3d a = p[i].cast<double>(), b = q[i].cast<double>();
+    meanP += a;
+    meanQ += b;
+    sumPQ += a * b.transpose();
+  }
+  meanP /= count;
+  meanQ /= count;
+  return ICP::bestFitTransform(meanP, meanQ,
+                               sumPQ / count - meanP * meanQ.transpose());
+}
+
+} // namespace
+
+GlobalRegistrationResult
+registerGlobally(const KdTree &source, const KdTree &target,
+                 const GlobalRegistrationParameters &parameters) {
+  GlobalRegistrationResult result;
+
+  auto start = std::chrono::steady_clock::now();
+  const std::vector<FPFHDescriptor> sourceFeatures =
+      computeFPFH(source, parameters.featureRadius);
+  const std::vector<FPFHDescriptor> targetFeatures =
+      computeFPFH(target, parameters.featureRadius);
+  result.descriptors = sourceFeatures.size() + targetFeatures.size();
+  result.descriptorSeconds = secondsSince(start);
+
+  // nearest target descriptor of every source descriptor, and back
+  start = std::chrono::steady_clock::now();
+  const std::size_t ns = sourceFeatures.size();
+  std::vector<int> forward(ns, -1);
+  {
+    const FPFHTree targetTree(targetFeatures);
+    parallelFor(
+        ns,
+        [&](std::size_t i) {
+          forward[i] = targetTree.nearest(sourceFeatures[i]);
+        },
+        256);
+  }
+  if (parameters.mutualFilter && !sourceFeatures.empty()) {
+    const FPFHTree sourceTree(sourceFeatures);
+    parallelFor(
+        ns,
+        [&](std::size_t i) {
+          if (forward[i] >= 0 &&
+              sourceTree.nearest(targetFeatures[forward[i]]) != int(i))
+            forward[i] = -1;
+        },
+        256);
+  }
+  std::vector<Eigen::Vector3f> p, q; // matched positions
+  for (std::size_t i = 0; i < ns; ++i) {
+    if (forward[i] < 0)
+      continue;
+    const QVector4D &a = source.cloud()[i], &b = target.cloud()[forward[i]];
+    p.emplace_back(a.x(), a.y(), a.z());
+    q.emplace_back(b.x(), b.y(), b.z());
+  }
+  const int m = int(p.size());
+  result.correspondences = m;
+  result.matchingSeconds = secondsSince(start);
+  if (m < 3)
+    return result;
+
+  // RANSAC: every thread draws samples until the shared iteration budget,
+  // lowered as better hypotheses are found, is used up
+  start = std::chrono::steady_clock::now();
+  const float maxDist2 = parameters.maxCorrespondenceDistance *
+                         parameters.maxCorrespondenceDistance;
+  auto score = [&](const Eigen::Matrix4f &T) {
+    Hypothesis h;
+    h.transform = T;
+    const Eigen::Matrix3f R = T.topLeftCorner<3, 3>();
+    const Eigen::Vector3f t = T.topRightCorner<3, 1>();
+    for (int k = 0; k < m; ++k) {
+      float d2 = (R * p[k] + t - q[k]).squaredNorm();
+      if (d2 <= maxDist2) {
+        ++h.inliers;
+        h.sumDist2 += d2;
+      }
+    }
+    return h;
+  };
+  const double logFailure = std::log(1.0 - double(parameters.confidence));
+  std::atomic<int> drawn{0}, budget{parameters.maxIterations};
+  const unsigned threads = parallelThreadCount();
+  std::vector<Hypothesis> best(threads);
+  parallelChunks(
+      threads,
+      [&](std::size_t, std::size_t, unsigned c) {
+        std::mt19937 rng(parameters.seed + c);
+        std::uniform_int_distribution<int> pick(0, m - 1);
+        const float sim = parameters.edgeSimilarity;
+        while (drawn.fetch_add(1) < budget.load()) {
+          int s[3] = {pick(rng), pick(rng), pick(rng)};
+          if (s[0] == s[1] || s[1] == s[2] || s[0] == s[2])
+            continue;
+          // corresponding edges of a rigid motion have equal lengths
+          bool similar = true;
+          for (int e = 0; e < 3 && similar; ++e) {
+            float ls = (p[s[e]] - p[s[(e + 1) % 3]]).norm();
+            float lt = (q[s[e]] - q[s[(e + 1) % 3]]).norm();
+            similar = ls >= sim * lt && lt >= sim * ls && ls > 0.0f;
+          }
+          if (!similar)
+            continue;
+          Hypothesis h = score(fit(p, q, 3, [&](int k) { return s[k]; }));
+          if (!h.betterThan(best[c]))
+            continue;
+          best[c] = h;
+          // samples needed to draw an all-inlier triple with the confidence
+          double w = double(h.inliers) / m;
+          double miss = std::log(std::max(1.0 - w * w * w, 1e-12));
+          int needed = int(std::min<double>(parameters.maxIterations,
+                                            std::ceil(logFailure / miss)));
+          int current = budget.load();
+          while (needed < current &&
+                 !budget.compare_exchange_weak(current, needed))
+            ;
+        }
+      },
+      1);
+  Hypothesis winner;
+  for (const Hypothesis &h : best)
+    if (h.betterThan(winner))
+      winner = h;
+  result.iterations = std::min(drawn.load(), budget.load());
+
+  // refit to the inliers, kept if it does not lose any
+  if (winner.inliers >= 3) {
+    std::vector<int> inliers;
+    const Eigen::Matrix3f R = winner.transform.topLeftCorner<3, 3>();
+    const Eigen::Vector3f t = winner.transform.topRightCorner<3, 1>();
+    for (int k = 0; k < m; ++k)
+      if ((R * p[k] + t - q[k]).squaredNorm() <= maxDist2)
+        inliers.push_back(k);
+    Hypothesis refit = score(fit(p, q, int(inliers.size()),
+                                 [&](int k) { return inliers[k]; }));
+    if (refit.inliers >= winner.inliers)
+      winner = refit;
+  }
+  result.transform = winner.transform;
+  result.inliers = winner.inliers;
+  result.rmse =
+      winner.inliers ? float(std::sqrt(winner.sumDist2 / winner.inliers)) : 0;
+  result.ransacSeconds = secondsSince(start);
+  return result;
+}
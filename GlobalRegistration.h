@@ -0,0 +1,51 @@
+//
+//  Coarse registration of two clouds in arbitrary relative pose from FPFH
+//  correspondences, as the initial transform for ICP
+//
+#pragma once
+
+#include "FPFH.h"
+
+#include <Eigen/Dense>
+
+struct GlobalRegistrationParameters {
+  float featureRadius = 0.05f; // FPFH neighbourhood, scene units
+  // correspondences closer than this after alignment are inliers
+  float maxCorrespondenceDistance = 0.015f;
+  bool mutualFilter = true; // keep only mutual nearest descriptors
+  // samples whose corresponding edge lengths differ by a ratio below this
+  // are rejected before a transform is fit
+  float edgeSimilarity = 0.9f;
+  int maxIterations = 100000;
+  float confidence = 0.999f; // of having drawn an all-inlier sample
+  unsigned seed = 1;
+};
+
+struct GlobalRegistrationResult {
+  Eigen::Matrix4f transform = Eigen::Matrix4f::Identity(); // source->target
+  int correspondences = 0; // descriptor matches
+  int inliers = 0;         // of the matches, at the final transform
+  float rmse = 0.0f;       // over the inlier matches
+  int iterations = 0;      // RANSAC samples drawn
+  std::size_t descriptors = 0;
+  double descriptorSeconds = 0.0, matchingSeconds = 0.0,
+         ransacSeconds = 0.0;
+
+  double descriptorsPerSecond() const {
+    return descriptorSeconds > 0.0 ? descriptors / descriptorSeconds : 0.0;
+  }
+  double seconds() const {
+    return descriptorSeconds + matchingSeconds + ransacSeconds;
+  }
+};
+
+// Matches the FPFH descriptors of both clouds (which need normals, see
+// estimateNormals) through an FPFHTree and fits a rigid transform to the
+// matches by RANSAC: samples of three matches with similar edge lengths are
+// fit with ICP::bestFitTransform and scored by their inlier matches, until
+// the adaptive iteration count for the confidence is reached. The threads
+// draw samples concurrently. The best transform is refit to its inliers.
+GlobalRegistrationResult
+registerGlobally(const KdTree &source, const KdTree &target,
+                 const GlobalRegistrationParameters &parameters =
+                     GlobalRegistrationParameters());
@@ -47,9 +47,16 @@ void Hexahedron::affineMap(const QMatrix4x4 &M) {
 
 void Hexahedron::draw(const RenderCamera &renderer, const QColor &color,
                       float lineWidth) const {
-  for (unsigned i = 0; i < 2 * edgeCount; i += 2)
-    renderer.renderLine((*this)[edgeList[i]], (*this)[edgeList[i + 1]], color,
-                        lineWidth);
+  const std::vector<QVector3D> &corners = *this;
+  if (wireframe.empty() || wireframeColor != color ||
+      wireframeCorners != corners) {
+    wireframe.clear();
+    for (unsigned i = 0; i < 2 * edgeCount; i += 2)
+      wireframe.addLine(corners[edgeList[i]], corners[edgeList[i + 1]], color);
+    wireframeCorners = corners;
+    wireframeColor = color;
+  }
+  wireframe.draw(renderer, lineWidth);
 }
 
 void Hexahedron::drawPoints(const RenderCamera &renderer, const QColor &col,
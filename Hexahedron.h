@@ -46,6 +46,13 @@ protected:
       0, 1, 0, 3, 1, 2, 2, 3, 4, 5, 4, 7, 5, 6, 6, 7, 0, 4, 1, 5, 2, 6, 3, 7};
   constexpr static unsigned faceList[4 * faceCount] = {
       0, 1, 2, 3, 0, 3, 7, 4, 0, 4, 5, 1, 6, 5, 4, 7, 6, 7, 3, 2, 6, 2, 1, 5};
+
+private:
+  // the wireframe, rebuilt when the corners (which are public) or the colour
+  // differ from the ones it was built for
+  mutable LineBatch wireframe;
+  mutable std::vector<QVector3D> wireframeCorners;
+  mutable QColor wireframeColor;
 };
 
 QDebug &operator<<(QDebug &dbg, const Hexahedron &hex);
@@ -0,0 +1,207 @@
+#include "ICP.h"
+#include "Parallel.h"
+
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// sums over the accepted correspondences of one chunk of source points
+struct Accumulator {
+  int count = 0;
+  double sumDist2 = 0.0;
+  Eigen::Vector3d sumP = Eigen::Vector3d::Zero();
+  Eigen::Vector3d sumQ = Eigen::Vector3d::Zero();
+  Eigen::Matrix3d sumPQ = Eigen::Matrix3d::Zero();           // point-to-point
+  Eigen::Matrix<double, 6, 6> JtJ = Eigen::Matrix<double, 6, 6>::Zero();
+  Eigen::Matrix<double, 6, 1> Jtr = Eigen::Matrix<double, 6, 1>::Zero();
+
+  void merge(const Accumulator &a) {
+    count += a.count;
+    sumDist2 += a.sumDist2;
+    sumP += a.sumP;
+    sumQ += a.sumQ;
+    sumPQ += a.sumPQ;
+    JtJ += a.JtJ;
+    Jtr += a.Jtr;
+  }
+};
+
+// the normal attribute columns of a cloud, if it has them
+struct Normals {
+  const std::vector<float> *x, *y, *z;
+
+  explicit Normals(const PointCloud &cloud)
+      : x(cloud.findAttribute("nx")), y(cloud.findAttribute("ny")),
+        z(cloud.findAttribute("nz")) {}
+
+  bool valid() const { return x && y && z; }
+  Eigen::Vector3f operator[](std::size_t i) const {
+    return Eigen::Vector3f((*x)[i], (*y)[i], (*z)[i]);
+  }
+};
+
+} // namespace
+
+ICP::ICP(const KdTree &target, const ICPParameters &parameters)
+    : m_target(target), m_parameters(parameters) {}
+
+Eigen::Matrix4f ICP::bestFitTransform(const Eigen::Vector3d &meanP,
+                                      const Eigen::Vector3d &meanQ,
+                                      const Eigen::Matrix3d &crossCov) {
+  Eigen::JacobiSVD<Eigen::Matrix3d> svd(crossCov, Eigen::ComputeFullU |
+                                                      Eigen::ComputeFullV);
+  Eigen::Matrix3d D = Eigen::Matrix3d::Identity();
+  if ((svd.matrixV() * svd.matrixU().transpose()).determinant() < 0.0)
+    D(2, 2) = -1.0; // reflection -> rotation
+  Eigen::Matrix3d R = svd.matrixV() * D * svd.matrixU().transpose();
+
+  Eigen::Matrix4f T = Eigen::Matrix4f::Identity();
+  T.topLeftCorner<3, 3>() = R.cast<float>();
+  T.topRightCorner<3, 1>() = (meanQ - R * meanP).cast<float>();
+  return T;
+}
+
+ICPResult ICP::align(const PointCloud &source,
+                     const Eigen::Matrix4f &initial) const {
+  const bool toPlane = m_parameters.metric == ICPMetric::IM_POINT_TO_PLANE;
+  const PointCloud &target = m_target.cloud();
+  const Normals targetNormals(target), sourceNormals(source);
+  if (toPlane && !targetNormals.valid())
+    throw std::runtime_error("point-to-plane ICP needs target normals");
+  const bool checkNormals = targetNormals.valid() && sourceNormals.valid() &&
+                            m_parameters.maxNormalAngle < 180.0f;
+  const float maxDist2 = m_parameters.maxCorrespondenceDistance *
+                         m_parameters.maxCorrespondenceDistance;
+  const float minCos =
+      std::cos(m_parameters.maxNormalAngle * float(M_PI) / 180.0f);
+
+  // nearest neighbours of the transformed source points, accumulated per
+  // chunk so that no correspondence list is materialised
+  auto correspond = [&](const Eigen::Matrix4f &T) {
+    const Eigen::Matrix3f R = T.topLeftCorner<3, 3>();
+    const Eigen::Vector3f t = T.topRightCorner<3, 1>();
+    const std::size_t n = source.size();
+    std::vector<Accumulator> partial(parallelChunkCount(n, 1024));
+    parallelChunks(
+        n,
+        [&](std::size_t b, std::size_t e, unsigned c) {
+          Accumulator &acc = partial[c];
+          for (std::size_t i = b; i < e; ++i) {
+            const QVector4D &s = source[i];
+            Eigen::Vector3f p = R * Eigen::Vector3f(s.x(), s.y(), s.z()) + t;
+            float d2;
+            int j = m_target.nearest(QVector3D(p.x(), p.y(), p.z()), &d2);
+            if (j < 0 || d2 > maxDist2)
+              continue;
+            // unsigned angle, normals need not be consistently oriented
+            if (checkNormals &&
+                std::fabs((R * sourceNormals[i]).dot(targetNormals[j])) <
+                    minCos)
+              continue;
+
+            const QVector4D &tq = target[j];
+            Eigen::Vector3d q(tq.x(), tq.y(), tq.z());
+            Eigen::Vector3d pd = p.cast<double>();
+            ++acc.count;
+            acc.sumDist2 += d2;
+            if (toPlane) {
+              Eigen::Vector3d nq = targetNormals[j].cast<double>();
+              Eigen::Matrix<double, 6, 1> J;
+              J << pd.cross(nq), nq;
+              double r = nq.dot(pd - q);
+              acc.JtJ += J * J.transpose();
+              acc.Jtr += J * r;
+            } else {
+              acc.sumP += pd;
+              acc.sumQ += q;
+              acc.sumPQ += pd * q.transpose();
+            }
+          }
+        },
+        1024);
+    for (std::size_t c = 1; c < partial.size(); ++c)
+      partial[0].merge(partial[c]);
+    return partial[0];
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  ICPResult result;
+  result.transform = initial;
+  Eigen::Matrix4f previousTransform = initial;
+  double previousRmse = std::numeric_limits<double>::max();
+
+  for (int it = 1; it <= m_parameters.maxIterations; ++it) {
+    Accumulator acc = correspond(result.transform);
+    if (acc.count < (toPlane ? 6 : 3))
+      break;
+    double rmse = std::sqrt(acc.sumDist2 / acc.count);
+    if (rmse > previousRmse) {
+      // diverging: the last update is undone, and ICP has not converged
+      result.transform = previousTransform;
+      --result.iterations;
+      break;
+    }
+
+    Eigen::Matrix4f update = Eigen::Matrix4f::Identity();
+    if (toPlane) {
+      Eigen::Matrix<double, 6, 1> x = acc.JtJ.ldlt().solve(-acc.Jtr);
+      Eigen::Vector3d omega = x.head<3>();
+      if (omega.norm() > 0.0)
+        update.topLeftCorner<3, 3>() =
+            Eigen::AngleAxisd(omega.norm(), omega.normalized())
+                .toRotationMatrix()
+                .cast<float>();
+      update.topRightCorner<3, 1>() = x.tail<3>().cast<float>();
+    } else {
+      Eigen::Vector3d meanP = acc.sumP / acc.count;
+      Eigen::Vector3d meanQ = acc.sumQ / acc.count;
+      Eigen::Matrix3d crossCov =
+          acc.sumPQ / acc.count - meanP * meanQ.transpose();
+      update = bestFitTransform(meanP, meanQ, crossCov);
+    }
+    previousTransform = result.transform;
+    result.transform = update * result.transform;
+    result.iterations = it;
+
+    float angle =
+        Eigen::AngleAxisf(Eigen::Matrix3f(update.topLeftCorner<3, 3>()))
+            .angle();
+    float shift = update.topRightCorner<3, 1>().norm();
+    if ((angle < m_parameters.minRotation &&
+         shift < m_parameters.minTranslation) ||
+        previousRmse - rmse <
+            m_parameters.minRelativeImprovement * previousRmse) {
+      result.converged = true;
+      break;
+    }
+    previousRmse = rmse;
+  }
+
+  Accumulator last = correspond(result.transform);
+  result.correspondences = last.count;
+  result.rmse = last.count ? float(std::sqrt(last.sumDist2 / last.count))
+                            : 0.0f;
+  result.seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  return result;
+}
+
+QMatrix4x4 toQMatrix4x4(const Eigen::Matrix4f &M) {
+  QMatrix4x4 Q;
+  for (int r = 0; r < 4; ++r)
+    for (int c = 0; c < 4; ++c)
+      Q(r, c) = M(r, c);
+  return Q;
+}
+
+Eigen::Matrix4f toEigenMatrix4f(const QMatrix4x4 &Q) {
+  Eigen::Matrix4f M;
+  for (int r = 0; r < 4; ++r)
+    for (int c = 0; c < 4; ++c)
+      M(r, c) = Q(r, c);
+  return M;
+}
@@ -0,0 +1,69 @@
+//
+//  Iterative closest point registration of a source cloud onto a target
+//  cloud indexed by a KdTree
+//
+#pragma once
+
+#include "KdTree.h"
+
+#include <Eigen/Dense>
+#include <QMatrix4x4>
+#include <limits>
+
+enum class ICPMetric {
+  IM_POINT_TO_POINT, // closed-form SVD update
+  IM_POINT_TO_PLANE  // linearised least squares, needs target normals
+};
+
+struct ICPParameters {
+  ICPMetric metric = ICPMetric::IM_POINT_TO_POINT;
+  int maxIterations = 50;
+  // correspondences farther apart than this are rejected
+  float maxCorrespondenceDistance = std::numeric_limits<float>::max();
+  // with normals on both clouds (attributes "nx", "ny", "nz", see
+  // estimateNormals), pairs whose normals differ by more than this angle
+  // (degrees) are rejected
+  float maxNormalAngle = 180.0f;
+  // convergence: the update moves by less than these ...
+  float minRotation = 1e-5f;    // radians
+  float minTranslation = 1e-6f; // scene units
+  // ... or the RMSE improves by less than this fraction; if it rises, the
+  // last update is undone and the result is not converged
+  float minRelativeImprovement = 1e-5f;
+};
+
+struct ICPResult {
+  Eigen::Matrix4f transform = Eigen::Matrix4f::Identity(); // source->target
+  int iterations = 0;
+  int correspondences = 0; // accepted pairs at the final transform
+  float rmse = 0.0f;       // over the accepted pairs at the final transform
+  bool converged = false;
+  double seconds = 0.0;
+
+  double iterationsPerSecond() const {
+    return seconds > 0.0 ? iterations / seconds : 0.0;
+  }
+};
+
+class ICP {
+public:
+  // The tree must stay alive and unchanged while the ICP is used.
+  explicit ICP(const KdTree &target,
+               const ICPParameters &parameters = ICPParameters());
+
+  ICPResult align(const PointCloud &source,
+                  const Eigen::Matrix4f &initial = Eigen::Matrix4f::Identity())
+      const;
+
+  // least-squares rigid transform mapping the points p onto the points q
+  static Eigen::Matrix4f bestFitTransform(const Eigen::Vector3d &meanP,
+                                          const Eigen::Vector3d &meanQ,
+                                          const Eigen::Matrix3d &crossCov);
+
+private:
+  const KdTree &m_target;
+  ICPParameters m_parameters;
+};
+
+QMatrix4x4 toQMatrix4x4(const Eigen::Matrix4f &M);
+Eigen::Matrix4f toEigenMatrix4f(const QMatrix4x4 &M);
@@ -0,0 +1,43 @@
+//
+//  Minimal row-major image of arbitrary pixel type, e.g. depth maps
+//
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+template <typename T> class Image {
+public:
+  Image(int width = 0, int height = 0, const T &value = T())
+      : m_width(width), m_height(height),
+        m_pixels(std::size_t(width) * height, value) {}
+
+  int width() const { return m_width; }
+  int height() const { return m_height; }
+  bool contains(int x, int y) const {
+    return x >= 0 && y >= 0 && x < m_width && y < m_height;
+  }
+
+  T &operator()(int x, int y) {
+    return m_pixels[std::size_t(y) * m_width + x];
+  }
+  const T &operator()(int x, int y) const {
+    return m_pixels[std::size_t(y) * m_width + x];
+  }
+
+  T *data() { return m_pixels.data(); }
+  const T *data() const { return m_pixels.data(); }
+  T *row(int y) { return m_pixels.data() + std::size_t(y) * m_width; }
+  const T *row(int y) const {
+    return m_pixels.data() + std::size_t(y) * m_width;
+  }
+
+  void fill(const T &value) {
+    std::fill(m_pixels.begin(), m_pixels.end(), value);
+  }
+
+private:
+  int m_width, m_height;
+  std::vector<T> m_pixels;
+};
@@ -1,12 +1,36 @@
 #include "KdTree.h"
 #include <algorithm>
+#include <numeric>
 
 static int axisForDepth(int d) { return d % 3; }
-KdTree::KdTree(PointCloud &cloud, int maxDepth, int minPoints, int visualDepth)
+
+// squared distance from q to the box [mn,mx], zero inside
+static float boxDist2(const QVector3D &q, const QVector3D &mn,
+                      const QVector3D &mx) {
+  float d2 = 0.0f;
+  for (int k = 0; k < 3; ++k) {
+    float d = std::max({mn[k] - q[k], 0.0f, q[k] - mx[k]});
+    d2 += d * d;
+  }
+  return d2;
+}
+
+static float pointDist2(const QVector3D &q, const QVector4D &p) {
+  float dx = p.x() - q.x(), dy = p.y() - q.y(), dz = p.z() - q.z();
+  return dx * dx + dy * dy + dz * dz;
+}
+KdTree::KdTree(PointCloud &cloud, int maxDepth, int minPoints, int visualDepth,
+               std::vector<int> *permutation)
     : m_cloud(cloud), m_maxDepth(maxDepth), m_minPoints(minPoints),
       m_visualDepth(visualDepth) {
   type = SceneObjectType::ST_KD_TREE;
-  m_root = build(0, cloud.size(), 0);
+  // build on a permutation, then sort points and attributes by the leaves
+  std::vector<int> order(cloud.size());
+  std::iota(order.begin(), order.end(), 0);
+  m_root = build(order, 0, cloud.size(), 0);
+  m_cloud.reorder(order);
+  if (permutation)
+    *permutation = std::move(order);
 }
 
 KdTree::~KdTree() {
@@ -20,7 +44,8 @@ KdTree::~KdTree() {
   freeNode(m_root);
 }
 
-KdTree::Node *KdTree::build(int begin, int end, int depth) {
+KdTree::Node *KdTree::build(std::vector<int> &order, int begin, int end,
+                            int depth) {
   Node *n = new Node;
   n->begin = begin;
   n->end = end;
@@ -31,7 +56,7 @@ KdTree::Node *KdTree::build(int begin, int end, int depth) {
                std::numeric_limits<float>::max());
   QVector3D mx(-mn);
   for (int i = begin; i < end; ++i) {
-    const QVector4D &p = m_cloud[i];
+    const QVector4D &p = m_cloud[order[i]];
     mn.setX(std::min(mn.x(), p.x()));
     mx.setX(std::max(mx.x(), p.x()));
     mn.setY(std::min(mn.y(), p.y()));
@@ -47,48 +72,214 @@ KdTree::Node *KdTree::build(int begin, int end, int depth) {
 
   int axis = axisForDepth(depth);
   int mid = (begin + end) / 2;
-  std::nth_element(m_cloud.begin() + begin, m_cloud.begin() + mid,
-                   m_cloud.begin() + end,
-                   [axis](const QVector4D &a, const QVector4D &b) {
-                     return a[axis] < b[axis];
+  std::nth_element(order.begin() + begin, order.begin() + mid,
+                   order.begin() + end, [&](int a, int b) {
+                     return m_cloud[a][axis] < m_cloud[b][axis];
                    });
-  n->left = build(begin, mid, depth + 1);
-  n->right = build(mid, end, depth + 1);
+  n->left = build(order, begin, mid, depth + 1);
+  n->right = build(order, mid, end, depth + 1);
   return n;
 }
 
 void KdTree::draw(const RenderCamera &renderer, const QColor &colour,
                   float lineWidth) const {
-  drawNode(m_root, renderer, m_visualDepth, colour, lineWidth);
+  m_wireframe.draw(renderer, m_root, m_visualDepth, colour, lineWidth,
+                   [](const Node *n, auto &&f) {
+                     f(n->left);
+                     f(n->right);
+                   });
+}
+
+RayHit KdTree::raycast(const Ray &ray, float radius, float coneSlope) const {
+  RayHit hit;
+  raycastNode(m_root, ray, radius, coneSlope, hit);
+  return hit;
 }
 
-void KdTree::drawNode(const Node *n, const RenderCamera &renderer,
-                      int maxVisualDepth, const QColor &colour,
-                      float lineWidth) const {
-  if (!n || n->depth > maxVisualDepth)
+void KdTree::raycastNode(const Node *n, const Ray &ray, float radius,
+                         float coneSlope, RayHit &hit) const {
+  float tEnter, tExit;
+  if (!n || n->begin == n->end ||
+      !raySlab(ray, n->min, n->max,
+               rayBoxMargin(ray, n->min, n->max, radius, coneSlope), tEnter,
+               tExit) ||
+      tEnter >= hit.t)
+    return;
+
+  if (!n->left) {
+    for (int i = n->begin; i < n->end; ++i)
+      rayTestPoint(ray, QVector3D(cloud()[i]), i, radius, coneSlope, hit);
     return;
+  }
 
-  const QVector3D &a = n->min;
-  const QVector3D &b = n->max;
+  // visit the child the ray reaches first, so the other is likely pruned
+  const Node *first = n->left, *second = n->right;
+  int axis = axisForDepth(n->depth);
+  if (ray.direction[axis] < 0.0f)
+    std::swap(first, second);
+  raycastNode(first, ray, radius, coneSlope, hit);
+  raycastNode(second, ray, radius, coneSlope, hit);
+}
 
-  // 12 wire-frame edges of the AABB
-  auto L = [&](const QVector3D &p1, const QVector3D &p2) {
-    renderer.renderLine(p1.toVector4D(), p2.toVector4D(), colour, lineWidth);
-  };
+int KdTree::nearest(const QVector3D &q, float *dist2) const {
+  int best = -1;
+  float bestDist2 = std::numeric_limits<float>::max();
+  nearestNode(m_root, q, 0.0f, best, bestDist2);
+  if (dist2)
+    *dist2 = bestDist2;
+  return best;
+}
+
+void KdTree::nearestBatch(const QVector4D *queries, std::size_t count,
+                          int *indices, float *dist2, float stopDist2) const {
+  const QVector4D *pts = cloud().constData();
+  int previous = -1;
+  for (std::size_t i = 0; i < count; ++i) {
+    const QVector3D q(queries[i]);
+    int best = previous;
+    float bestDist2 = previous >= 0 ? pointDist2(q, pts[previous])
+                                    : std::numeric_limits<float>::max();
+    if (bestDist2 > stopDist2)
+      nearestNode(m_root, q, stopDist2, best, bestDist2);
+    indices[i] = previous = best;
+    dist2[i] = bestDist2;
+  }
+}
 
-  L({a.x(), a.y(), a.z()}, {b.x(), a.y(), a.z()});
-  L({a.x(), a.y(), a.z()}, {a.x(), b.y(), a.z()});
-  L({a.x(), a.y(), a.z()}, {a.x(), a.y(), b.z()});
-  L({b.x(), b.y(), b.z()}, {a.x(), b.y(), b.z()});
-  L({b.x(), b.y(), b.z()}, {b.x(), a.y(), b.z()});
-  L({b.x(), b.y(), b.z()}, {b.x(), b.y(), a.z()});
-  L({a.x(), b.y(), a.z()}, {b.x(), b.y(), a.z()});
-  L({a.x(), b.y(), a.z()}, {a.x(), b.y(), b.z()});
-  L({a.x(), a.y(), b.z()}, {b.x(), a.y(), b.z()});
-  L({a.x(), a.y(), b.z()}, {a.x(), b.y(), b.z()});
-  L({b.x(), a.y(), a.z()}, {b.x(), a.y(), b.z()});
-  L({b.x(), a.y(), a.z()}, {b.x(), b.y(), a.z()});
-
-  drawNode(n->left, renderer, maxVisualDepth, colour, lineWidth);
-  drawNode(n->right, renderer, maxVisualDepth, colour, lineWidth);
+void KdTree::nearestNode(const Node *n, const QVector3D &q, float stopDist2,
+                         int &best, float &bestDist2) const {
+  if (!n->left) {
+    for (int i = n->begin; i < n->end; ++i) {
+      float d2 = pointDist2(q, cloud()[i]);
+      if (d2 < bestDist2) {
+        bestDist2 = d2;
+        best = i;
+      }
+    }
+    return;
+  }
+  float dl = boxDist2(q, n->left->min, n->left->max);
+  float dr = boxDist2(q, n->right->min, n->right->max);
+  const Node *first = n->left, *second = n->right;
+  if (dr < dl) {
+    std::swap(first, second);
+    std::swap(dl, dr);
+  }
+  if (dl < bestDist2)
+    nearestNode(first, q, stopDist2, best, bestDist2);
+  if (dr < bestDist2 && bestDist2 > stopDist2)
+    nearestNode(second, q, stopDist2, best, bestDist2);
+}
+
+void KdTree::knnSearch(const QVector3D &q, int k, std::vector<int> &indices,
+                       std::vector<float> &dist2) const {
+  k = std::max(k, 0);
+  indices.resize(k);
+  dist2.resize(k);
+  int count = 0;
+  if (k > 0 && m_root)
+    knnNode(m_root, q, k, indices.data(), dist2.data(), count);
+  indices.resize(count);
+  dist2.resize(count);
+}
+
+void KdTree::knnBatch(int begin, int end, int k, std::vector<int> &indices,
+                      std::vector<float> &dist2) const {
+  k = std::max(k, 0);
+  const std::size_t rows = std::size_t(std::max(end - begin, 0));
+  indices.assign(rows * k, -1);
+  dist2.assign(rows * k, std::numeric_limits<float>::max());
+  if (!m_root || k == 0)
+    return;
+  // root-to-leaf path of the current query; consecutive points share it
+  std::vector<const Node *> path;
+  for (int i = begin; i < end; ++i) {
+    if (path.empty() || i >= path.back()->end) {
+      path.assign(1, m_root);
+      while (path.back()->left) {
+        const Node *n = path.back();
+        path.push_back(i < n->left->end ? n->left : n->right);
+      }
+    }
+    const QVector3D q(cloud()[i]);
+    int *rowIndices = &indices[std::size_t(i - begin) * k];
+    float *rowDist2 = &dist2[std::size_t(i - begin) * k];
+    int count = 0;
+    // bottom-up: the own leaf gives a tight bound, then the siblings along
+    // the path are visited unless their boxes lie outside the k-ball
+    knnNode(path.back(), q, k, rowIndices, rowDist2, count);
+    for (std::size_t level = path.size() - 1; level > 0; --level) {
+      const Node *parent = path[level - 1];
+      const Node *sibling =
+          path[level] == parent->left ? parent->right : parent->left;
+      if (count < k ||
+          boxDist2(q, sibling->min, sibling->max) < rowDist2[k - 1])
+        knnNode(sibling, q, k, rowIndices, rowDist2, count);
+    }
+  }
+}
+
+void KdTree::knnNode(const Node *n, const QVector3D &q, int k,
+                     int *indices, float *dist2, int &count) const {
+  if (!n->left) {
+    // sorted insertion, cheaper than a heap for the small k used here
+    const QVector4D *pts = cloud().constData();
+    float bound = count < k ? std::numeric_limits<float>::max() : dist2[k - 1];
+    for (int i = n->begin; i < n->end; ++i) {
+      float d2 = pointDist2(q, pts[i]);
+      if (d2 >= bound)
+        continue;
+      int j = count < k ? count++ : k - 1;
+      for (; j > 0 && dist2[j - 1] > d2; --j) {
+        dist2[j] = dist2[j - 1];
+        indices[j] = indices[j - 1];
+      }
+      dist2[j] = d2;
+      indices[j] = i;
+      if (count == k)
+        bound = dist2[k - 1];
+    }
+    return;
+  }
+  float dl = boxDist2(q, n->left->min, n->left->max);
+  float dr = boxDist2(q, n->right->min, n->right->max);
+  const Node *first = n->left, *second = n->right;
+  if (dr < dl) {
+    std::swap(first, second);
+    std::swap(dl, dr);
+  }
+  if (count < k || dl < dist2[k - 1])
+    knnNode(first, q, k, indices, dist2, count);
+  if (count < k || dr < dist2[k - 1])
+    knnNode(second, q, k, indices, dist2, count);
+}
+
+void KdTree::radiusSearch(const QVector3D &q, float radius,
+                          std::vector<int> &indices,
+                          std::vector<float> *dist2) const {
+  indices.clear();
+  if (dist2)
+    dist2->clear();
+  if (m_root)
+    radiusNode(m_root, q, radius * radius, indices, dist2);
+}
+
+void KdTree::radiusNode(const Node *n, const QVector3D &q, float radius2,
+                        std::vector<int> &indices,
+                        std::vector<float> *dist2) const {
+  if (boxDist2(q, n->min, n->max) > radius2)
+    return;
+  if (!n->left) {
+    for (int i = n->begin; i < n->end; ++i) {
+      float d2 = pointDist2(q, cloud()[i]);
+      if (d2 <= radius2) {
+        indices.push_back(i);
+        if (dist2)
+          dist2->push_back(d2);
+      }
+    }
+    return;
+  }
+  radiusNode(n->left, q, radius2, indices, dist2);
+  radiusNode(n->right, q, radius2, indices, dist2);
 }
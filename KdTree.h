@@ -1,7 +1,11 @@
 #pragma once
+#include "LineBatch.h"
 #include "PointCloud.h"
+#include "Ray.h"
 #include "SceneObject.h"
 
+#include <vector>
+
 class KdTree : public SceneObject {
 public:
   struct Node {
@@ -12,8 +16,10 @@ public:
     int depth = 0;
   };
 
+  // reorders cloud by the leaves; order, if given, receives the permutation:
+  // point i is the former point (*order)[i]
   explicit KdTree(PointCloud &cloud, int maxDepth = 10, int minPoints = 20,
-                  int visualDepth = 3);
+                  int visualDepth = 3, std::vector<int> *order = nullptr);
   ~KdTree() override;
   void setVisualDepth(int d) { m_visualDepth = std::max(1, d); }
   int visualDepth() const { return m_visualDepth; }
@@ -24,6 +30,35 @@ public:
             float lineWidth = 2.0f) const override;
 
   const Node *root() const { return m_root; }
+  const PointCloud &cloud() const { return m_cloud; }
+
+  // Nearest point (smallest ray parameter) inside the tube of the given
+  // radius around the ray, widening by coneSlope per unit distance.
+  RayHit raycast(const Ray &ray, float radius, float coneSlope = 0.0f) const;
+
+  // Nearest-neighbour queries. Indices refer to the cloud, which the tree has
+  // reordered by its leaves; distances are returned squared.
+  int nearest(const QVector3D &q, float *dist2 = nullptr) const;
+  void knnSearch(const QVector3D &q, int k, std::vector<int> &indices,
+                 std::vector<float> &dist2) const; // sorted, closest first
+
+  // Nearest neighbours of count query points, e.g. another cloud in its
+  // tree's order: each search starts from the previous query's neighbour as
+  // the bound, which coherent queries keep tight. A search ends early once a
+  // point within stopDist2 is found; that point is returned instead of the
+  // nearest one.
+  void nearestBatch(const QVector4D *queries, std::size_t count, int *indices,
+                    float *dist2, float stopDist2 = 0.0f) const;
+  void radiusSearch(const QVector3D &q, float radius, std::vector<int> &indices,
+                    std::vector<float> *dist2 = nullptr) const;
+
+  // k nearest neighbours of the cloud's own points [begin, end), written as
+  // sorted rows of k to indices/dist2. Every point is its own neighbour at
+  // distance 0; rows are padded with -1 if the cloud has fewer than k points.
+  // Consecutive points share leaves, so the search runs bottom-up from the
+  // query's leaf.
+  void knnBatch(int begin, int end, int k, std::vector<int> &indices,
+                std::vector<float> &dist2) const;
 
 private:
   PointCloud &m_cloud;
@@ -31,8 +66,15 @@ private:
   int m_maxDepth;
   int m_minPoints;
   int m_visualDepth;
+  mutable TreeWireframe<Node> m_wireframe;
 
-  Node *build(int begin, int end, int depth);
-  void drawNode(const Node *n, const RenderCamera &renderer, int maxVisualDepth,
-                const QColor &colour, float lineWidth) const;
+  Node *build(std::vector<int> &order, int begin, int end, int depth);
+  void raycastNode(const Node *n, const Ray &ray, float radius,
+                   float coneSlope, RayHit &hit) const;
+  void nearestNode(const Node *n, const QVector3D &q, float stopDist2,
+                   int &best, float &bestDist2) const;
+  void knnNode(const Node *n, const QVector3D &q, int k, int *indices,
+               float *dist2, int &count) const;
+  void radiusNode(const Node *n, const QVector3D &q, float radius2,
+                  std::vector<int> &indices, std::vector<float> *dist2) const;
 };
@@ -0,0 +1,91 @@
+#include "LensDistortion.h"
+#include "PerspectiveCamera.h"
+#include "Parallel.h"
+
+#include <cmath>
+
+QVector2D LensDistortion::undistort(const QVector2D &p,
+                                    int maxIterations) const {
+  if (isZero())
+    return p;
+  float x = p.x(), y = p.y();
+  for (int it = 0; it < maxIterations; ++it) {
+    const float r2 = x * x + y * y;
+    const float radial = 1.0f + r2 * (k1 + r2 * (k2 + r2 * k3));
+    const float dRadial = 2.0f * (k1 + r2 * (2.0f * k2 + 3.0f * r2 * k3));
+    QVector2D e = distort(QVector2D(x, y)) - p;
+    if (std::fabs(e.x()) + std::fabs(e.y()) < 1e-7f)
+      break;
+    // Jacobian of distort at (x, y)
+    const float xy = dRadial * x * y + 2.0f * p1 * x + 2.0f * p2 * y;
+    const float a = radial + dRadial * x * x + 2.0f * p1 * y + 6.0f * p2 * x;
+    const float d = radial + dRadial * y * y + 6.0f * p1 * y + 2.0f * p2 * x;
+    const float det = a * d - xy * xy;
+    if (std::fabs(det) < 1e-12f)
+      break;
+    x -= (d * e.x() - xy * e.y()) / det;
+    y -= (a * e.y() - xy * e.x()) / det;
+  }
+  return QVector2D(x, y);
+}
+
+UndistortionLUT::UndistortionLUT(const PerspectiveCamera &camera, int cells)
+    : m_distortion(camera.distortion),
+      m_principalPoint(camera.imagePrincipalPoint),
+      m_focal(camera.imagePlaneDistance), m_cells(std::max(cells, 1)) {
+  // the image plane plus a margin of one cell
+  const float size = camera.imagePlaneSize * (1.0f + 2.0f / m_cells);
+  m_origin = -size;
+  m_scale = m_cells / (2.0f * size);
+  const int side = m_cells + 1;
+  m_x.resize(std::size_t(side) * side);
+  m_y.resize(m_x.size());
+  parallelFor(
+      m_x.size(),
+      [&](std::size_t i) {
+        QVector2D p(m_origin + float(i % side) / m_scale,
+                    m_origin + float(i / side) / m_scale);
+        QVector2D u = exact(p);
+        m_x[i] = u.x();
+        m_y[i] = u.y();
+      },
+      256);
+}
+
+QVector2D UndistortionLUT::exact(const QVector2D &p) const {
+  QVector2D n =
+      m_distortion.undistort((p - m_principalPoint) * (1.0f / m_focal));
+  return m_principalPoint + m_focal * n;
+}
+
+void UndistortionLUT::undistort(const QVector2D *points, std::size_t n,
+                                QVector2D *out) const {
+  const int side = m_cells + 1;
+  parallelFor(n, [&](std::size_t i) {
+    const float gx = (points[i].x() - m_origin) * m_scale;
+    const float gy = (points[i].y() - m_origin) * m_scale;
+    if (!(gx >= 0.0f && gy >= 0.0f && gx < m_cells && gy < m_cells)) {
+      out[i] = exact(points[i]);
+      return;
+    }
+    const int cx = int(gx), cy = int(gy);
+    const float fx = gx - cx, fy = gy - cy;
+    const std::size_t k = std::size_t(cy) * side + cx;
+    auto lerp = [&](const std::vector<float> &v) {
+      float top = v[k] + (v[k + 1] - v[k]) * fx;
+      float bottom = v[k + side] + (v[k + side + 1] - v[k + side]) * fx;
+      return top + (bottom - top) * fy;
+    };
+    out[i] = QVector2D(lerp(m_x), lerp(m_y));
+  });
+}
+
+RemapTable undistortionTable(const PerspectiveCamera &camera, int width,
+                             int height) {
+  // the distorted position of every pinhole pixel, no inversion needed
+  return RemapTable(width, height, width, height, [&](int u, int v) {
+    QVector3D ray = camera.fromPixel(float(u), float(v), 1.0f, width, height,
+                                     false);
+    return camera.toPixel(ray, width, height);
+  });
+}
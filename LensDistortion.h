@@ -0,0 +1,61 @@
+//
+//  Brown-Conrady lens distortion on normalised image coordinates, i.e.
+//  image plane coordinates relative to the principal point divided by the
+//  image plane distance
+//
+#pragma once
+
+#include "RemapTable.h"
+
+#include <QVector2D>
+#include <cstddef>
+#include <vector>
+
+class PerspectiveCamera;
+
+struct LensDistortion {
+  float k1 = 0.0f, k2 = 0.0f, k3 = 0.0f; // radial
+  float p1 = 0.0f, p2 = 0.0f;            // tangential
+
+  bool isZero() const {
+    return k1 == 0.0f && k2 == 0.0f && k3 == 0.0f && p1 == 0.0f &&
+           p2 == 0.0f;
+  }
+
+  QVector2D distort(const QVector2D &p) const {
+    const float x = p.x(), y = p.y(), r2 = x * x + y * y;
+    const float radial = 1.0f + r2 * (k1 + r2 * (k2 + r2 * k3));
+    return QVector2D(x * radial + 2.0f * p1 * x * y + p2 * (r2 + 2.0f * x * x),
+                     y * radial + p1 * (r2 + 2.0f * y * y) + 2.0f * p2 * x * y);
+  }
+
+  // inverse of distort by Newton iterations, for distortions that are
+  // invertible over the image
+  QVector2D undistort(const QVector2D &p, int maxIterations = 20) const;
+};
+
+// Undistorted positions sampled on a grid over the image plane of a
+// camera, so that undistorting points is a bilinear table lookup instead of
+// an iteration. Points off the grid are undistorted exactly.
+class UndistortionLUT {
+public:
+  explicit UndistortionLUT(const PerspectiveCamera &camera, int cells = 64);
+
+  // distorted to undistorted image plane coordinates of n points
+  void undistort(const QVector2D *points, std::size_t n, QVector2D *out) const;
+
+private:
+  LensDistortion m_distortion;
+  QVector2D m_principalPoint;
+  float m_focal, m_origin, m_scale; // grid index = (p - origin) * scale
+  int m_cells;
+  std::vector<float> m_x, m_y; // (cells + 1)^2 undistorted positions
+
+  QVector2D exact(const QVector2D &p) const;
+};
+
+// Remap table from the undistorted (pinhole) image of the camera to the
+// image it records, both width x height pixels: RemapTable::remap with it
+// undistorts an image.
+RemapTable undistortionTable(const PerspectiveCamera &camera, int width,
+                             int height);
@@ -0,0 +1,65 @@
+#include "LineBatch.h"
+#include "RenderCamera.h"
+
+#include <atomic>
+
+namespace {
+
+std::atomic<std::uint64_t> revisionCounter{0};
+
+} // namespace
+
+LineBatch::LineBatch()
+    : m_revision(++revisionCounter), m_clearRevision(m_revision),
+      m_id(++revisionCounter) {}
+
+LineBatch::LineBatch(const LineBatch &other) : LineBatch() {
+  m_vertices = other.m_vertices;
+}
+
+LineBatch &LineBatch::operator=(const LineBatch &other) {
+  m_vertices = other.m_vertices;
+  m_clearRevision = m_revision = ++revisionCounter;
+  return *this;
+}
+
+std::shared_ptr<const LineBatch> LineBatch::snapshot() const {
+  auto copy = std::make_shared<LineBatch>(*this);
+  copy->m_revision = m_revision;
+  copy->m_clearRevision = m_clearRevision;
+  copy->m_id = m_id;
+  return copy;
+}
+
+void LineBatch::clear() {
+  m_vertices.clear();
+  m_clearRevision = m_revision = ++revisionCounter;
+}
+
+void LineBatch::addLine(const QVector3D &a, const QVector3D &b,
+                        const QColor &color) {
+  const auto r = std::uint8_t(color.red()), g = std::uint8_t(color.green()),
+             bl = std::uint8_t(color.blue()), al = std::uint8_t(color.alpha());
+  m_vertices.push_back({a.x(), a.y(), a.z(), r, g, bl, al});
+  m_vertices.push_back({b.x(), b.y(), b.z(), r, g, bl, al});
+  m_revision = ++revisionCounter;
+}
+
+void LineBatch::addBox(const QVector3D &a, const QVector3D &b,
+                       const QColor &color) {
+  // corner k has the coordinates of b where bit 0, 1, 2 of k is set
+  auto corner = [&](int k) {
+    return QVector3D(k & 1 ? b.x() : a.x(), k & 2 ? b.y() : a.y(),
+                     k & 4 ? b.z() : a.z());
+  };
+  // every edge joins two corners differing in one bit
+  for (int k = 0; k < 8; ++k)
+    for (int bit = 1; bit < 8; bit <<= 1)
+      if (!(k & bit))
+        addLine(corner(k), corner(k | bit), color);
+}
+
+void LineBatch::draw(const RenderCamera &renderer, float lineWidth,
+                     std::size_t lineCount) const {
+  renderer.renderLines(*this, lineWidth, lineCount);
+}
@@ -0,0 +1,101 @@
+//
+//  Line segments collected for drawing in one call: the renderer keeps a GPU
+//  copy of every batch and updates it only when the batch's revision has
+//  changed; lines appended since then are uploaded alone, see
+//  RenderCamera::renderLines
+//
+#pragma once
+
+#include <QColor>
+#include <QVector3D>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class RenderCamera;
+
+class LineBatch {
+public:
+  struct Vertex {
+    float x, y, z;
+    std::uint8_t r, g, b, a;
+  };
+
+  LineBatch();
+  // copies take new revisions, their GPU copies are separate
+  LineBatch(const LineBatch &other);
+  LineBatch &operator=(const LineBatch &other);
+
+  void clear();
+  void addLine(const QVector3D &a, const QVector3D &b, const QColor &color);
+  // the 12 edges of an axis-aligned box
+  void addBox(const QVector3D &min, const QVector3D &max, const QColor &color);
+
+  bool empty() const { return m_vertices.empty(); }
+  std::size_t lineCount() const { return m_vertices.size() / 2; }
+  const std::vector<Vertex> &vertices() const { return m_vertices; }
+  // process-wide unique per change, like PointCloud::revision; the lines
+  // have only been appended to since clearRevision()
+  std::uint64_t revision() const { return m_revision; }
+  std::uint64_t clearRevision() const { return m_clearRevision; }
+  // the same for a batch and its snapshots, see PointCloud::id
+  std::uint64_t id() const { return m_id; }
+  // an immutable copy with the id and revisions of this batch
+  std::shared_ptr<const LineBatch> snapshot() const;
+
+  // draws the first lineCount lines
+  void draw(const RenderCamera &renderer, float lineWidth = 1.0f,
+            std::size_t lineCount = SIZE_MAX) const;
+
+private:
+  std::vector<Vertex> m_vertices; // two per line
+  std::uint64_t m_revision, m_clearRevision;
+  std::uint64_t m_id;
+};
+
+// The boxes (min, max) of a tree's nodes in breadth-first order, so that the
+// boxes down to a depth are a prefix of one batch: another visual depth
+// draws another prefix, and deeper levels are appended when first drawn.
+template <typename Node> class TreeWireframe {
+public:
+  // forEachChild(node, f) calls f for the child pointers of node, null ones
+  // included
+  template <typename ForEachChild>
+  void draw(const RenderCamera &renderer, const Node *root, int depth,
+            const QColor &colour, float lineWidth,
+            ForEachChild &&forEachChild) {
+    if (m_root != root || m_colour != colour || m_lines.empty()) {
+      m_lines.clear();
+      m_levelEnd.clear();
+      m_frontier.assign(1, root);
+      m_root = root;
+      m_colour = colour;
+    }
+    while (int(m_levelEnd.size()) <= depth && !m_frontier.empty()) {
+      std::vector<const Node *> next;
+      for (const Node *n : m_frontier) {
+        if (!n)
+          continue;
+        m_lines.addBox(n->min, n->max, colour);
+        forEachChild(n, [&](const Node *child) {
+          if (child)
+            next.push_back(child);
+        });
+      }
+      m_levelEnd.push_back(m_lines.lineCount());
+      m_frontier.swap(next);
+    }
+    if (!m_levelEnd.empty())
+      m_lines.draw(renderer, lineWidth,
+                   m_levelEnd[std::min(std::size_t(std::max(depth, 0)),
+                                       m_levelEnd.size() - 1)]);
+  }
+
+private:
+  LineBatch m_lines;
+  const Node *m_root = nullptr;
+  QColor m_colour;
+  std::vector<std::size_t> m_levelEnd; // lines down to each depth
+  std::vector<const Node *> m_frontier; // nodes of the next level
+};
@@ -0,0 +1,72 @@
+#include "NormalEstimation.h"
+#include "Parallel.h"
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+void estimateNormals(PointCloud &cloud, const KdTree &tree, int k,
+                     const QVector3D &viewpoint) {
+  if (&tree.cloud() != &cloud)
+    throw std::runtime_error("the tree does not index this cloud");
+  if (k < 3)
+    throw std::runtime_error("normal estimation needs k >= 3");
+
+  const std::size_t n = cloud.size();
+  float *nx = cloud.attribute("nx").data();
+  float *ny = cloud.attribute("ny").data();
+  float *nz = cloud.attribute("nz").data();
+  float *curvature = cloud.attribute("curvature").data();
+  const QVector4D *pts = cloud.constData();
+
+  // PCA of the neighbourhood row of point i
+  auto estimate = [&](std::size_t i, const int *row) {
+    const int m = int(std::find(row, row + k, -1) - row);
+    Eigen::Vector3f c = Eigen::Vector3f::Zero();
+    for (int j = 0; j < m; ++j)
+      c += Eigen::Vector3f(pts[row[j]].x(), pts[row[j]].y(), pts[row[j]].z());
+    c /= float(m);
+    Eigen::Matrix3f C = Eigen::Matrix3f::Zero();
+    for (int j = 0; j < m; ++j) {
+      Eigen::Vector3f q(pts[row[j]].x(), pts[row[j]].y(), pts[row[j]].z());
+      q -= c;
+      C += q * q.transpose();
+    }
+    C /= float(m);
+
+    // closed-form solution of the 3x3 characteristic polynomial
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> es;
+    es.computeDirect(C);
+    Eigen::Vector3f normal = es.eigenvectors().col(0);
+    Eigen::Vector3f L = es.eigenvalues();
+    const QVector4D &p = pts[i];
+    Eigen::Vector3f toView(viewpoint.x() - p.x(), viewpoint.y() - p.y(),
+                           viewpoint.z() - p.z());
+    if (normal.dot(toView) < 0.0f)
+      normal = -normal;
+    float sum = L.sum();
+
+    nx[i] = normal.x();
+    ny[i] = normal.y();
+    nz[i] = normal.z();
+    curvature[i] = sum > 0.0f ? std::max(L[0], 0.0f) / sum : 0.0f;
+  };
+
+  // batches of points in tree order are spatially coherent, so the batched
+  // kNN starts each search from the query's own leaf
+  const std::size_t batchSize = 256;
+  parallelChunks(
+      n,
+      [&](std::size_t b, std::size_t e, unsigned) {
+        std::vector<int> indices;
+        std::vector<float> dist2;
+        for (std::size_t batch = b; batch < e; batch += batchSize) {
+          std::size_t batchEnd = std::min(e, batch + batchSize);
+          tree.knnBatch(int(batch), int(batchEnd), k, indices, dist2);
+          for (std::size_t i = batch; i < batchEnd; ++i)
+            estimate(i, &indices[(i - batch) * k]);
+        }
+      },
+      batchSize);
+}
@@ -0,0 +1,18 @@
+//
+//  Per-point surface normals and curvature from k-nearest-neighbour PCA
+//
+#pragma once
+
+#include "KdTree.h"
+
+#include <QVector3D>
+
+// For every point of the cloud, computes the covariance of its k nearest
+// neighbours (the point itself included) as PointCloud::computePCA does and
+// takes the eigenvector of the smallest eigenvalue as the normal, flipped to
+// face the viewpoint. The curvature is l0 / (l0 + l1 + l2) of the ascending
+// eigenvalues, 0 on a plane and 1/3 for isotropic noise.
+// The results are written to the attributes "nx", "ny", "nz" and "curvature".
+// tree must index cloud, i.e. tree.cloud() is cloud.
+void estimateNormals(PointCloud &cloud, const KdTree &tree, int k,
+                     const QVector3D &viewpoint);
@@ -1,22 +1,7 @@
 #include "OctTree.h"
 #include <algorithm>
 #include <limits>
-
-static void cubeEdges(const QVector3D &a, const QVector3D &b,
-                      const std::function<void(QVector3D, QVector3D)> &L) {
-  L({a.x(), a.y(), a.z()}, {b.x(), a.y(), a.z()});
-  L({a.x(), a.y(), a.z()}, {a.x(), b.y(), a.z()});
-  L({a.x(), a.y(), a.z()}, {a.x(), a.y(), b.z()});
-  L({b.x(), b.y(), b.z()}, {a.x(), b.y(), b.z()});
-  L({b.x(), b.y(), b.z()}, {b.x(), a.y(), b.z()});
-  L({b.x(), b.y(), b.z()}, {b.x(), b.y(), a.z()});
-  L({a.x(), b.y(), a.z()}, {b.x(), b.y(), a.z()});
-  L({a.x(), b.y(), a.z()}, {a.x(), b.y(), b.z()});
-  L({a.x(), a.y(), b.z()}, {b.x(), a.y(), b.z()});
-  L({a.x(), a.y(), b.z()}, {a.x(), b.y(), b.z()});
-  L({b.x(), a.y(), a.z()}, {b.x(), a.y(), b.z()});
-  L({b.x(), a.y(), a.z()}, {b.x(), b.y(), a.z()});
-}
+#include <numeric>
 
 OctTree::OctTree(PointCloud &cloud, int maxDepth, int minPoints,
                  int visualDepth)
@@ -42,7 +27,11 @@ OctTree::OctTree(PointCloud &cloud, int maxDepth, int minPoints,
   QVector3D center = 0.5f * (mn + mx);
   QVector3D half = QVector3D(side, side, side) * 0.5f;
 
-  m_root = build(0, cloud.size(), 0, center - half, center + half);
+  // build on a permutation, then sort points and attributes by the leaves
+  std::vector<int> order(cloud.size());
+  std::iota(order.begin(), order.end(), 0);
+  m_root = build(order, 0, cloud.size(), 0, center - half, center + half);
+  m_cloud.reorder(order);
 }
 
 OctTree::~OctTree() {
@@ -56,31 +45,35 @@ OctTree::~OctTree() {
   freeNode(m_root);
 }
 
-OctTree::Node *OctTree::build(int begin, int end, int depth,
-                              const QVector3D &min, const QVector3D &max) {
+OctTree::Node *OctTree::build(std::vector<int> &order, int begin, int end,
+                              int depth, const QVector3D &min,
+                              const QVector3D &max) {
   Node *n = new Node{min, max, begin, end, {nullptr}, depth};
 
   if (depth >= m_maxDepth || end - begin <= m_minPoints)
     return n;
 
   QVector3D center = 0.5f * (min + max);
-  int mid[8] = {begin};
-  /* partition points into 8 octants in-place */
+  /* partition points into 8 octants in-place: split by z, then y, then x */
   auto octantIdx = [&](const QVector4D &p) -> int {
     return (p.x() >= center.x()) * 1 + (p.y() >= center.y()) * 2 +
            (p.z() >= center.z()) * 4;
   };
-  int head[8];
-  for (int i = 0; i < 8; ++i)
-    head[i] = begin;
-  for (int i = begin; i < end; ++i) {
-    int idx = octantIdx(m_cloud[i]);
-    std::swap(m_cloud[head[idx]], m_cloud[i]);
-    ++head[idx];
-  }
+  auto split = [&](int b, int e, int bit) {
+    return int(std::partition(order.begin() + b, order.begin() + e,
+                              [&](int i) {
+                                return !(octantIdx(m_cloud[i]) & bit);
+                              }) -
+               order.begin());
+  };
+  int mid[9];
   mid[0] = begin;
-  for (int i = 1; i < 8; ++i)
-    mid[i] = head[i - 1];
+  mid[8] = end;
+  mid[4] = split(begin, end, 4);
+  mid[2] = split(mid[0], mid[4], 2);
+  mid[6] = split(mid[4], mid[8], 2);
+  for (int i = 1; i < 8; i += 2)
+    mid[i] = split(mid[i - 1], mid[i + 1], 1);
 
   QVector3D half = 0.5f * (max - min);
   auto subMin = [&](int i) {
@@ -96,29 +89,52 @@ OctTree::Node *OctTree::build(int begin, int end, int depth,
 
   for (int i = 0; i < 8; ++i) {
     int b = mid[i];
-    int e = (i == 7) ? end : mid[i + 1];
+    int e = mid[i + 1];
     if (b == e)
       continue;
-    n->child[i] = build(b, e, depth + 1, subMin(i), subMax(i));
+    n->child[i] = build(order, b, e, depth + 1, subMin(i), subMax(i));
   }
   return n;
 }
 
 void OctTree::draw(const RenderCamera &renderer, const QColor &colour,
                    float lineWidth) const {
-  drawNode(m_root, renderer, m_visualDepth, colour, lineWidth);
+  m_wireframe.draw(renderer, m_root, m_visualDepth, colour, lineWidth,
+                   [](const Node *n, auto &&f) {
+                     for (const Node *c : n->child)
+                       f(c);
+                   });
 }
 
-void OctTree::drawNode(const Node *n, const RenderCamera &renderer,
-                       int maxVisDepth, const QColor &colour,
-                       float lineWidth) const {
-  if (!n || n->depth > maxVisDepth)
-    return;
+RayHit OctTree::raycast(const Ray &ray, float radius, float coneSlope) const {
+  RayHit hit;
+  raycastNode(m_root, ray, radius, coneSlope, hit);
+  return hit;
+}
 
-  cubeEdges(n->min, n->max, [&](QVector3D p1, QVector3D p2) {
-    renderer.renderLine(p1.toVector4D(), p2.toVector4D(), colour, lineWidth);
-  });
+void OctTree::raycastNode(const Node *n, const Ray &ray, float radius,
+                          float coneSlope, RayHit &hit) const {
+  float tEnter, tExit;
+  if (!n ||
+      !raySlab(ray, n->min, n->max,
+               rayBoxMargin(ray, n->min, n->max, radius, coneSlope), tEnter,
+               tExit) ||
+      tEnter >= hit.t)
+    return;
 
+  bool leaf = true;
   for (auto *c : n->child)
-    drawNode(c, renderer, maxVisDepth, colour, lineWidth);
+    leaf = leaf && !c;
+  if (leaf) {
+    for (int i = n->begin; i < n->end; ++i)
+      rayTestPoint(ray, QVector3D(m_cloud[i]), i, radius, coneSlope, hit);
+    return;
+  }
+
+  // front-to-back: flipping the octant bits along negative ray directions
+  // yields an order in which no child is visited after one it occludes
+  int flip = (ray.direction.x() < 0.0f) * 1 + (ray.direction.y() < 0.0f) * 2 +
+             (ray.direction.z() < 0.0f) * 4;
+  for (int i = 0; i < 8; ++i)
+    raycastNode(n->child[i ^ flip], ray, radius, coneSlope, hit);
 }
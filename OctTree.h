@@ -1,5 +1,7 @@
 #pragma once
+#include "LineBatch.h"
 #include "PointCloud.h"
+#include "Ray.h"
 #include "SceneObject.h"
 
 class OctTree : public SceneObject {
@@ -24,15 +26,22 @@ public:
   void setVisualDepth(int d) { m_visualDepth = std::max(1, d); }
   int visualDepth() const { return m_visualDepth; }
 
+  const PointCloud &cloud() const { return m_cloud; }
+
+  // Nearest point (smallest ray parameter) inside the tube of the given
+  // radius around the ray, widening by coneSlope per unit distance.
+  RayHit raycast(const Ray &ray, float radius, float coneSlope = 0.0f) const;
+
 private:
   PointCloud &m_cloud;
   Node *m_root = nullptr;
   int m_maxDepth;
   int m_minPoints;
   int m_visualDepth;
+  mutable TreeWireframe<Node> m_wireframe;
 
-  Node *build(int begin, int end, int depth, const QVector3D &min,
-              const QVector3D &max);
-  void drawNode(const Node *n, const RenderCamera &renderer, int maxVisDepth,
-                const QColor &colour, float lineWidth) const;
+  Node *build(std::vector<int> &order, int begin, int end, int depth,
+              const QVector3D &min, const QVector3D &max);
+  void raycastNode(const Node *n, const Ray &ray, float radius,
+                   float coneSlope, RayHit &hit) const;
 };
@@ -0,0 +1,89 @@
+#include "OutlierRemoval.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+std::vector<std::uint8_t> statisticalOutlierMask(const KdTree &tree, int k,
+                                                 float stddevMultiplier,
+                                                 OutlierStatistics *stats) {
+  if (k < 1)
+    throw std::runtime_error("outlier removal needs k >= 1");
+  const std::size_t n = tree.cloud().size();
+
+  // mean distance to the k neighbours; the query point is in its own row at
+  // distance 0, so k + 1 are fetched and all of them summed
+  std::vector<float> meanDist(n);
+  const unsigned chunks = parallelChunkCount(n, 256);
+  std::vector<double> chunkSum(chunks, 0.0), chunkSum2(chunks, 0.0);
+  const std::size_t batchSize = 256;
+  const int row = k + 1;
+  parallelChunks(
+      n,
+      [&](std::size_t b, std::size_t e, unsigned c) {
+        std::vector<int> indices;
+        std::vector<float> dist2;
+        double sum = 0.0, sum2 = 0.0;
+        for (std::size_t batch = b; batch < e; batch += batchSize) {
+          std::size_t batchEnd = std::min(e, batch + batchSize);
+          tree.knnBatch(int(batch), int(batchEnd), row, indices, dist2);
+          for (std::size_t i = batch; i < batchEnd; ++i) {
+            const std::size_t offset = (i - batch) * row;
+            float d = 0.0f;
+            int m = 0;
+            for (int j = 0; j < row && indices[offset + j] >= 0; ++j, ++m)
+              d += std::sqrt(dist2[offset + j]);
+            d = m > 1 ? d / float(m - 1) : 0.0f;
+            meanDist[i] = d;
+            sum += d;
+            sum2 += double(d) * d;
+          }
+        }
+        chunkSum[c] = sum;
+        chunkSum2[c] = sum2;
+      },
+      batchSize);
+
+  double sum = 0.0, sum2 = 0.0;
+  for (unsigned c = 0; c < chunks; ++c) {
+    sum += chunkSum[c];
+    sum2 += chunkSum2[c];
+  }
+  const double mean = n ? sum / n : 0.0;
+  const double variance = n > 1 ? (sum2 - sum * mean) / (n - 1) : 0.0;
+  const double stddev = std::sqrt(std::max(variance, 0.0));
+  const double threshold = mean + stddevMultiplier * stddev;
+
+  std::vector<std::uint8_t> mask(n);
+  std::vector<std::size_t> chunkInliers(parallelChunkCount(n), 0);
+  parallelChunks(n, [&](std::size_t b, std::size_t e, unsigned c) {
+    std::size_t inliers = 0;
+    for (std::size_t i = b; i < e; ++i)
+      inliers += mask[i] = meanDist[i] <= threshold;
+    chunkInliers[c] = inliers;
+  });
+
+  if (stats) {
+    stats->mean = mean;
+    stats->stddev = stddev;
+    stats->threshold = threshold;
+    stats->inliers = 0;
+    for (std::size_t inliers : chunkInliers)
+      stats->inliers += inliers;
+  }
+  return mask;
+}
+
+PointCloud statisticalOutlierRemoval(const KdTree &tree, int k,
+                                     float stddevMultiplier,
+                                     OutlierStatistics *stats) {
+  std::vector<std::uint8_t> mask =
+      statisticalOutlierMask(tree, k, stddevMultiplier, stats);
+  std::vector<int> inliers;
+  inliers.reserve(mask.size());
+  for (std::size_t i = 0; i < mask.size(); ++i)
+    if (mask[i])
+      inliers.push_back(int(i));
+  return tree.cloud().select(inliers);
+}
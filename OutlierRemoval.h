@@ -0,0 +1,30 @@
+//
+//  Statistical outlier removal: points whose mean distance to their k nearest
+//  neighbours is far above the cloud's average are treated as noise
+//
+#pragma once
+
+#include "KdTree.h"
+
+#include <cstdint>
+#include <vector>
+
+struct OutlierStatistics {
+  double mean = 0.0;   // of the per-point mean kNN distances
+  double stddev = 0.0; // ... and their standard deviation
+  double threshold = 0.0;
+  std::size_t inliers = 0;
+};
+
+// Inlier mask (1 = keep) in the order of tree.cloud(). A point is an outlier
+// if its mean distance to its k nearest neighbours exceeds
+// mean + stddevMultiplier * stddev over all points. The neighbourhoods come
+// from batched kNN queries run in parallel over the tree-ordered cloud.
+std::vector<std::uint8_t>
+statisticalOutlierMask(const KdTree &tree, int k, float stddevMultiplier,
+                       OutlierStatistics *statistics = nullptr);
+
+// the inliers of tree.cloud() as a new cloud, attributes included
+PointCloud statisticalOutlierRemoval(const KdTree &tree, int k,
+                                     float stddevMultiplier,
+                                     OutlierStatistics *statistics = nullptr);
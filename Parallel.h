@@ -0,0 +1,50 @@
+//
+//  Minimal fork/join helpers for the data-parallel point cloud algorithms
+//
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// number of threads the helpers below fan out to
+inline unsigned parallelThreadCount() {
+  static const unsigned n = std::max(1u, std::thread::hardware_concurrency());
+  return n;
+}
+
+// number of chunks parallelChunks() splits n items into
+inline unsigned parallelChunkCount(std::size_t n, std::size_t minChunk = 4096) {
+  std::size_t chunks = (n + minChunk - 1) / std::max<std::size_t>(1, minChunk);
+  return unsigned(std::clamp<std::size_t>(chunks, 1, parallelThreadCount()));
+}
+
+// splits [0,n) into contiguous chunks and calls f(begin, end, chunk) for each
+// of them concurrently; chunk 0 runs on the calling thread
+template <typename F>
+void parallelChunks(std::size_t n, F &&f, std::size_t minChunk = 4096) {
+  const unsigned chunks = parallelChunkCount(n, minChunk);
+  const std::size_t step = (n + chunks - 1) / chunks;
+  std::vector<std::thread> workers;
+  workers.reserve(chunks - 1);
+  for (unsigned c = 1; c < chunks; ++c) {
+    std::size_t b = std::min(n, c * step), e = std::min(n, b + step);
+    workers.emplace_back([&f, b, e, c] { f(b, e, c); });
+  }
+  f(std::size_t(0), std::min(n, step), 0u);
+  for (auto &w : workers)
+    w.join();
+}
+
+// calls f(i) for every i in [0,n), distributed over parallelChunks()
+template <typename F>
+void parallelFor(std::size_t n, F &&f, std::size_t minChunk = 4096) {
+  parallelChunks(
+      n,
+      [&f](std::size_t b, std::size_t e, unsigned) {
+        for (std::size_t i = b; i < e; ++i)
+          f(i);
+      },
+      minChunk);
+}
@@ -1,7 +1,10 @@
 #include "PerspectiveCamera.h"
+#include "Parallel.h"
 #include "math.h"
 #include "qcolor.h"
 
+#include <limits>
+
 PerspectiveCamera::PerspectiveCamera(const QVector4D &center,
                                      const QMatrix4x4 &pose,
                                      float imagePlaneSize,
@@ -40,44 +43,83 @@ void PerspectiveCamera::calculateTransformationMatrix() {
   translation.setToIdentity();
   translation.translate(center.x(), center.y(), center.z());
   transformationMatrix = translation * pose;
+  frustumLines.clear();
+  axisLines.clear();
 }
 
 void PerspectiveCamera::rotate() {}
 
 void PerspectiveCamera::affineMap(const QMatrix4x4 &matrix) {}
 
-void PerspectiveCamera::drawHexahedron(PerspectiveCamera &camera,
+void PerspectiveCamera::drawHexahedron(const PerspectiveCamera &camera,
                                        const RenderCamera &renderer,
                                        const Hexahedron &hexahedron,
                                        const QColor &color, float lineWidth) {
+  std::vector<QVector4D> corners(hexahedron.size());
+  for (std::size_t i = 0; i < corners.size(); ++i)
+    corners[i] = QVector4D(hexahedron[i], 1.0f);
+  std::vector<QVector2D> image(corners.size());
+  camera.project(corners.data(), corners.size(), image.data());
+  camera.drawImageHexahedron(renderer, image.data(), color, lineWidth);
+}
+
+void PerspectiveCamera::drawImageHexahedron(const RenderCamera &renderer,
+                                            const QVector2D *corners,
+                                            const QColor &color,
+                                            float lineWidth) const {
   Hexahedron hex;
-  int i = 0;
-  for (const auto &point : hexahedron) {
-    float dx = point.x() - camera.center.x();
-    float dy = point.y() - camera.center.y();
-    float dz = point.z() - camera.center.z();
-
-    float numeratorX = camera.pose(0, 0) * dx + camera.pose(1, 0) * dy +
-                       camera.pose(2, 0) * dz;
-    float denominator = camera.pose(0, 2) * dx + camera.pose(1, 2) * dy +
-                        camera.pose(2, 2) * dz;
-    float numeratorY = camera.pose(0, 1) * dx + camera.pose(1, 1) * dy +
-                       camera.pose(2, 1) * dz;
-
-    float x_p = camera.imagePrincipalPoint.x() +
-                camera.imagePlaneDistance * numeratorX / denominator;
-    float y_p = camera.imagePrincipalPoint.y() +
-                camera.imagePlaneDistance * numeratorY / denominator;
-
-    QVector3D projected =
-        QVector3D(camera.center) + x_p * QVector3D(camera.pose.column(0)) +
-        y_p * QVector3D(camera.pose.column(1)) +
-        camera.imagePlaneDistance * QVector3D(camera.pose.column(2));
-    hex[i] = projected;
-    i++;
-  }
+  for (std::size_t i = 0; i < hex.size(); ++i)
+    hex[i] = imagePlanePoint(corners[i]);
   hex.draw(renderer, color, lineWidth);
-  camera.planarHex.push_back(hex);
+}
+
+void PerspectiveCamera::project(const QVector4D *points, std::size_t n,
+                                QVector2D *image) const {
+  const float cx = center.x(), cy = center.y(), cz = center.z();
+  const float f = imagePlaneDistance;
+  const float px = imagePrincipalPoint.x(), py = imagePrincipalPoint.y();
+  float R[3][3]; // rows: the camera axes in world coordinates
+  for (int r = 0; r < 3; ++r)
+    for (int c = 0; c < 3; ++c)
+      R[r][c] = pose(c, r);
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  const bool distorted = !distortion.isZero();
+
+  // fixed-size blocks of structure-of-arrays temporaries, so that the
+  // compiler can keep the arithmetic in vector registers
+  constexpr std::size_t BLOCK = 16;
+  parallelChunks(n, [&](std::size_t b, std::size_t e, unsigned) {
+    for (std::size_t i0 = b; i0 < e; i0 += BLOCK) {
+      const std::size_t m = std::min(BLOCK, e - i0);
+      float dx[BLOCK] = {}, dy[BLOCK] = {}, dz[BLOCK] = {};
+      float u[BLOCK], v[BLOCK];
+      for (std::size_t k = 0; k < m; ++k) {
+        dx[k] = points[i0 + k].x() - cx;
+        dy[k] = points[i0 + k].y() - cy;
+        dz[k] = points[i0 + k].z() - cz;
+      }
+      for (std::size_t k = 0; k < BLOCK; ++k) {
+        float x = R[0][0] * dx[k] + R[0][1] * dy[k] + R[0][2] * dz[k];
+        float y = R[1][0] * dx[k] + R[1][1] * dy[k] + R[1][2] * dz[k];
+        float z = R[2][0] * dx[k] + R[2][1] * dy[k] + R[2][2] * dz[k];
+        float s = z > 0.0f ? 1.0f / z : nan;
+        u[k] = s * x; // normalised coordinates
+        v[k] = s * y;
+      }
+      if (distorted)
+        for (std::size_t k = 0; k < BLOCK; ++k) {
+          QVector2D d = distortion.distort(QVector2D(u[k], v[k]));
+          u[k] = d.x();
+          v[k] = d.y();
+        }
+      for (std::size_t k = 0; k < m; ++k)
+        image[i0 + k] = QVector2D(px + f * u[k], py + f * v[k]);
+    }
+  });
+}
+
+QVector3D PerspectiveCamera::imagePlanePoint(const QVector2D &p) const {
+  return toWorld(QVector3D(p, imagePlaneDistance));
 }
 
 void PerspectiveCamera::draw(const RenderCamera &renderer, const QColor &color,
@@ -95,24 +137,62 @@ void PerspectiveCamera::draw(const RenderCamera &renderer, const QColor &color,
                 imagePlaneSize * QVector3D(pose.column(1)) +
                 imagePlaneDistance * QVector3D(pose.column(2));
 
-  renderer.renderLine(center, a.toVector4D(), QColorConstants::White, 1.0f);
-  renderer.renderLine(center, b.toVector4D(), QColorConstants::White, 1.0f);
-  renderer.renderLine(center, c.toVector4D(), QColorConstants::White, 1.0f);
-  renderer.renderLine(center, d.toVector4D(), QColorConstants::White, 1.0f);
+  if (frustumLines.empty()) {
+    const QVector3D eye(center);
+    for (const QVector3D &corner : {a, b, c, d})
+      frustumLines.addLine(eye, corner, QColorConstants::White);
+
+    QVector3D ipp3d = eye + imagePlaneDistance * QVector3D(pose.column(2));
+    axisLines.addLine(ipp3d, ipp3d + 0.5f * QVector3D(pose.column(0)),
+                      QColorConstants::Red);
+    axisLines.addLine(ipp3d, ipp3d + 0.5f * QVector3D(pose.column(1)),
+                      QColorConstants::Blue);
+    axisLines.addLine(eye, eye + QVector3D(pose.column(2)),
+                      QColorConstants::White);
+  }
+  frustumLines.draw(renderer, 1.0f);
 
   renderer.renderPlane(a, b, c, d, QColor(0, 0, 0), 0.6f);
   renderer.renderPoint(center, color, 30.0f);
 
-  QVector3D ipp3d =
-      QVector3D(center) + imagePlaneDistance * QVector3D(pose.column(2));
-
-  renderer.renderLine(ipp3d, (ipp3d + 0.5f * QVector3D(pose.column(0))),
-                      QColorConstants::Red, 4.0f);
-  renderer.renderLine(ipp3d, (ipp3d + 0.5f * QVector3D(pose.column(1))),
-                      QColorConstants::Blue, 4.0f);
-  renderer.renderLine(center.toVector3D(),
-                      (QVector3D(center) + QVector3D(pose.column(2))),
-                      QColorConstants::White, 4.0f);
+  axisLines.draw(renderer, 4.0f);
 }
 
 QMatrix4x4 PerspectiveCamera::getPose() { return pose; }
+
+QVector3D PerspectiveCamera::toCamera(const QVector3D &world) const {
+  QVector3D d = world - QVector3D(center);
+  return QVector3D(QVector3D::dotProduct(d, QVector3D(pose.column(0))),
+                   QVector3D::dotProduct(d, QVector3D(pose.column(1))),
+                   QVector3D::dotProduct(d, QVector3D(pose.column(2))));
+}
+
+QVector3D PerspectiveCamera::toWorld(const QVector3D &camera) const {
+  return QVector3D(center) + camera.x() * QVector3D(pose.column(0)) +
+         camera.y() * QVector3D(pose.column(1)) +
+         camera.z() * QVector3D(pose.column(2));
+}
+
+QVector2D PerspectiveCamera::toPixel(const QVector3D &camera, int width,
+                                     int height) const {
+  QVector2D n = distortion.distort(
+      QVector2D(camera.x() / camera.z(), camera.y() / camera.z()));
+  float x = imagePrincipalPoint.x() + imagePlaneDistance * n.x();
+  float y = imagePrincipalPoint.y() + imagePlaneDistance * n.y();
+  return QVector2D((x + imagePlaneSize) / (2.0f * imagePlaneSize) * width -
+                       0.5f,
+                   (imagePlaneSize - y) / (2.0f * imagePlaneSize) * height -
+                       0.5f);
+}
+
+QVector3D PerspectiveCamera::fromPixel(float u, float v, float depth,
+                                       int width, int height,
+                                       bool distorted) const {
+  float x = (u + 0.5f) / width * 2.0f * imagePlaneSize - imagePlaneSize;
+  float y = imagePlaneSize - (v + 0.5f) / height * 2.0f * imagePlaneSize;
+  QVector2D n((x - imagePrincipalPoint.x()) / imagePlaneDistance,
+              (y - imagePrincipalPoint.y()) / imagePlaneDistance);
+  if (distorted)
+    n = distortion.undistort(n);
+  return QVector3D(n.x() * depth, n.y() * depth, depth);
+}
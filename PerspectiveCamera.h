@@ -1,14 +1,16 @@
 #pragma once
 
 #include "Hexahedron.h"
+#include "LensDistortion.h"
+#include "LineBatch.h"
 #include "SceneObject.h"
 #include <QMatrix4x4>
 #include <QVector2D>
 #include <QVector3D>
+#include <cstddef>
 
 class PerspectiveCamera : public SceneObject, public QObject {
 public:
-  std::vector<Hexahedron> planarHex;
   PerspectiveCamera(const QVector4D &center, const QMatrix4x4 &pose,
                     float imagePlaneSize, float imagePlaneDistance,
                     const QVector2D &imagePrincipalPoint = QVector2D(0, 0));
@@ -18,22 +20,47 @@ public:
                     const QVector2D &imagePrincipalPoint = QVector2D(0, 0));
 
   void updateCamera();
-  static void drawHexahedron(PerspectiveCamera &camera,
+  static void drawHexahedron(const PerspectiveCamera &camera,
                              const RenderCamera &renderer,
                              const Hexahedron &hexahedron, const QColor &color,
                              float lineWidth);
+  // draws the hexahedron with the given image plane corners (see project)
+  void drawImageHexahedron(const RenderCamera &renderer,
+                           const QVector2D *corners, const QColor &color,
+                           float lineWidth) const;
   void affineMap(const QMatrix4x4 &matrix) override;
   void draw(const RenderCamera &renderer, const QColor &color = COLOR_CAMERA,
             float lineWidth = 3.0f) const override;
   QMatrix4x4 getPose();
+
+  // camera coordinates: x, y along the image axes (pose columns 0, 1), z the
+  // depth along the viewing direction (pose column 2)
+  QVector3D toCamera(const QVector3D &world) const;
+  QVector3D toWorld(const QVector3D &camera) const;
+  // Pixel coordinates in a width x height image covering the image plane
+  // [-imagePlaneSize, imagePlaneSize]^2, row 0 at the top, integer values at
+  // pixel centres, distortion applied; fromPixel is the inverse for a given
+  // depth, of a pixel in the distorted image or else in the pinhole one.
+  QVector2D toPixel(const QVector3D &camera, int width, int height) const;
+  QVector3D fromPixel(float u, float v, float depth, int width, int height,
+                      bool distorted = true) const;
+  // Central projection of n world points to image plane coordinates, the
+  // principal point and distortion included; points not in front of the
+  // camera map to NaN.
+  void project(const QVector4D *points, std::size_t n, QVector2D *image) const;
+  // the world position of image plane coordinates p
+  QVector3D imagePlanePoint(const QVector2D &p) const;
   QVector4D center;
   QMatrix4x4 pose;
   QVector2D imagePrincipalPoint;
   float imagePlaneSize;
   float imagePlaneDistance;
+  LensDistortion distortion; // none by default
 
 private:
   QMatrix4x4 transformationMatrix;
+  // the frustum (thin) and the axes (thick) as drawn, cleared by updateCamera
+  mutable LineBatch frustumLines, axisLines;
 
   void calculateTransformationMatrix();
   void rotate();
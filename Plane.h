@@ -20,4 +20,7 @@ public:
                     float transparency = 0.2f) const override;
 
   Plane &operator=(const Plane &p);
+
+  QVector4D getOrigin() const { return origin; }
+  QVector4D getNormal() const { return normal; }
 };
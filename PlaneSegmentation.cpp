@@ -0,0 +1,209 @@
+#include "PlaneSegmentation.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+
+namespace {
+
+struct Hypothesis {
+  float a, b, c, d; // a x + b y + c z + d = 0, (a, b, c) unit
+  int score = 0;
+};
+
+// number of points within t of the plane; branch-free over the coordinate
+// arrays so that the compiler vectorises it
+int countInliers(const float *x, const float *y, const float *z,
+                 std::size_t n, const Hypothesis &h, float t) {
+  int count = 0;
+  for (std::size_t i = 0; i < n; ++i)
+    count += std::fabs(h.a * x[i] + h.b * y[i] + h.c * z[i] + h.d) <= t;
+  return count;
+}
+
+// inliers of the remaining points and their moments, per chunk
+struct PlaneFit {
+  std::size_t count = 0;
+  double sumDist2 = 0.0;
+  Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+  Eigen::Matrix3d sumOuter = Eigen::Matrix3d::Zero();
+
+  void merge(const PlaneFit &f) {
+    count += f.count;
+    sumDist2 += f.sumDist2;
+    sum += f.sum;
+    sumOuter += f.sumOuter;
+  }
+};
+
+} // namespace
+
+std::vector<PlaneSegment>
+segmentPlanes(const PointCloud &cloud,
+              const PlaneSegmentationParameters &parameters) {
+  const float t = parameters.distanceThreshold;
+  const int B = std::max(parameters.preemptionBlock, 1);
+  std::mt19937 rng(parameters.seed);
+
+  // the remaining points as coordinate arrays, flattest first if the
+  // curvature is known, and their indices in the cloud
+  std::vector<int> index(cloud.size());
+  std::iota(index.begin(), index.end(), 0);
+  const std::vector<float> *curvature = cloud.findAttribute("curvature");
+  if (curvature)
+    std::stable_sort(index.begin(), index.end(), [&](int i, int j) {
+      return (*curvature)[i] < (*curvature)[j];
+    });
+  std::vector<float> xs(index.size()), ys(index.size()), zs(index.size());
+  const QVector4D *pts = cloud.constData();
+  parallelFor(index.size(), [&](std::size_t i) {
+    xs[i] = pts[index[i]].x();
+    ys[i] = pts[index[i]].y();
+    zs[i] = pts[index[i]].z();
+  });
+
+  std::vector<PlaneSegment> segments;
+  std::vector<std::uint8_t> inlier;
+  while (int(segments.size()) < parameters.maxPlanes) {
+    const std::size_t m = index.size();
+    if (m < std::size_t(std::max(3, parameters.minInliers)))
+      break;
+
+    // hypotheses from random triples; with curvature the pool of the
+    // flattest points grows from a small prefix to all points (PROSAC)
+    const int H = std::max(parameters.hypotheses, 1);
+    std::vector<Hypothesis> hypotheses;
+    hypotheses.reserve(H);
+    for (int attempt = 0; int(hypotheses.size()) < H && attempt < 10 * H;
+         ++attempt) {
+      std::size_t pool = m;
+      if (curvature)
+        pool = std::max(std::min<std::size_t>(m, 1000),
+                        m * (hypotheses.size() + 1) / H);
+      std::uniform_int_distribution<std::size_t> pick(0, pool - 1);
+      std::size_t i = pick(rng), j = pick(rng), k = pick(rng);
+      if (i == j || j == k || i == k)
+        continue;
+      Eigen::Vector3f p(xs[i], ys[i], zs[i]);
+      Eigen::Vector3f n = (Eigen::Vector3f(xs[j], ys[j], zs[j]) - p)
+                              .cross(Eigen::Vector3f(xs[k], ys[k], zs[k]) - p);
+      float length = n.norm();
+      if (!(length > 1e-12f))
+        continue; // collinear
+      n /= length;
+      hypotheses.push_back({n.x(), n.y(), n.z(), -n.dot(p)});
+    }
+    if (hypotheses.empty())
+      break;
+
+    // preemptive scoring: every round scores the survivors on the next
+    // block of random points and keeps the better half
+    int rounds = 1;
+    while ((std::size_t(1) << (rounds - 1)) < hypotheses.size())
+      ++rounds;
+    const std::size_t samples = std::size_t(rounds) * B;
+    std::vector<float> sx(samples), sy(samples), sz(samples);
+    std::uniform_int_distribution<std::size_t> pickPoint(0, m - 1);
+    for (std::size_t s = 0; s < samples; ++s) {
+      std::size_t i = pickPoint(rng);
+      sx[s] = xs[i];
+      sy[s] = ys[i];
+      sz[s] = zs[i];
+    }
+    for (int round = 0; hypotheses.size() > 1; ++round) {
+      const std::size_t offset = std::size_t(round) * B;
+      parallelFor(
+          hypotheses.size(),
+          [&](std::size_t h) {
+            hypotheses[h].score +=
+                countInliers(&sx[offset], &sy[offset], &sz[offset],
+                             std::size_t(B), hypotheses[h], t);
+          },
+          1);
+      std::stable_sort(hypotheses.begin(), hypotheses.end(),
+                       [](const Hypothesis &a, const Hypothesis &b) {
+                         return a.score > b.score;
+                       });
+      hypotheses.resize((hypotheses.size() + 1) / 2);
+    }
+    Hypothesis best = hypotheses[0];
+
+    // inliers of the winner on all remaining points, refit by least squares
+    inlier.resize(m);
+    PlaneFit fit;
+    Eigen::Vector3d centroid = Eigen::Vector3d::Zero();
+    for (int pass = 0; pass <= parameters.refinements; ++pass) {
+      std::vector<PlaneFit> partial(parallelChunkCount(m));
+      parallelChunks(m, [&](std::size_t b, std::size_t e, unsigned c) {
+        for (std::size_t i = b; i < e; ++i)
+          inlier[i] = std::fabs(best.a * xs[i] + best.b * ys[i] +
+                                best.c * zs[i] + best.d) <= t;
+        PlaneFit &f = partial[c];
+        for (std::size_t i = b; i < e; ++i) {
+          if (!inlier[i])
+            continue;
+          Eigen::Vector3d p(xs[i], ys[i], zs[i]);
+          double dist = best.a * p.x() + best.b * p.y() + best.c * p.z() +
+                        best.d;
+          ++f.count;
+          f.sumDist2 += dist * dist;
+          f.sum += p;
+          f.sumOuter += p * p.transpose();
+        }
+      });
+      fit = PlaneFit();
+      for (const PlaneFit &f : partial)
+        fit.merge(f);
+      if (fit.count < 3)
+        break;
+      centroid = fit.sum / double(fit.count);
+      if (pass == parameters.refinements)
+        break;
+      Eigen::Matrix3d C = fit.sumOuter / double(fit.count) -
+                          centroid * centroid.transpose();
+      Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> es;
+      es.computeDirect(C);
+      Eigen::Vector3d n = es.eigenvectors().col(0);
+      best.a = float(n.x());
+      best.b = float(n.y());
+      best.c = float(n.z());
+      best.d = float(-n.dot(centroid));
+    }
+    if (fit.count < std::size_t(std::max(parameters.minInliers, 3)))
+      break;
+
+    PlaneSegment segment;
+    segment.normal = Eigen::Vector3f(best.a, best.b, best.c);
+    segment.d = best.d;
+    segment.plane = Plane(
+        QVector4D(float(centroid.x()), float(centroid.y()),
+                  float(centroid.z()), 1.0f),
+        QVector4D(best.a, best.b, best.c, 0.0f));
+    segment.inliers = fit.count;
+    segment.rmse = float(std::sqrt(fit.sumDist2 / double(fit.count)));
+    segment.mask.assign(cloud.size(), 0);
+    for (std::size_t i = 0; i < m; ++i)
+      if (inlier[i])
+        segment.mask[index[i]] = 1;
+    segments.push_back(std::move(segment));
+
+    // peel the inliers off, keeping the order of the rest
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < m; ++i) {
+      if (inlier[i])
+        continue;
+      index[kept] = index[i];
+      xs[kept] = xs[i];
+      ys[kept] = ys[i];
+      zs[kept] = zs[i];
+      ++kept;
+    }
+    index.resize(kept);
+    xs.resize(kept);
+    ys.resize(kept);
+    zs.resize(kept);
+  }
+  return segments;
+}
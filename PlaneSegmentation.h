@@ -0,0 +1,42 @@
+//
+//  Multi-plane RANSAC segmentation: the dominant planes are found one after
+//  the other and their inliers peeled off the cloud
+//
+#pragma once
+
+#include "Plane.h"
+#include "PointCloud.h"
+
+#include <cstdint>
+#include <vector>
+
+struct PlaneSegmentationParameters {
+  int maxPlanes = 4;
+  float distanceThreshold = 0.01f; // inlier band, scene units
+  int minInliers = 1000;           // smaller planes end the segmentation
+  int hypotheses = 256;            // sampled per plane
+  int preemptionBlock = 500;       // points scored per preemption round
+  int refinements = 2;             // least-squares refits of the winner
+  unsigned seed = 1;
+};
+
+struct PlaneSegment {
+  Plane plane;                      // origin at the inlier centroid
+  Eigen::Vector3f normal;           // unit, n.p + d = 0 on the plane
+  float d = 0.0f;
+  std::vector<std::uint8_t> mask;   // inliers (1), in the order of the cloud
+  std::size_t inliers = 0;
+  float rmse = 0.0f;                // of the inlier distances
+};
+
+// Hypotheses from random point triples are scored preemptively (Nister):
+// all of them on a first block of random points, then the better half on
+// the next block and so on, so that only one survives to be scored on the
+// full cloud. If the cloud has a "curvature" attribute, the triples are
+// drawn PROSAC-style from a pool of flattest points that grows to the whole
+// cloud over the hypotheses. The winner is refit by least squares to its
+// inliers, which are then removed before the next plane is searched.
+std::vector<PlaneSegment>
+segmentPlanes(const PointCloud &cloud,
+              const PlaneSegmentationParameters &parameters =
+                  PlaneSegmentationParameters());
@@ -3,23 +3,71 @@
 //
 #include "PointCloud.h"
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <iostream>
 #include <math.h>
 #include <sstream>
 
 #include "GLConvenience.h"
+#include "Parallel.h"
 #include "QtConvenience.h"
 
 using namespace std;
 
-PointCloud::PointCloud() {
+// source of the revisions of all clouds, so that no two edits share one
+static atomic<uint64_t> revisionCounter{0};
+
+PointCloud::PointCloud()
+    : identity(++revisionCounter), changeRevision(++revisionCounter) {
   type = SceneObjectType::ST_POINT_CLOUD;
   pointSize = 3.0f;
 }
 
+PointCloud::PointCloud(const PointCloud &other)
+    : SceneObject(other), identity(++revisionCounter) {
+  *this = other;
+}
+
+PointCloud &PointCloud::operator=(const PointCloud &other) {
+  if (this == &other)
+    return *this;
+  QVector<QVector4D>::operator=(other);
+  type = other.type;
+  pointsBoundMin = other.pointsBoundMin;
+  pointsBoundMax = other.pointsBoundMax;
+  pointSize = other.pointSize;
+  attributes = other.attributes;
+  markDirty();
+
+  std::scoped_lock lock(pcaMutex, other.pcaMutex);
+  pcaValid = other.pcaValid;
+  pcaCentroid = other.pcaCentroid;
+  pcaEV = other.pcaEV;
+  pcaLambda = other.pcaLambda;
+  momentsValid = other.momentsValid;
+  momentMean = other.momentMean;
+  momentScatter = other.momentScatter;
+  return *this;
+}
+
 PointCloud::~PointCloud() {}
 
+void PointCloud::setPoint(qsizetype i, const QVector4D &p) {
+  Points::operator[](i) = p;
+  markDirty(size_t(i), size_t(i) + 1);
+  std::lock_guard<std::mutex> lock(pcaMutex);
+  pcaValid = false;
+  momentsValid = false;
+}
+
+void PointCloud::setPoints(const QVector<QVector4D> &points) {
+  Points::operator=(points);
+  attributes.clear();
+  invalidatePCA();
+}
+
 bool PointCloud::loadPLY(const QString &filePath) {
   // open stream
   fstream is;
@@ -56,7 +104,7 @@ bool PointCloud::loadPLY(const QString &filePath) {
 
     stringstream ss;
     string line;
-    QVector4D *p = this->data();
+    QVector4D *p = Points::data();
     for (size_t i = 0; is.good() && i < pointsCount; ++i) {
       getline(is, line);
       ss.str(line);
@@ -87,25 +135,148 @@ bool PointCloud::loadPLY(const QString &filePath) {
       s += a * a;
     }
     s = sqrt(s) / pointCloudScale;
-    for (auto &p : *this) {
+    for (auto &p : static_cast<Points &>(*this)) {
       p /= s;
       p[3] = 1.0;
     }
     //  for (int i=0; i < size(); i++) { (*this)[i]/=s; (*this)[i][3] = 1.0; }
   }
+  invalidatePCA();
   return true;
 }
 
+void PointCloud::computeBounds() {
+  boundingBox(pointsBoundMin, pointsBoundMax);
+}
+
+void PointCloud::boundingBox(QVector3D &mn, QVector3D &mx) const {
+  // reduced per chunk, then over the chunks
+  const unsigned chunks = parallelChunkCount(size_t(size()));
+  vector<QVector3D> chunkMin(chunks), chunkMax(chunks);
+  const QVector4D *pts = data();
+  parallelChunks(size_t(size()), [&](size_t b, size_t e, unsigned c) {
+    float m = float(INT_MAX);
+    QVector3D lo(m, m, m), hi(-m, -m, -m);
+    for (size_t i = b; i < e; ++i)
+      for (int k = 0; k < 3; k++) {
+        lo[k] = min(lo[k], pts[i][k]);
+        hi[k] = max(hi[k], pts[i][k]);
+      }
+    chunkMin[c] = lo;
+    chunkMax[c] = hi;
+  });
+  mn = chunkMin[0];
+  mx = chunkMax[0];
+  for (unsigned c = 1; c < chunks; ++c)
+    for (int k = 0; k < 3; k++) {
+      mn[k] = min(mn[k], chunkMin[c][k]);
+      mx[k] = max(mx[k], chunkMax[c][k]);
+    }
+}
+
 void PointCloud::setPointSize(unsigned _pointSize) { pointSize = _pointSize; }
 
 void PointCloud::affineMap(const QMatrix4x4 &M) {
-  for (auto &p : *this)
-    p = M.map(p);
+  QVector4D *pts = Points::data();
+  parallelFor(size_t(size()), [&](size_t i) { pts[i] = M.map(pts[i]); });
+  markDirty();
+
+  const bool projective = M(3, 0) != 0.0f || M(3, 1) != 0.0f ||
+                          M(3, 2) != 0.0f || M(3, 3) != 1.0f;
+  Eigen::Matrix3d A;
+  Eigen::Vector3d t;
+  for (int r = 0; r < 3; ++r) {
+    for (int c = 0; c < 3; ++c)
+      A(r, c) = M(r, c);
+    t[r] = M(r, 3);
+  }
+  mapNormals(projective ? Eigen::Matrix3d::Zero() : A);
+
+  // the moments follow an affine map exactly: m' = Am + t, S' = ASA^T
+  std::lock_guard<std::mutex> lock(pcaMutex);
+  pcaValid = false;
+  if (projective) {
+    momentsValid = false;
+    return;
+  }
+  if (!momentsValid)
+    return;
+  momentMean = A * momentMean + t;
+  momentScatter = A * momentScatter * A.transpose();
+}
+
+void PointCloud::mapNormals(const Eigen::Matrix3d &A) {
+  auto x = attributes.find("nx"), y = attributes.find("ny"),
+       z = attributes.find("nz");
+  if (x == attributes.end() || y == attributes.end() ||
+      z == attributes.end())
+    return;
+  // normals map with the inverse transpose; there is none for singular and
+  // projective maps, which therefore drop them, as do columns that do not
+  // match the points
+  const size_t count = size_t(size());
+  const double det = A.determinant();
+  if (det == 0.0 || !std::isfinite(det) || x->second.size() != count ||
+      y->second.size() != count || z->second.size() != count) {
+    attributes.erase(x);
+    attributes.erase(y);
+    attributes.erase(z);
+    return;
+  }
+  const Eigen::Matrix3f N = A.inverse().transpose().cast<float>();
+  float *nx = x->second.data(), *ny = y->second.data(), *nz = z->second.data();
+  parallelFor(count, [&](size_t i) {
+    Eigen::Vector3f n = N * Eigen::Vector3f(nx[i], ny[i], nz[i]);
+    const float length = n.norm();
+    if (length > 0.0f)
+      n /= length;
+    nx[i] = n.x();
+    ny[i] = n.y();
+    nz[i] = n.z();
+  });
 }
 
 void PointCloud::draw(const RenderCamera &camera, const QColor &color,
                       float) const {
-  camera.renderPCL((*this), color, pointSize);
+  camera.renderPointCloud(*this, color, pointSize);
+}
+
+void PointCloud::computeMoments(Eigen::Vector3d &mean,
+                                Eigen::Matrix3d &scatter) const {
+  // per-chunk two-pass moments, merged pairwise (Chan et al.)
+  const size_t n = size_t(size());
+  const unsigned chunks = parallelChunkCount(n);
+  vector<Eigen::Vector3d> chunkMean(chunks, Eigen::Vector3d::Zero());
+  vector<Eigen::Matrix3d> chunkScatter(chunks, Eigen::Matrix3d::Zero());
+  vector<size_t> chunkCount(chunks, 0);
+  const QVector4D *pts = data();
+  parallelChunks(n, [&](size_t b, size_t e, unsigned c) {
+    Eigen::Vector3d m = Eigen::Vector3d::Zero();
+    for (size_t i = b; i < e; ++i)
+      m += Eigen::Vector3d(pts[i].x(), pts[i].y(), pts[i].z());
+    m /= double(e - b);
+    Eigen::Matrix3d S = Eigen::Matrix3d::Zero();
+    for (size_t i = b; i < e; ++i) {
+      Eigen::Vector3d q(pts[i].x(), pts[i].y(), pts[i].z());
+      q -= m;
+      S += q * q.transpose();
+    }
+    chunkMean[c] = m;
+    chunkScatter[c] = S;
+    chunkCount[c] = e - b;
+  });
+  mean.setZero();
+  scatter.setZero();
+  double count = 0.0;
+  for (unsigned c = 0; c < chunks; ++c) {
+    if (!chunkCount[c])
+      continue;
+    double nc = double(chunkCount[c]), total = count + nc;
+    Eigen::Vector3d d = chunkMean[c] - mean;
+    mean += d * (nc / total);
+    scatter += chunkScatter[c] + d * d.transpose() * (count * nc / total);
+    count = total;
+  }
 }
 
 void PointCloud::computePCA(Eigen::Vector3f &c, Eigen::Matrix3f &R,
@@ -114,45 +285,223 @@ void PointCloud::computePCA(Eigen::Vector3f &c, Eigen::Matrix3f &R,
   if (n == 0)
     return;
 
-  c.setZero();
-  for (const auto &p : *this)
-    c += Eigen::Vector3f(p.x(), p.y(), p.z());
-  c /= float(n);
-
-  Eigen::Matrix3f C;
-  C.setZero();
-  for (const auto &p : *this) {
-    Eigen::Vector3f q(p.x(), p.y(), p.z());
-    q -= c;
-    C += q * q.transpose();
-  }
-  C /= float(n);
+  Eigen::Vector3d mean;
+  Eigen::Matrix3d scatter;
+  computeMoments(mean, scatter);
+  c = mean.cast<float>();
+  Eigen::Matrix3f C = (scatter / double(n)).cast<float>();
 
   Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> es(C);
   R = es.eigenvectors();
   L = es.eigenvalues();
 }
 
-const Eigen::Vector3f &PointCloud::centroid() const {
-  if (!pcaValid) {
-    computePCA(pcaCentroid, pcaEV, pcaLambda);
-    pcaValid = true;
+void PointCloud::updatePCA() const {
+  if (pcaValid || isEmpty())
+    return;
+  if (!momentsValid) {
+    computeMoments(momentMean, momentScatter);
+    momentsValid = true;
   }
+  pcaCentroid = momentMean.cast<float>();
+  Eigen::Matrix3f C = (momentScatter / double(size())).cast<float>();
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> es(C);
+  pcaEV = es.eigenvectors();
+  pcaLambda = es.eigenvalues();
+  pcaValid = true;
+}
+
+PointCloud::PCA PointCloud::pca() const {
+  std::lock_guard<std::mutex> lock(pcaMutex);
+  updatePCA();
+  return {pcaCentroid, pcaEV, pcaLambda};
+}
+Eigen::Vector3f PointCloud::centroid() const {
+  std::lock_guard<std::mutex> lock(pcaMutex);
+  updatePCA();
   return pcaCentroid;
 }
-const Eigen::Matrix3f &PointCloud::eigenVectors() const {
-  if (!pcaValid) {
-    Eigen::Vector3f dummy;
-    computePCA(pcaCentroid, pcaEV, pcaLambda);
-    pcaValid = true;
-  }
+Eigen::Matrix3f PointCloud::eigenVectors() const {
+  std::lock_guard<std::mutex> lock(pcaMutex);
+  updatePCA();
   return pcaEV;
 }
-const Eigen::Vector3f &PointCloud::eigenValues() const {
-  if (!pcaValid) {
-    Eigen::Matrix3f dummyR;
-    computePCA(pcaCentroid, pcaEV, pcaLambda);
-    pcaValid = true;
-  }
+Eigen::Vector3f PointCloud::eigenValues() const {
+  std::lock_guard<std::mutex> lock(pcaMutex);
+  updatePCA();
   return pcaLambda;
 }
+
+void PointCloud::invalidatePCA() {
+  markDirty();
+  std::lock_guard<std::mutex> lock(pcaMutex);
+  pcaValid = false;
+  momentsValid = false;
+}
+
+uint64_t PointCloud::revision() const {
+  std::lock_guard<std::mutex> lock(changeMutex);
+  return changeRevision;
+}
+
+void PointCloud::markDirty(size_t begin, size_t end) {
+  std::lock_guard<std::mutex> lock(changeMutex);
+  changes.push_back({changeRevision, begin, end});
+  if (changes.size() > maxChanges)
+    changes.pop_front();
+  changeRevision = ++revisionCounter;
+}
+
+bool PointCloud::changedSince(uint64_t revision, size_t &begin,
+                              size_t &end) const {
+  std::lock_guard<std::mutex> lock(changeMutex);
+  begin = SIZE_MAX;
+  end = 0;
+  if (revision == changeRevision)
+    return true;
+  auto first = find_if(changes.begin(), changes.end(),
+                       [&](const Change &c) { return c.before == revision; });
+  if (first == changes.end())
+    return false;
+  for (auto it = first; it != changes.end(); ++it) {
+    begin = min(begin, it->begin);
+    end = max(end, it->end);
+  }
+  end = min(end, size_t(size()));
+  return true;
+}
+
+shared_ptr<const PointCloud> PointCloud::snapshot() const {
+  auto copy = make_shared<PointCloud>();
+  copy->Points::operator=(*this);
+  copy->type = type;
+  copy->pointsBoundMin = pointsBoundMin;
+  copy->pointsBoundMax = pointsBoundMax;
+  copy->pointSize = pointSize;
+  copy->identity = identity;
+  std::lock_guard<std::mutex> lock(changeMutex);
+  copy->changeRevision = changeRevision;
+  copy->changes = changes;
+  return copy;
+}
+
+void PointCloud::append(const QVector4D &point) {
+  QVector<QVector4D>::append(point);
+  for (auto &column : attributes)
+    column.second.resize(size_t(size()), 0.0f);
+  markDirty(size_t(size()) - 1, size_t(size()));
+
+  // Welford update
+  std::lock_guard<std::mutex> lock(pcaMutex);
+  pcaValid = false;
+  if (!momentsValid)
+    return;
+  Eigen::Vector3d p(point.x(), point.y(), point.z());
+  Eigen::Vector3d d = p - momentMean;
+  momentMean += d / double(size());
+  momentScatter += d * (p - momentMean).transpose();
+}
+
+void PointCloud::append(const PointCloud &other) {
+  if (&other == this) {
+    append(PointCloud(other));
+    return;
+  }
+  const size_t n = size_t(size()), m = size_t(other.size());
+  if (n == 0)
+    attributes = other.attributes;
+  for (auto it = attributes.begin(); it != attributes.end();) {
+    const vector<float> *column = other.findAttribute(it->first);
+    if (n == 0) {
+      ++it;
+      continue;
+    }
+    if (it->second.size() != n || !column) {
+      it = attributes.erase(it);
+      continue;
+    }
+    it->second.insert(it->second.end(), column->begin(), column->end());
+    ++it;
+  }
+  QVector<QVector4D>::append(other);
+  if (m == 0)
+    return;
+  markDirty(n, n + m);
+
+  // merge of the two parts' moments (Chan et al.)
+  Eigen::Vector3d otherMean;
+  Eigen::Matrix3d otherScatter;
+  {
+    std::lock_guard<std::mutex> lock(other.pcaMutex);
+    if (!other.momentsValid) {
+      other.computeMoments(other.momentMean, other.momentScatter);
+      other.momentsValid = true;
+    }
+    otherMean = other.momentMean;
+    otherScatter = other.momentScatter;
+  }
+  std::lock_guard<std::mutex> lock(pcaMutex);
+  pcaValid = false;
+  if (n == 0) {
+    momentMean = otherMean;
+    momentScatter = otherScatter;
+    momentsValid = true;
+    return;
+  }
+  if (!momentsValid)
+    return;
+  double total = double(n + m);
+  Eigen::Vector3d d = otherMean - momentMean;
+  momentMean += d * (double(m) / total);
+  momentScatter += otherScatter + d * d.transpose() * (double(n) * m / total);
+}
+
+std::vector<float> &PointCloud::attribute(const std::string &name) {
+  std::vector<float> &column = attributes[name];
+  column.resize(size_t(size()), 0.0f);
+  return column;
+}
+
+const std::vector<float> *
+PointCloud::findAttribute(const std::string &name) const {
+  auto it = attributes.find(name);
+  if (it == attributes.end() || it->second.size() != size_t(size()))
+    return nullptr;
+  return &it->second;
+}
+
+void PointCloud::reorder(const std::vector<int> &order) {
+  QVector<QVector4D> points(size());
+  QVector4D *dst = points.data();
+  const QVector4D *src = constData();
+  parallelFor(order.size(), [&](size_t i) { dst[i] = src[order[i]]; });
+  QVector<QVector4D>::swap(points);
+  markDirty();
+  for (auto &[name, column] : attributes) {
+    if (column.size() != order.size())
+      continue;
+    vector<float> permuted(column.size());
+    parallelFor(order.size(),
+                [&](size_t i) { permuted[i] = column[order[i]]; });
+    column.swap(permuted);
+  }
+}
+
+PointCloud PointCloud::select(const std::vector<int> &indices) const {
+  PointCloud result;
+  result.pointSize = pointSize;
+  result.Points::resize(qsizetype(indices.size()));
+  QVector4D *dst = result.Points::data();
+  const QVector4D *src = constData();
+  parallelFor(indices.size(), [&](size_t i) { dst[i] = src[indices[i]]; });
+  for (const auto &[name, column] : attributes) {
+    if (column.size() != size_t(size()))
+      continue;
+    vector<float> &selected = result.attributes[name];
+    selected.resize(indices.size());
+    parallelFor(indices.size(),
+                [&](size_t i) { selected[i] = column[indices[i]]; });
+  }
+  result.computeBounds();
+  return result;
+}
@@ -6,9 +6,21 @@
 #include "RenderCamera.h"
 #include "SceneObject.h"
 #include <Eigen/Dense>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
-class PointCloud : public SceneObject, public QVector<QVector4D> {
+// The points are only readable from outside: every change goes through the
+// methods below, which keep the revision, the change log and the moments
+// current.
+class PointCloud : public SceneObject, private QVector<QVector4D> {
 private:
+  using Points = QVector<QVector4D>;
+
   QVector3D pointsBoundMin;
   QVector3D pointsBoundMax;
 
@@ -19,18 +31,69 @@ private:
   mutable Eigen::Matrix3f pcaEV;
   mutable Eigen::Vector3f pcaLambda;
 
+  // first and second moments (mean and scatter sum_i (p_i-m)(p_i-m)^T),
+  // carried through affineMap and append so that the PCA is an O(1) update
+  mutable bool momentsValid = false;
+  mutable Eigen::Vector3d momentMean;
+  mutable Eigen::Matrix3d momentScatter;
+  mutable std::mutex pcaMutex; // guards the lazy moment and PCA updates
+
+  void computeMoments(Eigen::Vector3d &mean, Eigen::Matrix3d &scatter) const;
+  void updatePCA() const; // with pcaMutex held
+
+  // named per-point attribute columns, kept in the order of the points
+  std::map<std::string, std::vector<float>> attributes;
+  // maps the normal columns "nx", "ny", "nz" along with points mapped by A
+  void mapNormals(const Eigen::Matrix3d &A);
+
+  // change tracking for copies of the points, see markDirty
+  struct Change {
+    std::uint64_t before; // the revision the edit started from
+    std::size_t begin, end;
+  };
+  static constexpr std::size_t maxChanges = 32;
+  std::uint64_t identity; // see id()
+  std::uint64_t changeRevision = 0;
+  std::deque<Change> changes; // the latest edits, oldest first
+  mutable std::mutex changeMutex; // guards the two above
+
 public:
   PointCloud();
+  PointCloud(const PointCloud &other);
+  PointCloud &operator=(const PointCloud &other);
   virtual ~PointCloud();
 
   bool loadPLY(const QString &);
 
+  // read access to the points
+  using Points::const_iterator;
+  using Points::value_type;
+  qsizetype size() const { return Points::size(); }
+  bool isEmpty() const { return Points::isEmpty(); }
+  bool empty() const { return Points::isEmpty(); }
+  const QVector4D &operator[](qsizetype i) const { return Points::at(i); }
+  const QVector4D &at(qsizetype i) const { return Points::at(i); }
+  const QVector4D *data() const { return Points::constData(); }
+  const QVector4D *constData() const { return Points::constData(); }
+  const_iterator begin() const { return Points::cbegin(); }
+  const_iterator end() const { return Points::cend(); }
+  const QVector<QVector4D> &points() const { return *this; }
+
+  // changes of the points
+  void setPoint(qsizetype i, const QVector4D &p);
+  // replaces all points; the attribute columns are dropped
+  void setPoints(const QVector<QVector4D> &points);
+  void clear() { setPoints({}); }
+
+  // maps the points and the normal attributes, see mapNormals
   virtual void affineMap(const QMatrix4x4 &) override;
   virtual void draw(const RenderCamera &camera,
                     const QColor &color = COLOR_POINT_CLOUD,
                     float point_size = 3.0f) const override;
   QVector3D getMin() const { return pointsBoundMin; }
   QVector3D getMax() const { return pointsBoundMax; }
+  void computeBounds(); // recomputes the AABB from the current points
+  void boundingBox(QVector3D &min, QVector3D &max) const; // parallel AABB
 
   // setup point size
   void setPointSize(unsigned s);
@@ -38,7 +101,50 @@ public:
   void computePCA(Eigen::Vector3f &centroid, Eigen::Matrix3f &eigenVectors,
                   Eigen::Vector3f &eigenValues) const;
 
-  const Eigen::Vector3f &centroid() const;
-  const Eigen::Matrix3f &eigenVectors() const;
-  const Eigen::Vector3f &eigenValues() const;
+  // Cached PCA, kept current by affineMap and append. The results are
+  // copies taken under the lock; pca() gives all three of one state.
+  struct PCA {
+    Eigen::Vector3f centroid;
+    Eigen::Matrix3f eigenVectors;
+    Eigen::Vector3f eigenValues;
+  };
+  PCA pca() const;
+  Eigen::Vector3f centroid() const;
+  Eigen::Matrix3f eigenVectors() const;
+  Eigen::Vector3f eigenValues() const;
+  void invalidatePCA(); // also marks all points dirty
+
+  // Change tracking for copies of the points, e.g. GPU buffers: every edit
+  // gets a new, process-wide unique revision() and is logged with its range
+  // of points, so that a copy at an older revision can update just the
+  // points changed since, see changedSince. All methods that change points
+  // mark their edits themselves.
+  std::uint64_t revision() const;
+  void markDirty(std::size_t begin = 0, std::size_t end = SIZE_MAX);
+  // the range [begin, end) of the points changed since revision; false if
+  // that is no longer known (too many edits since), i.e. all points
+  bool changedSince(std::uint64_t revision, std::size_t &begin,
+                    std::size_t &end) const;
+  // identifies the points for their copies: the same for a cloud and its
+  // snapshots, process-wide unique otherwise
+  std::uint64_t id() const { return identity; }
+  // an immutable copy of the points (no attributes) with the id, revision
+  // and change log of this cloud, so that a copy of an older snapshot is
+  // updated like one of this cloud; the points are shared until they change
+  std::shared_ptr<const PointCloud> snapshot() const;
+
+  // appends points and merges the moments of both parts; attribute columns
+  // are concatenated where both clouds have them and dropped otherwise
+  void append(const QVector4D &point);
+  void append(const PointCloud &other);
+
+  // per-point attributes, e.g. normals "nx", "ny", "nz" and "curvature"
+  std::vector<float> &attribute(const std::string &name); // created on demand
+  const std::vector<float> *findAttribute(const std::string &name) const;
+  void removeAttribute(const std::string &name) { attributes.erase(name); }
+
+  // permutes points and attributes: new point i is old point order[i]
+  void reorder(const std::vector<int> &order);
+  // new cloud of the points (and their attributes) at the given indices
+  PointCloud select(const std::vector<int> &indices) const;
 };
@@ -0,0 +1,150 @@
+#include "PointRasterizer.h"
+#include "Parallel.h"
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+RasterImages rasterize(const PointCloud &cloud,
+                       const PerspectiveCamera &camera,
+                       const RasterParameters &parameters) {
+  const int W = parameters.width, H = parameters.height;
+  const int radius = parameters.splatRadius, T = parameters.tileSize;
+  if (W <= 0 || H <= 0 || radius < 0 || T <= 0)
+    throw std::runtime_error("invalid raster parameters");
+  const float inf = std::numeric_limits<float>::infinity();
+  RasterImages images{Image<float>(W, H, inf), Image<int>(W, H, -1),
+                      Image<float>(W, H, 0.0f)};
+
+  // pixel centre and depth of every point in front of the camera
+  const std::size_t n = cloud.size();
+  std::vector<int> px(n), py(n);
+  std::vector<float> depth(n);
+  // continuous pixel position u = a x' + b of the distorted normalised
+  // coordinates x', see PerspectiveCamera::toPixel
+  const float size = camera.imagePlaneSize, f = camera.imagePlaneDistance;
+  const float ax = f / (2.0f * size) * W, ay = -f / (2.0f * size) * H;
+  const float bx = (camera.imagePrincipalPoint.x() + size) / (2.0f * size) * W;
+  const float by = (size - camera.imagePrincipalPoint.y()) / (2.0f * size) * H;
+  const QVector3D eye(camera.center);
+  const QVector3D axis[3] = {QVector3D(camera.pose.column(0)),
+                             QVector3D(camera.pose.column(1)),
+                             QVector3D(camera.pose.column(2))};
+  const QVector4D *points = cloud.constData();
+  const bool distorted = !camera.distortion.isZero();
+  parallelFor(n, [&](std::size_t i) {
+    QVector3D d = QVector3D(points[i]) - eye;
+    float x = QVector3D::dotProduct(d, axis[0]);
+    float y = QVector3D::dotProduct(d, axis[1]);
+    float z = QVector3D::dotProduct(d, axis[2]);
+    QVector2D normalised(x / z, y / z);
+    if (distorted)
+      normalised = camera.distortion.distort(normalised);
+    float u = ax * normalised.x() + bx, v = ay * normalised.y() + by;
+    // the pixel is the floor of the continuous position
+    bool visible = z > 0.0f && u > -radius && v > -radius && u < W + radius &&
+                   v < H + radius;
+    px[i] = visible ? int(std::floor(u)) : 0;
+    py[i] = visible ? int(std::floor(v)) : 0;
+    depth[i] = visible ? z : inf;
+  });
+
+  // counting sort of the splats into tiles; a splat is listed in every
+  // tile it overlaps, and per-chunk offsets keep the scatter stable
+  const int tilesX = (W + T - 1) / T, tilesY = (H + T - 1) / T;
+  const int tileCount = tilesX * tilesY;
+  auto forTiles = [&](std::size_t i, auto &&f) {
+    if (depth[i] == inf)
+      return;
+    int x0 = std::max(px[i] - radius, 0) / T;
+    int x1 = std::min(px[i] + radius, W - 1) / T;
+    int y0 = std::max(py[i] - radius, 0) / T;
+    int y1 = std::min(py[i] + radius, H - 1) / T;
+    for (int ty = y0; ty <= y1; ++ty)
+      for (int tx = x0; tx <= x1; ++tx)
+        f(ty * tilesX + tx);
+  };
+  const unsigned chunks = parallelChunkCount(n);
+  std::vector<std::vector<int>> offsets(chunks, std::vector<int>(tileCount));
+  parallelChunks(n, [&](std::size_t b, std::size_t e, unsigned c) {
+    for (std::size_t i = b; i < e; ++i)
+      forTiles(i, [&](int tile) { ++offsets[c][tile]; });
+  });
+  std::vector<int> tileStart(tileCount + 1);
+  int sum = 0;
+  for (int tile = 0; tile < tileCount; ++tile) {
+    tileStart[tile] = sum;
+    for (unsigned c = 0; c < chunks; ++c) {
+      int count = offsets[c][tile];
+      offsets[c][tile] = sum;
+      sum += count;
+    }
+  }
+  tileStart[tileCount] = sum;
+  // the splats are copied into the bins, so that a tile reads them in
+  // sequence rather than gathering from the per-point arrays
+  struct Splat {
+    int x, y;
+    float depth;
+    int index;
+  };
+  std::vector<Splat> binned(sum);
+  parallelChunks(n, [&](std::size_t b, std::size_t e, unsigned c) {
+    for (std::size_t i = b; i < e; ++i)
+      forTiles(i, [&](int tile) {
+        binned[offsets[c][tile]++] = {px[i], py[i], depth[i], int(i)};
+      });
+  });
+
+  // intensity source
+  const std::vector<float> *intensity =
+      cloud.findAttribute(parameters.intensity);
+  const std::vector<float> *nx = cloud.findAttribute("nx"),
+                           *ny = cloud.findAttribute("ny"),
+                           *nz = cloud.findAttribute("nz");
+  const bool shaded = !intensity && nx && ny && nz;
+  auto shade = [&](int i) {
+    if (intensity)
+      return (*intensity)[i];
+    if (!shaded)
+      return 1.0f;
+    QVector3D ray = (QVector3D(points[i]) - eye).normalized();
+    return std::fabs(QVector3D::dotProduct(
+        ray, QVector3D((*nx)[i], (*ny)[i], (*nz)[i])));
+  };
+
+  // z-buffer per tile; the points of a tile are in index order, so the
+  // strict comparison keeps the lowest index among equal depths
+  parallelFor(
+      std::size_t(tileCount),
+      [&](std::size_t tile) {
+        const int x0 = int(tile % tilesX) * T, y0 = int(tile / tilesX) * T;
+        const int x1 = std::min(x0 + T, W), y1 = std::min(y0 + T, H);
+        for (int k = tileStart[tile]; k < tileStart[tile + 1]; ++k) {
+          const Splat &s = binned[k];
+          for (int y = std::max(s.y - radius, y0),
+                   ye = std::min(s.y + radius + 1, y1);
+               y < ye; ++y) {
+            float *zRow = images.depth.row(y);
+            int *iRow = images.index.row(y);
+            for (int x = std::max(s.x - radius, x0),
+                     xe = std::min(s.x + radius + 1, x1);
+                 x < xe; ++x)
+              if (s.depth < zRow[x]) {
+                zRow[x] = s.depth;
+                iRow[x] = s.index;
+              }
+          }
+        }
+        for (int y = y0; y < y1; ++y) {
+          const int *iRow = images.index.row(y);
+          float *out = images.intensity.row(y);
+          for (int x = x0; x < x1; ++x)
+            if (iRow[x] >= 0)
+              out[x] = shade(iRow[x]);
+        }
+      },
+      1);
+  return images;
+}
@@ -0,0 +1,35 @@
+//
+//  Software z-buffer rendering of a point cloud through a PerspectiveCamera
+//  into depth, index and intensity images, e.g. for synthetic views and
+//  visibility masks
+//
+#pragma once
+
+#include "Image.h"
+#include "PerspectiveCamera.h"
+#include "PointCloud.h"
+
+#include <string>
+
+struct RasterParameters {
+  int width = 640, height = 480; // covering the image plane, see toPixel
+  int splatRadius = 0;           // points cover (2r+1)^2 pixels
+  int tileSize = 64;             // pixels per side of a tile
+  // attribute column written to the intensity image; without it, points
+  // with normals get |cos| of the angle to the viewing ray, others 1
+  std::string intensity = "intensity";
+};
+
+struct RasterImages {
+  Image<float> depth;     // along the viewing direction, +inf where empty
+  Image<int> index;       // of the visible point, -1 where empty
+  Image<float> intensity; // 0 where empty
+};
+
+// Projects the points in parallel, bins their splats into screen tiles by a
+// counting sort, and resolves every tile in its own task, so no pixel is
+// written concurrently. Ties in depth go to the lower point index, so the
+// result does not depend on the thread count.
+RasterImages rasterize(const PointCloud &cloud,
+                       const PerspectiveCamera &camera,
+                       const RasterParameters &parameters = RasterParameters());
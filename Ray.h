@@ -0,0 +1,85 @@
+//
+//  Rays and ray/box tests for picking against the spatial indices
+//
+#pragma once
+
+#include <QVector3D>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+struct Ray {
+  QVector3D origin;
+  QVector3D direction; // unit length
+  QVector3D invDirection;
+
+  Ray() = default;
+  Ray(const QVector3D &o, const QVector3D &d)
+      : origin(o), direction(d.normalized()) {
+    for (int k = 0; k < 3; ++k)
+      invDirection[k] = direction[k] != 0.0f
+                            ? 1.0f / direction[k]
+                            : std::numeric_limits<float>::infinity();
+  }
+};
+
+struct RayHit {
+  int index = -1; // point index in the indexed cloud, -1 if nothing was hit
+  float t = std::numeric_limits<float>::max(); // distance along the ray
+  float distance = 0.0f; // distance of the point from the ray axis
+};
+
+// Slab test of the ray against the box [min,max] grown by margin on every
+// side. On a hit, [tEnter,tExit] is the parameter interval inside the box.
+inline bool raySlab(const Ray &ray, const QVector3D &min, const QVector3D &max,
+                    float margin, float &tEnter, float &tExit) {
+  tEnter = 0.0f;
+  tExit = std::numeric_limits<float>::max();
+  for (int k = 0; k < 3; ++k) {
+    float lo = min[k] - margin, hi = max[k] + margin;
+    if (ray.direction[k] == 0.0f) {
+      if (ray.origin[k] < lo || ray.origin[k] > hi)
+        return false;
+      continue;
+    }
+    float t0 = (lo - ray.origin[k]) * ray.invDirection[k];
+    float t1 = (hi - ray.origin[k]) * ray.invDirection[k];
+    if (t0 > t1)
+      std::swap(t0, t1);
+    tEnter = std::max(tEnter, t0);
+    tExit = std::min(tExit, t1);
+    if (tEnter > tExit)
+      return false;
+  }
+  return true;
+}
+
+// Margin by which a box must be grown so that a slab test finds every point
+// of the box inside the cone of apex radius `radius` and opening slope
+// `coneSlope` (radius growth per unit distance along the ray).
+inline float rayBoxMargin(const Ray &ray, const QVector3D &min,
+                          const QVector3D &max, float radius,
+                          float coneSlope) {
+  if (coneSlope <= 0.0f)
+    return radius;
+  QVector3D center = 0.5f * (min + max);
+  float tFar = (center - ray.origin).length() + 0.5f * (max - min).length();
+  return radius + coneSlope * tFar;
+}
+
+// Tests a single point against the tube/cone and keeps it in hit if it lies
+// inside and closer to the ray origin than the current hit.
+inline void rayTestPoint(const Ray &ray, const QVector3D &p, int index,
+                         float radius, float coneSlope, RayHit &hit) {
+  QVector3D v = p - ray.origin;
+  float t = QVector3D::dotProduct(v, ray.direction);
+  if (t < 0.0f || t >= hit.t)
+    return;
+  float d2 = std::max(0.0f, v.lengthSquared() - t * t);
+  float tol = radius + coneSlope * t;
+  if (d2 <= tol * tol) {
+    hit.index = index;
+    hit.t = t;
+    hit.distance = std::sqrt(d2);
+  }
+}
@@ -0,0 +1,54 @@
+#include "RemapTable.h"
+
+#include <stdexcept>
+
+template <typename T, typename Blend>
+Image<T> RemapTable::apply(const Image<T> &source, const T &border,
+                           Blend &&blend) const {
+  if (source.width() != m_sourceWidth || source.height() != m_sourceHeight)
+    throw std::runtime_error("image size does not match the remap table");
+  Image<T> out(m_width, m_height, border);
+  // one-pixel-wide sources have no right/bottom neighbour; their weight is 0
+  const std::size_t dx = m_sourceWidth > 1 ? 1 : 0;
+  const std::size_t dy = m_sourceHeight > 1 ? m_sourceWidth : 0;
+  const T *s = source.data();
+  parallelFor(
+      std::size_t(m_height),
+      [&](std::size_t y) {
+        const std::size_t row = y * m_width;
+        T *o = out.row(int(y));
+        for (int x = 0; x < m_width; ++x) {
+          const std::int32_t offset = m_offset[row + x];
+          if (offset < 0)
+            continue;
+          const T *p = s + offset;
+          const int fx = m_fraction[row + x] & 0xff;
+          const int fy = m_fraction[row + x] >> 8;
+          o[x] = blend(p[0], p[dx], p[dy], p[dx + dy], fx, fy);
+        }
+      },
+      8);
+  return out;
+}
+
+Image<std::uint8_t> RemapTable::remap(const Image<std::uint8_t> &source,
+                                      std::uint8_t border) const {
+  return apply(source, border,
+               [](int a, int b, int c, int d, int fx, int fy) {
+                 int top = a * ONE + (b - a) * fx;
+                 int bottom = c * ONE + (d - c) * fx;
+                 int value = top * ONE + (bottom - top) * fy;
+                 return std::uint8_t((value + ONE * ONE / 2) >>
+                                     (2 * FRACTION_BITS));
+               });
+}
+
+Image<float> RemapTable::remap(const Image<float> &source,
+                               float border) const {
+  return apply(source, border,
+               [](float a, float b, float c, float d, int fx, int fy) {
+                 const float wx = fx * (1.0f / ONE), wy = fy * (1.0f / ONE);
+                 float top = a + (b - a) * wx, bottom = c + (d - c) * wx;
+                 return top + (bottom - top) * wy;
+               });
+}
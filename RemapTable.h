@@ -0,0 +1,85 @@
+//
+//  Precomputed image warp: every output pixel stores where it samples the
+//  source image, so applying a rectification or undistortion is a table
+//  lookup with fixed-point bilinear weights instead of per-pixel geometry
+//
+#pragma once
+
+#include "Image.h"
+#include "Parallel.h"
+
+#include <QVector2D>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+class RemapTable {
+public:
+  static constexpr int FRACTION_BITS = 7; // bilinear weights in 1/128 px
+  static constexpr int ONE = 1 << FRACTION_BITS;
+
+  RemapTable() = default;
+
+  // Table for a width x height output of a sourceWidth x sourceHeight
+  // image; source(x, y) is the source pixel position (integer values at
+  // pixel centres) sampled by output pixel (x, y). It is evaluated once per
+  // pixel, in parallel over rows.
+  template <typename F>
+  RemapTable(int width, int height, int sourceWidth, int sourceHeight,
+             F &&source)
+      : m_width(width), m_height(height), m_sourceWidth(sourceWidth),
+        m_sourceHeight(sourceHeight),
+        m_offset(std::size_t(width) * height, -1),
+        m_fraction(std::size_t(width) * height, 0) {
+    parallelFor(
+        std::size_t(height),
+        [&](std::size_t y) {
+          for (int x = 0; x < width; ++x) {
+            QVector2D s = source(x, int(y));
+            set(std::size_t(y) * width + x, s.x(), s.y());
+          }
+        },
+        8);
+  }
+
+  int width() const { return m_width; }
+  int height() const { return m_height; }
+  int sourceWidth() const { return m_sourceWidth; }
+  int sourceHeight() const { return m_sourceHeight; }
+  bool valid(int x, int y) const {
+    return m_offset[std::size_t(y) * m_width + x] >= 0;
+  }
+
+  // Bilinear resampling through the table; output pixels that sample
+  // outside the source get border. The source must have the size the
+  // table was built for.
+  Image<std::uint8_t> remap(const Image<std::uint8_t> &source,
+                            std::uint8_t border = 0) const;
+  Image<float> remap(const Image<float> &source,
+                     float border = std::nanf("")) const;
+
+private:
+  int m_width = 0, m_height = 0;
+  int m_sourceWidth = 0, m_sourceHeight = 0;
+  // per output pixel: index of the top-left source pixel of the bilinear
+  // footprint or -1, and the x and y weights of the right/bottom pixels
+  std::vector<std::int32_t> m_offset;
+  std::vector<std::uint16_t> m_fraction; // x | y << 8, in 1/ONE
+
+  void set(std::size_t i, float sx, float sy) {
+    if (!(sx >= 0.0f && sy >= 0.0f && sx <= m_sourceWidth - 1 &&
+          sy <= m_sourceHeight - 1))
+      return;
+    // footprints stay inside: the last row/column is reached with weight 1
+    int x = std::min(int(sx), std::max(m_sourceWidth - 2, 0));
+    int y = std::min(int(sy), std::max(m_sourceHeight - 2, 0));
+    int fx = int(std::lround((sx - x) * ONE));
+    int fy = int(std::lround((sy - y) * ONE));
+    m_offset[i] = std::int32_t(y * m_sourceWidth + x);
+    m_fraction[i] = std::uint16_t(fx | fy << 8);
+  }
+
+  template <typename T, typename Blend>
+  Image<T> apply(const Image<T> &source, const T &border,
+                 Blend &&blend) const;
+};
@@ -0,0 +1,345 @@
+#include "RenderBenchmark.h"
+#include "Axes.h"
+#include "KdTree.h"
+#include "PointCloud.h"
+#include "RenderCamera.h"
+#include "RenderList.h"
+#include "SceneManager.h"
+
+#include <QCommandLineParser>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLTimerQuery>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// one turn around the scene, then in and out again
+const char *defaultPath = R"(1 reset
+360 rotate 0 1 0
+60 backward
+60 forward
+)";
+
+struct FrameTiming {
+  double cpuMs;  // until the draw calls returned
+  double glMs;   // until glFinish returned, i.e. the frame was rendered
+  double gpuMs;  // GL timer query, < 0 if not supported
+  std::size_t uploadedBytes;
+};
+
+std::string readFile(const std::string &file) {
+  std::ifstream in(file);
+  if (!in)
+    throw std::runtime_error("cannot open " + file);
+  std::stringstream text;
+  text << in.rdbuf();
+  return text.str();
+}
+
+void apply(RenderCamera &renderer, const RenderBenchmarkStep &step) {
+  const std::string &c = step.command;
+  if (c == "reset")
+    renderer.reset();
+  else if (c == "rotate")
+    renderer.rotate(step.dx, step.dy, step.dz);
+  else if (c == "forward")
+    renderer.forward();
+  else if (c == "backward")
+    renderer.backward();
+  else if (c == "left")
+    renderer.left();
+  else if (c == "right")
+    renderer.right();
+  else if (c == "up")
+    renderer.up();
+  else if (c == "down")
+    renderer.down();
+}
+
+// frame as in GLWidget::paintGL
+FrameTiming renderFrame(RenderCamera &renderer, const RenderList &snapshot,
+                        QOpenGLTimerQuery *timer) {
+  using clock = std::chrono::steady_clock;
+  auto ms = [](clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+  };
+  renderer.resetStatistics();
+  const clock::time_point start = clock::now();
+  if (timer)
+    timer->begin();
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  renderer.setup();
+  snapshot.replay(renderer);
+  renderer.releaseUnusedBuffers();
+  if (timer)
+    timer->end();
+  const clock::time_point submitted = clock::now();
+  glFinish();
+  const clock::time_point finished = clock::now();
+
+  FrameTiming timing{ms(submitted - start), ms(finished - start), -1.0,
+                     renderer.uploadedBytes()};
+  if (timer)
+    timing.gpuMs = double(timer->waitForResult()) * 1e-6; // in ns
+  return timing;
+}
+
+QJsonObject statistics(std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  double sum = 0;
+  for (double v : values)
+    sum += v;
+  auto quantile = [&](double q) {
+    return values[std::size_t(q * double(values.size() - 1) + 0.5)];
+  };
+  return {{"mean", sum / double(values.size())},
+          {"median", quantile(0.5)},
+          {"p95", quantile(0.95)},
+          {"min", values.front()},
+          {"max", values.back()}};
+}
+
+QJsonDocument benchmark(const RenderBenchmarkParameters &parameters) {
+  const std::vector<RenderBenchmarkStep> path = parseCameraPath(
+      parameters.path.empty() ? defaultPath : readFile(parameters.path));
+
+  // the scene, drawn in the order of GLWidget
+  std::vector<std::unique_ptr<SceneObject>> objects;
+  objects.push_back(std::make_unique<Axes>());
+  std::size_t points = 0;
+  std::vector<std::string> scenes = parameters.scenes;
+  if (scenes.empty())
+#ifdef WIN32
+    scenes.push_back("..\\..\\data\\bunny.ply");
+#else
+    scenes.push_back("data/bunny.unix.ply");
+#endif
+  PointCloud *first = nullptr;
+  for (const std::string &file : scenes) {
+    auto cloud = std::make_unique<PointCloud>();
+    if (!cloud->loadPLY(QString::fromStdString(file)) || cloud->empty())
+      throw std::runtime_error("cannot read point cloud " + file);
+    points += std::size_t(cloud->size());
+    if (!first)
+      first = cloud.get();
+    objects.push_back(std::move(cloud));
+  }
+  if (parameters.kdDepth >= 0)
+    objects.push_back(std::make_unique<KdTree>(
+        *first, std::max(10, parameters.kdDepth), 20, parameters.kdDepth));
+  SceneManager scene;
+  for (const auto &object : objects)
+    scene.push_back(object.get());
+  // the scene is still, so one snapshot as of SceneWorker serves all frames
+  RenderCamera recorder;
+  const std::shared_ptr<const RenderList> snapshot = RenderList::record(
+      recorder, nullptr,
+      [&](const RenderCamera &r) { scene.draw(r, COLOR_SCENE); });
+
+  // offscreen context with a framebuffer object as canvas
+  QOpenGLContext context;
+  context.setFormat(QSurfaceFormat::defaultFormat());
+  if (!context.create())
+    throw std::runtime_error("cannot create an OpenGL context");
+  QOffscreenSurface surface;
+  surface.setFormat(context.format());
+  surface.create();
+  if (!surface.isValid() || !context.makeCurrent(&surface))
+    throw std::runtime_error("cannot create an offscreen surface");
+  // the GL objects are freed in this scope, while the context is current
+  std::vector<FrameTiming> timings;
+  {
+    QOpenGLFramebufferObject canvas(
+        parameters.width, parameters.height,
+        QOpenGLFramebufferObject::CombinedDepthStencil);
+    if (!canvas.isValid() || !canvas.bind())
+      throw std::runtime_error("cannot create a framebuffer object");
+    QOpenGLTimerQuery timerQuery;
+    QOpenGLTimerQuery *timer = timerQuery.create() ? &timerQuery : nullptr;
+
+    // GL state of GLWidget::initializeGL and resizeGL
+    glViewport(0, 0, parameters.width, parameters.height);
+    glEnable(GL_POINT_SMOOTH);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glClearColor(0.4f, 0.4f, 0.4f, 1);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
+    RenderCamera renderer;
+    QMatrix4x4 projectionMatrix;
+    projectionMatrix.perspective(70.0f,
+                                 float(parameters.width) /
+                                     float(parameters.height),
+                                 0.01f, 100.0f);
+    renderer.setProjectionMatrix(projectionMatrix);
+    renderer.reset();
+
+    // warm-up frames upload the buffers and are not reported
+    for (int i = 0; i < parameters.warmupFrames; ++i)
+      renderFrame(renderer, *snapshot, timer);
+    for (const RenderBenchmarkStep &step : path)
+      for (int i = 0; i < step.frames; ++i) {
+        apply(renderer, step);
+        timings.push_back(renderFrame(renderer, *snapshot, timer));
+      }
+    renderer.releaseBuffers();
+    canvas.release();
+  }
+
+  QJsonArray frames;
+  std::vector<double> cpuMs, glMs, gpuMs;
+  double glSeconds = 0;
+  for (const FrameTiming &t : timings) {
+    frames.append(QJsonObject{
+        {"cpuMs", t.cpuMs},
+        {"glMs", t.glMs},
+        {"gpuMs", t.gpuMs < 0 ? QJsonValue() : QJsonValue(t.gpuMs)},
+        {"pointsPerSecond", 1000.0 * double(points) / t.glMs},
+        {"uploadedBytes", double(t.uploadedBytes)}});
+    cpuMs.push_back(t.cpuMs);
+    glMs.push_back(t.glMs);
+    if (t.gpuMs >= 0)
+      gpuMs.push_back(t.gpuMs);
+    glSeconds += t.glMs / 1000.0;
+  }
+  QJsonObject summary{{"frames", int(timings.size())},
+                      {"pointsPerSecond",
+                       glSeconds > 0 ? double(points) * double(timings.size()) /
+                                           glSeconds
+                                     : 0.0}};
+  if (!timings.empty()) {
+    summary["cpuMs"] = statistics(cpuMs);
+    summary["glMs"] = statistics(glMs);
+  }
+  if (!gpuMs.empty())
+    summary["gpuMs"] = statistics(gpuMs);
+
+  auto glString = [](GLenum name) {
+    const auto *s = reinterpret_cast<const char *>(glGetString(name));
+    return QString::fromLatin1(s ? s : "");
+  };
+  QJsonObject result{{"renderer", glString(GL_RENDERER)},
+                     {"version", glString(GL_VERSION)},
+                     {"width", parameters.width},
+                     {"height", parameters.height},
+                     {"points", double(points)},
+                     {"warmupFrames", parameters.warmupFrames},
+                     {"summary", summary},
+                     {"frames", frames}};
+  context.doneCurrent();
+  return QJsonDocument(result);
+}
+
+} // namespace
+
+RenderBenchmarkParameters
+parseRenderBenchmarkArguments(const QStringList &arguments) {
+  QCommandLineParser parser;
+  const QCommandLineOption benchmarkOption("benchmark");
+  const QCommandLineOption sizeOption("size", "canvas size", "WxH");
+  const QCommandLineOption sceneOption("scene", "point cloud", "file.ply");
+  const QCommandLineOption pathOption("path", "camera path", "file");
+  const QCommandLineOption outputOption("output", "JSON report", "file.json");
+  const QCommandLineOption kdDepthOption("kd-depth", "kd-tree depth", "d");
+  const QCommandLineOption warmupOption("warmup", "warm-up frames", "n");
+  parser.addOptions({benchmarkOption, sizeOption, sceneOption, pathOption,
+                     outputOption, kdDepthOption, warmupOption});
+  if (!parser.parse(arguments))
+    throw std::runtime_error(parser.errorText().toStdString());
+
+  auto number = [&](const QCommandLineOption &option, int min) {
+    bool ok = false;
+    const int n = parser.value(option).toInt(&ok);
+    if (!ok || n < min)
+      throw std::runtime_error("invalid --" + option.names()[0].toStdString() +
+                               " " + parser.value(option).toStdString());
+    return n;
+  };
+
+  RenderBenchmarkParameters parameters;
+  if (parser.isSet(sizeOption)) {
+    const QStringList size = parser.value(sizeOption).split('x');
+    bool okWidth = false, okHeight = false;
+    if (size.size() == 2) {
+      parameters.width = size[0].toInt(&okWidth);
+      parameters.height = size[1].toInt(&okHeight);
+    }
+    if (!okWidth || !okHeight || parameters.width <= 0 ||
+        parameters.height <= 0)
+      throw std::runtime_error("invalid --size " +
+                               parser.value(sizeOption).toStdString());
+  }
+  for (const QString &scene : parser.values(sceneOption))
+    parameters.scenes.push_back(scene.toStdString());
+  parameters.path = parser.value(pathOption).toStdString();
+  parameters.output = parser.value(outputOption).toStdString();
+  if (parser.isSet(kdDepthOption))
+    parameters.kdDepth = number(kdDepthOption, 0);
+  if (parser.isSet(warmupOption))
+    parameters.warmupFrames = number(warmupOption, 0);
+  return parameters;
+}
+
+std::vector<RenderBenchmarkStep> parseCameraPath(const std::string &text) {
+  std::vector<RenderBenchmarkStep> path;
+  std::istringstream lines(text);
+  std::string line;
+  for (int number = 1; std::getline(lines, line); ++number) {
+    std::istringstream in(line);
+    RenderBenchmarkStep step;
+    if (!(in >> step.frames) || step.frames < 0) {
+      in.clear();
+      std::string word;
+      if (!(in >> word) || word[0] == '#')
+        continue; // empty line or comment
+      throw std::runtime_error("camera path, line " + std::to_string(number) +
+                               ": frame count expected");
+    }
+    in >> step.command;
+    if (step.command == "rotate" && !(in >> step.dx >> step.dy >> step.dz))
+      throw std::runtime_error("camera path, line " + std::to_string(number) +
+                               ": rotate needs three angles");
+    static const char *commands[] = {"reset", "rotate", "forward", "backward",
+                                     "left",  "right",  "up",      "down",
+                                     "still"};
+    if (std::find(std::begin(commands), std::end(commands), step.command) ==
+        std::end(commands))
+      throw std::runtime_error("camera path, line " + std::to_string(number) +
+                               ": unknown command '" + step.command + "'");
+    path.push_back(step);
+  }
+  return path;
+}
+
+int runRenderBenchmark(const QStringList &arguments) {
+  try {
+    const RenderBenchmarkParameters parameters =
+        parseRenderBenchmarkArguments(arguments);
+    const QByteArray json = benchmark(parameters).toJson();
+    if (parameters.output.empty()) {
+      std::cout.write(json.constData(), json.size());
+      std::cout.flush();
+    } else {
+      std::ofstream out(parameters.output, std::ios::binary);
+      out.write(json.constData(), json.size());
+      if (!out)
+        throw std::runtime_error("cannot write " + parameters.output);
+    }
+    return 0;
+  } catch (const std::exception &e) {
+    std::cerr << "benchmark: " << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,54 @@
+//
+//  Headless render benchmark: draws a scene through the GLWidget pipeline
+//  (a RenderList snapshot of a SceneManager, replayed through RenderCamera)
+//  into a framebuffer object of an offscreen surface, so that it runs
+//  without a display, e.g. with Mesa's software GL (QT_QPA_PLATFORM=
+//  offscreen). A scripted camera path is replayed, one frame per step, and
+//  the per-frame timings are written as JSON.
+//
+//  A camera path has one step per line, "<frames> <command> [arguments]",
+//  the command being applied before each of the frames:
+//
+//    reset                      RenderCamera::reset
+//    rotate <dx> <dy> <dz>      RenderCamera::rotate, in degrees
+//    forward, backward, left,   one RenderCamera translation step
+//    right, up, down
+//    still                      no motion
+//
+//  Empty lines and lines starting with '#' are ignored.
+//
+#pragma once
+
+#include <QStringList>
+#include <string>
+#include <vector>
+
+struct RenderBenchmarkParameters {
+  int width = 1280;
+  int height = 720;
+  std::vector<std::string> scenes; // PLY files; the bunny if empty
+  std::string path;                // camera path file; an orbit if empty
+  std::string output;              // JSON file; stdout if empty
+  int kdDepth = -1;                // draws a kd-tree of the first scene if >= 0
+  int warmupFrames = 5;            // rendered before the path, not reported
+};
+
+struct RenderBenchmarkStep {
+  int frames = 1;
+  std::string command;
+  int dx = 0, dy = 0, dz = 0;
+};
+
+// parses the command line of "Framework --benchmark"; throws
+// std::runtime_error on invalid arguments
+RenderBenchmarkParameters
+parseRenderBenchmarkArguments(const QStringList &arguments);
+
+// parses a camera path, see above; throws std::runtime_error on syntax errors
+std::vector<RenderBenchmarkStep> parseCameraPath(const std::string &text);
+
+// runs the benchmark for the command line of "Framework --benchmark [--size
+// WxH] [--scene file.ply]... [--path file] [--output file.json] [--kd-depth
+// d] [--warmup n]"; needs a Q(Gui)Application, returns the process exit code
+// and reports errors on stderr
+int runRenderBenchmark(const QStringList &arguments);
@@ -4,8 +4,14 @@
 // (c) Georg Umlauf, 2021
 //
 #include "RenderCamera.h"
+#include "GLBufferCache.h"
 #include "GLConvenience.h"
+#include "LineBatch.h"
+#include "PointCloud.h"
 #include "QtConvenience.h"
+#include "RenderList.h"
+
+#include <algorithm>
 
 RenderCamera::RenderCamera(QObject *parent)
     : QObject(parent), xRotation(0), yRotation(0), zRotation(0) {
@@ -15,6 +21,8 @@ RenderCamera::RenderCamera(QObject *parent)
   renderMatrix = getRenderMatrix();
 }
 
+RenderCamera::~RenderCamera() = default;
+
 void RenderCamera::setup() {
   // position and angles
   QMatrix4x4 cm;
@@ -128,8 +136,19 @@ QMatrix4x4 RenderCamera::getViewMatrix() const {
   return projectionMatrix * cameraMatrix * worldMatrix;
 }
 
+Ray RenderCamera::pickRay(float x, float y) const {
+  QMatrix4x4 inverse = renderMatrix.inverted();
+  QVector3D nearPoint = inverse.map(QVector3D(x, y, -1.0f));
+  QVector3D farPoint = inverse.map(QVector3D(x, y, 1.0f));
+  return Ray(nearPoint, farPoint - nearPoint);
+}
+
 void RenderCamera::renderPoint(const QVector3D &p, const QColor &color,
                                float pointSize) const {
+  if (recording) {
+    recording->addPoint(p, color, pointSize);
+    return;
+  }
   glPointSize(fmaxf(1.0f, pointSize));
   glBegin(GL_POINTS);
   glColor3f(color);
@@ -144,6 +163,10 @@ void RenderCamera::renderPoint(const QVector4D &p, const QColor &color,
 
 void RenderCamera::renderLine(const QVector3D &a, const QVector3D &b,
                               const QColor &color, float lineWidth) const {
+  if (recording) {
+    recording->addLine(a, b, color, lineWidth);
+    return;
+  }
   glLineWidth(fmaxf(1.0f, lineWidth));
   glBegin(GL_LINES);
   glColor4f(color);
@@ -161,6 +184,10 @@ void RenderCamera::renderLine(const QVector4D &a, const QVector4D &b,
 void RenderCamera::renderPlane(const QVector3D &a, const QVector3D &b,
                                const QVector3D &c, const QVector3D &d,
                                const QColor &color, float alpha) const {
+  if (recording) {
+    recording->addPlane(a, b, c, d, color, alpha);
+    return;
+  }
   glBegin(GL_QUADS);
   glColor4f(color, fminf(fmaxf(0.0f, alpha), 1.0f));
   glVertex3f(renderMatrix ^ a);
@@ -170,8 +197,36 @@ void RenderCamera::renderPlane(const QVector3D &a, const QVector3D &b,
   glEnd();
 }
 
+void RenderCamera::renderTriangles(const std::vector<QVector3D> &vertices,
+                                   const std::vector<int> &indices,
+                                   const QColor &color, float alpha) const {
+  if (recording) {
+    recording->addTriangles(vertices, indices, color, alpha);
+    return;
+  }
+  glBegin(GL_TRIANGLES);
+  for (std::size_t t = 0; t + 2 < indices.size(); t += 3) {
+    QVector3D a = renderMatrix ^ vertices[indices[t]];
+    QVector3D b = renderMatrix ^ vertices[indices[t + 1]];
+    QVector3D c = renderMatrix ^ vertices[indices[t + 2]];
+    // headlight shading from the facing of the projected triangle
+    QVector3D n = QVector3D::crossProduct(b - a, c - a).normalized();
+    float shade = 0.3f + 0.7f * fabsf(n.z());
+    glColor4f(color.redF() * shade, color.greenF() * shade,
+              color.blueF() * shade, fminf(fmaxf(0.0f, alpha), 1.0f));
+    glVertex3f(a);
+    glVertex3f(b);
+    glVertex3f(c);
+  }
+  glEnd();
+}
+
 void RenderCamera::renderPCL(const QVector<QVector4D> &pcl, const QColor &color,
                              float pointSize) const {
+  if (recording) {
+    recording->addPCL(pcl, color, pointSize);
+    return;
+  }
   glPointSize(fmaxf(1.0f, pointSize));
   glBegin(GL_POINTS);
   glColor3f(color);
@@ -179,3 +234,59 @@ void RenderCamera::renderPCL(const QVector<QVector4D> &pcl, const QColor &color,
     glVertex3f(renderMatrix ^ p);
   glEnd();
 }
+
+void RenderCamera::renderPointCloud(const PointCloud &pcl, const QColor &color,
+                                    float pointSize) const {
+  if (recording) {
+    recording->addPointCloud(pcl, color, pointSize);
+    return;
+  }
+  if (!buffers)
+    buffers = std::make_unique<GLBufferCache>();
+  if (!buffers->valid()) { // no shader support, immediate mode
+    renderPCL(pcl.points(), color, pointSize);
+    return;
+  }
+  buffers->draw(pcl, renderMatrix, color, pointSize);
+}
+
+void RenderCamera::renderLines(const LineBatch &lines, float lineWidth,
+                               std::size_t lineCount) const {
+  if (recording) {
+    recording->addLines(lines, lineWidth, lineCount);
+    return;
+  }
+  if (!buffers)
+    buffers = std::make_unique<GLBufferCache>();
+  if (buffers->valid()) {
+    buffers->draw(lines, renderMatrix, lineWidth, lineCount);
+    return;
+  }
+  // no shader support: immediate mode, but in one glBegin/glEnd
+  const std::vector<LineBatch::Vertex> &vertices = lines.vertices();
+  const std::size_t n = std::min(vertices.size(), 2 * lineCount);
+  glLineWidth(fmaxf(1.0f, lineWidth));
+  glBegin(GL_LINES);
+  for (std::size_t i = 0; i < n; ++i) {
+    const LineBatch::Vertex &v = vertices[i];
+    glColor4ub(v.r, v.g, v.b, v.a);
+    glVertex3f(renderMatrix ^ QVector3D(v.x, v.y, v.z));
+  }
+  glEnd();
+}
+
+void RenderCamera::releaseUnusedBuffers() {
+  if (buffers)
+    buffers->releaseUnused();
+}
+
+void RenderCamera::releaseBuffers() { buffers.reset(); }
+
+std::size_t RenderCamera::uploadedBytes() const {
+  return buffers ? buffers->uploadedBytes() : 0;
+}
+
+void RenderCamera::resetStatistics() {
+  if (buffers)
+    buffers->resetStatistics();
+}
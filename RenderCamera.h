@@ -15,12 +15,23 @@
 #include <QMatrix4x4>
 #include <QObject>
 #include <QVector3D>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Ray.h"
+
+class GLBufferCache;
+class LineBatch;
+class PointCloud;
+class RenderList;
 
 class RenderCamera : public QObject {
   Q_OBJECT
 
 public:
   RenderCamera(QObject *parent = nullptr);
+  ~RenderCamera();
 
   // methods to render primitive geometric objects, e.g. points, lines, planes,
   // point clouds, etc.
@@ -42,6 +53,16 @@ public:
   void renderPCL(
       const QVector<QVector4D> &pcl, // render point cloud of homogeneous points
       const QColor &color, float pointSize = 3.0f) const;
+  void renderPointCloud( // render point cloud from a GPU buffer, transformed
+      const PointCloud &pcl, // by a vertex shader; needs the GL context
+      const QColor &color, float pointSize = 3.0f) const;
+  void renderLines( // render the first lineCount lines of a batch from a GPU
+      const LineBatch &lines, // buffer, see LineBatch; needs the GL context
+      float lineWidth = 1.0f, std::size_t lineCount = SIZE_MAX) const;
+  void renderTriangles(
+      const std::vector<QVector3D> &vertices, // render indexed triangles,
+      const std::vector<int> &indices,        // shaded by facing
+      const QColor &color, float alpha = 1.0f) const;
 
   // methods for render camera navigation
   void setup();
@@ -54,6 +75,20 @@ public:
   void down();
   void rotate(int dx, int dy, int dz);
 
+  // frees the GPU buffers of point clouds not rendered since the last call,
+  // e.g. deleted ones; needs the GL context
+  void releaseUnusedBuffers();
+  // frees all GPU resources, before the GL context goes away
+  void releaseBuffers();
+  // while a list is set, the render methods append their calls to it instead
+  // of drawing, e.g. on a thread without GL context; see RenderList
+  void record(RenderList *list) { recording = list; }
+
+  // bytes uploaded to the GPU buffers since resetStatistics(), e.g. for
+  // benchmarks
+  std::size_t uploadedBytes() const;
+  void resetStatistics();
+
   // setter-methods for render camera parameters
   void setPosition(const QVector3D &p);
   void setProjectionMatrix(const QMatrix4x4 &P);
@@ -64,6 +99,10 @@ public:
   QMatrix4x4 getRenderMatrix() const;
   QMatrix4x4 getViewMatrix() const;
 
+  // ray in world coordinates through normalized device coordinates (x,y) of
+  // the last rendered frame, i.e. the inverse of renderMatrix
+  Ray pickRay(float x, float y) const;
+
 signals:
   void changed();
 
@@ -83,6 +122,11 @@ private:
   QMatrix4x4 worldMatrix;
   QMatrix4x4 renderMatrix;
 
+  // created with the first retained-mode render call, while the GL context
+  // is current
+  mutable std::unique_ptr<GLBufferCache> buffers;
+  RenderList *recording = nullptr;
+
   const int RotationBASE = 360;
   const int RotationSTEP = 1;
   const float TranslationSTEP = 0.002f;
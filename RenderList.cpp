@@ -0,0 +1,111 @@
+#include "RenderList.h"
+#include "RenderCamera.h"
+
+#include <type_traits>
+
+namespace {
+
+// the copy of original in copies, else the one of previous if it is still
+// current, else a new one made by copy()
+template <typename T, typename Copies, typename MakeCopy>
+std::shared_ptr<const T> share(const T &original, Copies &copies,
+                               const Copies *previous, MakeCopy &&copy) {
+  auto it = copies.find(&original);
+  if (it != copies.end() && it->second.revision == original.revision())
+    return it->second.copy;
+  std::shared_ptr<const T> shared;
+  if (previous) {
+    auto old = previous->find(&original);
+    if (old != previous->end() && old->second.revision == original.revision())
+      shared = old->second.copy;
+  }
+  if (!shared)
+    shared = copy();
+  copies[&original] = {original.revision(), shared};
+  return shared;
+}
+
+} // namespace
+
+std::shared_ptr<const RenderList>
+RenderList::record(RenderCamera &renderer, const RenderList *previous,
+                   const std::function<void(const RenderCamera &)> &draw) {
+  auto list = std::make_shared<RenderList>();
+  list->m_previous = previous;
+  renderer.record(list.get());
+  try {
+    draw(renderer);
+  } catch (...) {
+    renderer.record(nullptr);
+    throw;
+  }
+  renderer.record(nullptr);
+  list->m_previous = nullptr;
+  return list;
+}
+
+void RenderList::addPoint(const QVector3D &p, const QColor &color,
+                          float pointSize) {
+  m_commands.push_back(Point{p, color, pointSize});
+}
+
+void RenderList::addLine(const QVector3D &a, const QVector3D &b,
+                         const QColor &color, float lineWidth) {
+  m_commands.push_back(Line{a, b, color, lineWidth});
+}
+
+void RenderList::addPlane(const QVector3D &a, const QVector3D &b,
+                          const QVector3D &c, const QVector3D &d,
+                          const QColor &color, float alpha) {
+  m_commands.push_back(Plane{a, b, c, d, color, alpha});
+}
+
+void RenderList::addTriangles(const std::vector<QVector3D> &vertices,
+                              const std::vector<int> &indices,
+                              const QColor &color, float alpha) {
+  m_commands.push_back(Triangles{vertices, indices, color, alpha});
+}
+
+void RenderList::addPCL(const QVector<QVector4D> &pcl, const QColor &color,
+                        float pointSize) {
+  m_commands.push_back(PCL{pcl, color, pointSize});
+}
+
+void RenderList::addPointCloud(const PointCloud &pcl, const QColor &color,
+                               float pointSize) {
+  auto cloud = share(pcl, m_clouds,
+                     m_previous ? &m_previous->m_clouds : nullptr,
+                     [&] { return pcl.snapshot(); });
+  m_commands.push_back(Cloud{std::move(cloud), color, pointSize});
+}
+
+void RenderList::addLines(const LineBatch &lines, float lineWidth,
+                          std::size_t lineCount) {
+  auto batch = share(lines, m_lines,
+                     m_previous ? &m_previous->m_lines : nullptr,
+                     [&] { return lines.snapshot(); });
+  m_commands.push_back(Lines{std::move(batch), lineWidth, lineCount});
+}
+
+void RenderList::replay(const RenderCamera &renderer) const {
+  for (const Command &command : m_commands)
+    std::visit(
+        [&](const auto &c) {
+          using C = std::decay_t<decltype(c)>;
+          if constexpr (std::is_same_v<C, Point>)
+            renderer.renderPoint(c.p, c.color, c.size);
+          else if constexpr (std::is_same_v<C, Line>)
+            renderer.renderLine(c.a, c.b, c.color, c.width);
+          else if constexpr (std::is_same_v<C, Plane>)
+            renderer.renderPlane(c.a, c.b, c.c, c.d, c.color, c.alpha);
+          else if constexpr (std::is_same_v<C, Triangles>)
+            renderer.renderTriangles(c.vertices, c.indices, c.color, c.alpha);
+          else if constexpr (std::is_same_v<C, PCL>)
+            renderer.renderPCL(c.points, c.color, c.size);
+          else if constexpr (std::is_same_v<C, Cloud>)
+            renderer.renderPointCloud(*c.cloud, c.color, c.size);
+          else
+            renderer.renderLines(*c.lines, c.width, c.count);
+        },
+        command);
+}
@@ -0,0 +1,110 @@
+//
+//  A recorded sequence of render calls: a snapshot of what a scene renders,
+//  e.g. recorded on a worker thread (see SceneWorker) and replayed on the GUI
+//  thread with the current render camera.
+//
+//  Points, lines, planes and triangles are kept by value. Point clouds and
+//  line batches are kept as snapshots (see PointCloud::snapshot); a point
+//  cloud snapshot shares the points of its original until either changes
+//  (QVector's copy-on-write). Snapshots keep the id and revision of their
+//  original, so the GPU buffer of an original is updated by just its
+//  changes, and a recording hands on the snapshots of the previous one whose
+//  originals have the same revision.
+//
+#pragma once
+
+#include "LineBatch.h"
+#include "PointCloud.h"
+
+#include <QColor>
+#include <QVector3D>
+#include <QVector4D>
+#include <functional>
+#include <map>
+#include <memory>
+#include <variant>
+#include <vector>
+
+class RenderCamera;
+
+class RenderList {
+public:
+  // what draw renders through renderer, reusing the copies of previous (may
+  // be null) whose originals did not change
+  static std::shared_ptr<const RenderList>
+  record(RenderCamera &renderer, const RenderList *previous,
+         const std::function<void(const RenderCamera &)> &draw);
+
+  // called by RenderCamera while recording
+  void addPoint(const QVector3D &p, const QColor &color, float pointSize);
+  void addLine(const QVector3D &a, const QVector3D &b, const QColor &color,
+               float lineWidth);
+  void addPlane(const QVector3D &a, const QVector3D &b, const QVector3D &c,
+                const QVector3D &d, const QColor &color, float alpha);
+  void addTriangles(const std::vector<QVector3D> &vertices,
+                    const std::vector<int> &indices, const QColor &color,
+                    float alpha);
+  void addPCL(const QVector<QVector4D> &pcl, const QColor &color,
+              float pointSize);
+  void addPointCloud(const PointCloud &pcl, const QColor &color,
+                     float pointSize);
+  void addLines(const LineBatch &lines, float lineWidth,
+                std::size_t lineCount);
+
+  std::size_t size() const { return m_commands.size(); }
+
+  // issues the recorded calls through renderer, i.e. with its current
+  // transformation; needs the GL context
+  void replay(const RenderCamera &renderer) const;
+
+private:
+  struct Point {
+    QVector3D p;
+    QColor color;
+    float size;
+  };
+  struct Line {
+    QVector3D a, b;
+    QColor color;
+    float width;
+  };
+  struct Plane {
+    QVector3D a, b, c, d;
+    QColor color;
+    float alpha;
+  };
+  struct Triangles {
+    std::vector<QVector3D> vertices;
+    std::vector<int> indices;
+    QColor color;
+    float alpha;
+  };
+  struct PCL {
+    QVector<QVector4D> points;
+    QColor color;
+    float size;
+  };
+  struct Cloud {
+    std::shared_ptr<const PointCloud> cloud;
+    QColor color;
+    float size;
+  };
+  struct Lines {
+    std::shared_ptr<const LineBatch> lines;
+    float width;
+    std::size_t count;
+  };
+  using Command =
+      std::variant<Point, Line, Plane, Triangles, PCL, Cloud, Lines>;
+
+  // copy of an original at its revision
+  template <typename T> struct Copy {
+    std::uint64_t revision;
+    std::shared_ptr<const T> copy;
+  };
+
+  std::vector<Command> m_commands;
+  std::map<const PointCloud *, Copy<PointCloud>> m_clouds;
+  std::map<const LineBatch *, Copy<LineBatch>> m_lines;
+  const RenderList *m_previous = nullptr; // while recording
+};
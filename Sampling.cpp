@@ -0,0 +1,189 @@
+#include "Sampling.h"
+#include "Parallel.h"
+#include "SpatialHashGrid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+std::vector<int> farthestPointSampling(const KdTree &tree, int count,
+                                       int first) {
+  const PointCloud &cloud = tree.cloud();
+  const QVector4D *pts = cloud.constData();
+  const std::size_t n = cloud.size();
+  std::vector<int> samples;
+  if (n == 0 || count <= 0)
+    return samples;
+  if (first < 0 || std::size_t(first) >= n)
+    throw std::runtime_error("first sample out of range");
+  count = int(std::min<std::size_t>(count, n));
+  samples.reserve(count);
+
+  // squared distance of every point to its nearest sample
+  std::vector<float> minDist2(n);
+  const QVector3D p0(pts[first]);
+  parallelFor(n, [&](std::size_t i) {
+    minDist2[i] = (QVector3D(pts[i]) - p0).lengthSquared();
+  });
+  samples.push_back(first);
+
+  // entries whose distance has dropped since they were pushed are stale and
+  // pushed again with the current value when they surface
+  std::vector<std::pair<float, int>> heap(n);
+  parallelFor(n, [&](std::size_t i) { heap[i] = {minDist2[i], int(i)}; });
+  std::make_heap(heap.begin(), heap.end());
+
+  std::vector<int> neighbours;
+  std::vector<float> dist2;
+  while (int(samples.size()) < count && !heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end());
+    auto [d2, i] = heap.back();
+    heap.pop_back();
+    if (d2 != minDist2[i]) {
+      if (minDist2[i] > 0.0f) {
+        heap.emplace_back(minDist2[i], i);
+        std::push_heap(heap.begin(), heap.end());
+      }
+      continue;
+    }
+    if (d2 <= 0.0f)
+      break; // only duplicates of samples are left
+    samples.push_back(i);
+    minDist2[i] = 0.0f;
+    // every distance is at most d2, so farther points cannot get closer
+    tree.radiusSearch(QVector3D(pts[i]), std::sqrt(d2), neighbours, &dist2);
+    for (std::size_t k = 0; k < neighbours.size(); ++k)
+      minDist2[neighbours[k]] = std::min(minDist2[neighbours[k]], dist2[k]);
+  }
+  return samples;
+}
+
+std::vector<int> poissonDiskSampling(const PointCloud &cloud, float radius,
+                                     unsigned seed) {
+  if (!(radius > 0.0f))
+    throw std::runtime_error("radius must be positive");
+  const SpatialHashGrid grid(cloud, radius);
+  const QVector4D *pts = cloud.constData();
+  const std::vector<int> &cellStart = grid.cellStart();
+  const std::vector<int> &indices = grid.indices();
+  const int cells = int(grid.cellCount());
+  const float radius2 = radius * radius;
+
+  // pseudo-random candidate priority, independent of the thread schedule
+  auto priority = [seed](int i) {
+    std::uint64_t x = (std::uint64_t(i) << 32 | seed) * 0x9e3779b97f4a7c15ULL;
+    return x ^ x >> 29;
+  };
+
+  std::vector<std::vector<int>> phases(27);
+  for (int cell = 0; cell < cells; ++cell) {
+    int c[3];
+    grid.cellCoordinates(cell, c);
+    phases[c[0] % 3 * 9 + c[1] % 3 * 3 + c[2] % 3].push_back(cell);
+  }
+
+  // samples per cell; a cell only reads the samples of neighbouring cells,
+  // which belong to other phases and are not written concurrently
+  std::vector<std::vector<int>> samples(cells);
+  for (const std::vector<int> &phase : phases)
+    parallelFor(
+        phase.size(),
+        [&](std::size_t k) {
+          const int cell = phase[k];
+          int c[3];
+          grid.cellCoordinates(cell, c);
+          int neighbours[27], count = 0;
+          for (int dx = -1; dx <= 1; ++dx)
+            for (int dy = -1; dy <= 1; ++dy)
+              for (int dz = -1; dz <= 1; ++dz) {
+                int id = grid.cellId(c[0] + dx, c[1] + dy, c[2] + dz);
+                if (id >= 0 && id != cell)
+                  neighbours[count++] = id;
+              }
+          std::vector<int> candidates(indices.begin() + cellStart[cell],
+                                      indices.begin() + cellStart[cell + 1]);
+          std::sort(candidates.begin(), candidates.end(),
+                    [&](int a, int b) { return priority(a) < priority(b); });
+
+          auto conflicts = [&](const QVector3D &p, const std::vector<int> &s) {
+            for (int j : s)
+              if ((QVector3D(pts[j]) - p).lengthSquared() < radius2)
+                return true;
+            return false;
+          };
+          std::vector<int> &own = samples[cell];
+          for (int i : candidates) {
+            QVector3D p(pts[i]);
+            if (conflicts(p, own))
+              continue;
+            bool free = true;
+            for (int n = 0; n < count && free; ++n)
+              free = !conflicts(p, samples[neighbours[n]]);
+            if (free)
+              own.push_back(i);
+          }
+        },
+        16);
+
+  std::vector<int> result;
+  for (const std::vector<int> &s : samples)
+    result.insert(result.end(), s.begin(), s.end());
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+std::vector<int> poissonDiskSamplingToCount(const PointCloud &cloud,
+                                            int count, float *radius,
+                                            unsigned seed) {
+  std::vector<int> best;
+  if (count <= 0 || cloud.isEmpty())
+    return best;
+  if (std::size_t(count) >= std::size_t(cloud.size())) {
+    best.resize(cloud.size());
+    for (std::size_t i = 0; i < best.size(); ++i)
+      best[i] = int(i);
+    return best;
+  }
+
+  // the sample count falls roughly like r^-2 on surfaces: take secant steps
+  // in log-log space, bracketed by bisection
+  QVector3D mn, mx;
+  cloud.boundingBox(mn, mx);
+  const float diagonal = (mx - mn).length();
+  float lo = 0.0f, hi = diagonal; // count(lo) >= count > count(hi)
+  float r = diagonal / std::sqrt(float(count)), bestRadius = 0.0f;
+  for (int iteration = 0; iteration < 16; ++iteration) {
+    std::vector<int> samples = poissonDiskSampling(cloud, r, seed);
+    const int n = int(samples.size());
+    if (n >= count) {
+      lo = r;
+      if (best.empty() || n < int(best.size())) {
+        best.swap(samples);
+        bestRadius = r;
+      }
+      if (n <= count + count / 100)
+        break;
+    } else {
+      hi = r;
+    }
+    float next = r * std::sqrt(float(std::max(n, 1)) / float(count));
+    if (!(next > lo && next < hi))
+      next = lo > 0.0f ? std::sqrt(lo * hi) : 0.5f * hi;
+    r = next;
+  }
+  if (best.empty()) { // not bracketed, fall back to a tiny radius
+    bestRadius = diagonal * 1e-6f;
+    best = poissonDiskSampling(cloud, bestRadius, seed);
+  }
+
+  std::mt19937 rng(seed);
+  std::shuffle(best.begin(), best.end(), rng);
+  best.resize(std::min<std::size_t>(best.size(), count));
+  std::sort(best.begin(), best.end());
+  if (radius)
+    *radius = bestRadius;
+  return best;
+}
@@ -0,0 +1,33 @@
+//
+//  Evenly spread subsets of point clouds; both samplers return indices into
+//  the cloud instead of copying points (see PointCloud::select)
+//
+#pragma once
+
+#include "KdTree.h"
+
+#include <vector>
+
+// Farthest-point sampling: starting from point first, repeatedly picks the
+// point farthest from all samples so far. The distances to the samples are
+// kept per point and, after each pick, only updated within the radius that
+// can still lower them (a radius query in the tree); the next pick comes
+// from a lazily updated max-heap. Indices refer to tree.cloud().
+std::vector<int> farthestPointSampling(const KdTree &tree, int count,
+                                       int first = 0);
+
+// Poisson-disk sampling: a subset with no two points closer than radius,
+// maximal in the sense that every other point is within radius of a sample.
+// The points are binned into a grid of cell size radius and the cells are
+// processed in 27 phase groups (cell coordinates mod 3): cells of one group
+// cannot conflict, so each group runs in parallel. Candidates are visited
+// in a seeded pseudo-random order. The indices are sorted.
+std::vector<int> poissonDiskSampling(const PointCloud &cloud, float radius,
+                                     unsigned seed = 1);
+
+// Poisson-disk sampling with count samples: the radius is searched for a
+// sampling with at least count points, which is then thinned at random.
+// The radius used is returned in radius if given.
+std::vector<int> poissonDiskSamplingToCount(const PointCloud &cloud,
+                                            int count, float *radius = nullptr,
+                                            unsigned seed = 1);
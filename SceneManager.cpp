@@ -34,9 +34,10 @@ void SceneManager::draw(const RenderCamera &renderer,
         obj->draw(renderer, COLOR_POINT_CLOUD, 3.0f);
 
         auto *pc = static_cast<PointCloud *>(obj);
-        const Eigen::Vector3f &c = pc->centroid();
-        const Eigen::Matrix3f &EV = pc->eigenVectors();
-        const Eigen::Vector3f &L = pc->eigenValues();
+        const PointCloud::PCA pca = pc->pca();
+        const Eigen::Vector3f &c = pca.centroid;
+        const Eigen::Matrix3f &EV = pca.eigenVectors;
+        const Eigen::Vector3f &L = pca.eigenValues;
 
         QVector3D center(c.x(), c.y(), c.z());
         float scale = 1.5f * std::sqrt(L.maxCoeff());
@@ -64,6 +65,12 @@ void SceneManager::draw(const RenderCamera &renderer,
       case ST_KD_TREE:
         obj->draw(renderer, QColorConstants::Yellow, 1.5f);
         break;
+      case ST_CLUSTER_BOXES:
+        obj->draw(renderer, QColorConstants::Magenta, 1.5f);
+        break;
+      case ST_TRIANGLE_MESH:
+        obj->draw(renderer, QColor(200, 200, 200), 1.0f);
+        break;
       case ST_STEREO_CAMERA: {
         // TODO: Assignement 2, Part 1 - 3
         // Part 1: This is the place to invoke the stereo camera's projection
@@ -73,12 +80,17 @@ void SceneManager::draw(const RenderCamera &renderer,
         // misaligned stereo cameras.
         auto stereo = static_cast<StereoCamera *>(obj);
         obj->draw(renderer, COLOR_CAMERA, 3.0f);
+        stereo->beginFrame();
         for (auto toDraw : *this)
           if (toDraw->getType() == ST_HEXAHEDRON)
             stereo->projectHexahedron(
                 renderer, *dynamic_cast<Hexahedron *>(toDraw), 1.0f,
                 QColorConstants::Green, QColorConstants::Cyan);
-        stereo->reconstruct(renderer, QColorConstants::Red, 4.0f);
+          else if (toDraw->getType() == ST_POINT_CLOUD &&
+                   stereo->reconstructsPointClouds())
+            stereo->project(*static_cast<PointCloud *>(toDraw));
+        stereo->reconstruct();
+        stereo->drawReconstruction(renderer, QColorConstants::Red, 4.0f, 3.0f);
         break;
       }
       }
@@ -32,6 +32,8 @@ enum class SceneObjectType {
   ST_MaxSceneType [[maybe_unused]],
   ST_KD_TREE [[maybe_unused]],
   ST_OCT_TREE [[maybe_unused]],
+  ST_CLUSTER_BOXES [[maybe_unused]],
+  ST_TRIANGLE_MESH [[maybe_unused]],
 };
 
 class SceneObject {
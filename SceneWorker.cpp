@@ -0,0 +1,78 @@
+#include "SceneWorker.h"
+
+#include <iostream>
+
+SceneWorker::SceneWorker(QObject *parent)
+    : QObject(parent), current(std::make_shared<RenderList>()) {
+  thread = std::thread(&SceneWorker::run, this);
+}
+
+SceneWorker::~SceneWorker() { stop(); }
+
+void SceneWorker::post(Job job) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping)
+      return;
+    jobs.push_back(std::move(job));
+  }
+  wakeup.notify_one();
+}
+
+std::shared_ptr<const RenderList> SceneWorker::snapshot() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return current;
+}
+
+void SceneWorker::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    jobs.clear();
+  }
+  wakeup.notify_one();
+  if (thread.joinable())
+    thread.join();
+}
+
+void SceneWorker::run() {
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wakeup.wait(lock, [this] { return stopping || !jobs.empty(); });
+      if (stopping)
+        return;
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    try {
+      job(scene);
+    } catch (const std::exception &e) {
+      std::cerr << "scene update failed: " << e.what() << std::endl;
+    }
+
+    // one snapshot for a burst of jobs
+    std::shared_ptr<const RenderList> previous;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!jobs.empty() || stopping)
+        continue;
+      previous = current;
+    }
+    std::shared_ptr<const RenderList> next;
+    try {
+      next = RenderList::record(
+          recorder, previous.get(),
+          [this](const RenderCamera &r) { scene.draw(r, COLOR_SCENE); });
+    } catch (const std::exception &e) {
+      std::cerr << "scene snapshot failed: " << e.what() << std::endl;
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      current = std::move(next);
+    }
+    emit published();
+  }
+}
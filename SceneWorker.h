@@ -0,0 +1,57 @@
+//
+//  Runs the updates of a scene on a worker thread, e.g. transforms, PCA, tree
+//  rebuilds, level-of-detail selection and stereo reconstructions, and
+//  publishes what the scene renders as immutable snapshots (see RenderList).
+//  The GUI thread just replays the latest snapshot, so painting costs only
+//  the submission and long computations never block the input.
+//
+//  The scene belongs to the worker: it must only be accessed by jobs.
+//
+#pragma once
+
+#include "RenderCamera.h"
+#include "RenderList.h"
+#include "SceneManager.h"
+
+#include <QObject>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+class SceneWorker : public QObject {
+  Q_OBJECT
+
+public:
+  using Job = std::function<void(SceneManager &scene)>;
+
+  SceneWorker(QObject *parent = nullptr);
+  ~SceneWorker() override; // stop()
+
+  // queues a job; the jobs run in order, and a snapshot is recorded whenever
+  // the queue has run empty
+  void post(Job job);
+  // the latest snapshot, never null; for any thread
+  std::shared_ptr<const RenderList> snapshot() const;
+  // discards the queued jobs, waits for the running one and ends the thread
+  void stop();
+
+signals:
+  // a new snapshot is available; emitted on the worker thread
+  void published();
+
+private:
+  void run();
+
+  SceneManager scene;
+  RenderCamera recorder; // records the snapshots, never draws
+
+  mutable std::mutex mutex; // guards jobs, stopping and current
+  std::condition_variable wakeup;
+  std::deque<Job> jobs;
+  bool stopping = false;
+  std::shared_ptr<const RenderList> current;
+  std::thread thread;
+};
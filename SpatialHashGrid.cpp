@@ -0,0 +1,178 @@
+#include "SpatialHashGrid.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+SpatialHashGrid::SpatialHashGrid(const PointCloud &cloud, float cellSize)
+    : m_cloud(cloud), m_cellSize(cellSize), m_invCellSize(1.0f / cellSize) {
+  if (!(cellSize > 0.0f))
+    throw std::runtime_error("cell size must be positive");
+
+  const std::size_t n = cloud.size();
+  const QVector4D *pts = cloud.data();
+  QVector3D mx;
+  cloud.boundingBox(m_origin, mx);
+  for (int k = 0; k < 3; ++k) {
+    float cells = n ? std::floor((mx[k] - m_origin[k]) * m_invCellSize) : 0;
+    if (cells >= float(1 << 21))
+      throw std::runtime_error("cell size too small for the cloud extent");
+    m_dims[k] = int(cells) + 1;
+  }
+
+  // packed cell coordinates of every point
+  std::vector<std::uint64_t> keys(n);
+  parallelFor(n, [&](std::size_t i) {
+    int c[3];
+    cellCoords(QVector3D(pts[i]), c);
+    for (int k = 0; k < 3; ++k)
+      c[k] = std::clamp(c[k], 0, m_dims[k] - 1);
+    keys[i] = packCell(c[0], c[1], c[2]);
+  });
+
+  // occupied cells: collected per chunk, merged and numbered in key order,
+  // so that the rows of neighbouring cells are close in memory
+  const unsigned chunks = parallelChunkCount(n);
+  std::vector<FlatHashMap<int>> local(chunks);
+  parallelChunks(n, [&](std::size_t b, std::size_t e, unsigned c) {
+    std::uint64_t last = FlatHashMap<int>::EMPTY;
+    for (std::size_t i = b; i < e; ++i)
+      if (keys[i] != last)
+        local[c][last = keys[i]] = 0;
+  });
+  for (auto &cells : local) {
+    cells.forEach([&](std::uint64_t key, int) { m_cells[key] = 0; });
+    cells.release();
+  }
+  m_cellKeys.reserve(m_cells.size());
+  m_cells.forEach([&](std::uint64_t key, int) { m_cellKeys.push_back(key); });
+  std::sort(m_cellKeys.begin(), m_cellKeys.end());
+  const int cellCount = int(m_cellKeys.size());
+  for (int id = 0; id < cellCount; ++id)
+    m_cells[m_cellKeys[id]] = id;
+
+  std::vector<int> cellOf(n);
+  parallelFor(n, [&](std::size_t i) { cellOf[i] = *m_cells.find(keys[i]); });
+  std::vector<std::uint64_t>().swap(keys);
+
+  // counting sort by cell: per-chunk histograms give every chunk its own
+  // write offsets, so the scatter needs no synchronisation and is stable
+  std::vector<std::vector<int>> offsets(chunks,
+                                        std::vector<int>(cellCount, 0));
+  parallelChunks(n, [&](std::size_t b, std::size_t e, unsigned c) {
+    for (std::size_t i = b; i < e; ++i)
+      ++offsets[c][cellOf[i]];
+  });
+  m_cellStart.assign(cellCount + 1, 0);
+  int sum = 0;
+  for (int cell = 0; cell < cellCount; ++cell) {
+    m_cellStart[cell] = sum;
+    for (unsigned c = 0; c < chunks; ++c) {
+      int count = offsets[c][cell];
+      offsets[c][cell] = sum;
+      sum += count;
+    }
+  }
+  m_cellStart[cellCount] = sum;
+
+  m_indices.resize(n);
+  m_points.resize(n);
+  parallelChunks(n, [&](std::size_t b, std::size_t e, unsigned c) {
+    for (std::size_t i = b; i < e; ++i) {
+      int slot = offsets[c][cellOf[i]]++;
+      m_indices[slot] = int(i);
+      m_points[slot] = QVector3D(pts[i]);
+    }
+  });
+}
+
+int SpatialHashGrid::maxRing(const int c[3]) const {
+  int ring = 0;
+  for (int k = 0; k < 3; ++k)
+    ring = std::max({ring, std::abs(c[k]), std::abs(m_dims[k] - 1 - c[k])});
+  return ring;
+}
+
+int SpatialHashGrid::nearest(const QVector3D &q, float *dist2) const {
+  int c[3];
+  cellCoords(q, c);
+  int best = -1;
+  float bestDist2 = std::numeric_limits<float>::max();
+  // after ring r every unvisited point is at least r cells away
+  for (int ring = 0, last = maxRing(c); ring <= last; ++ring) {
+    forEachInRing(c, ring, [&](int index, const QVector3D &p) {
+      float d2 = (p - q).lengthSquared();
+      if (d2 < bestDist2) {
+        bestDist2 = d2;
+        best = index;
+      }
+    });
+    float reach = ring * m_cellSize;
+    if (best >= 0 && bestDist2 <= reach * reach)
+      break;
+  }
+  if (dist2)
+    *dist2 = bestDist2;
+  return best;
+}
+
+void SpatialHashGrid::knnSearch(const QVector3D &q, int k,
+                                std::vector<int> &indices,
+                                std::vector<float> &dist2) const {
+  std::vector<std::pair<float, int>> heap;
+  heap.reserve(std::max(k, 0) + 1);
+  int c[3];
+  cellCoords(q, c);
+  for (int ring = 0, last = maxRing(c); k > 0 && ring <= last; ++ring) {
+    forEachInRing(c, ring, [&](int index, const QVector3D &p) {
+      float d2 = (p - q).lengthSquared();
+      if (heap.size() < std::size_t(k)) {
+        heap.emplace_back(d2, index);
+        std::push_heap(heap.begin(), heap.end());
+      } else if (d2 < heap.front().first) {
+        std::pop_heap(heap.begin(), heap.end());
+        heap.back() = {d2, index};
+        std::push_heap(heap.begin(), heap.end());
+      }
+    });
+    float reach = ring * m_cellSize;
+    if (heap.size() == std::size_t(k) && heap.front().first <= reach * reach)
+      break;
+  }
+  std::sort_heap(heap.begin(), heap.end());
+  indices.resize(heap.size());
+  dist2.resize(heap.size());
+  for (std::size_t i = 0; i < heap.size(); ++i) {
+    dist2[i] = heap[i].first;
+    indices[i] = heap[i].second;
+  }
+}
+
+void SpatialHashGrid::radiusSearch(const QVector3D &q, float radius,
+                                   std::vector<int> &indices,
+                                   std::vector<float> *dist2) const {
+  indices.clear();
+  if (dist2)
+    dist2->clear();
+  const float radius2 = radius * radius;
+  auto collect = [&](int index, const QVector3D &p) {
+    float d2 = (p - q).lengthSquared();
+    if (d2 <= radius2) {
+      indices.push_back(index);
+      if (dist2)
+        dist2->push_back(d2);
+    }
+  };
+  if (radius <= m_cellSize) {
+    forEachNeighbour(q, collect);
+    return;
+  }
+  int c[3];
+  cellCoords(q, c);
+  const int r = int(std::ceil(radius * m_invCellSize));
+  for (int dx = -r; dx <= r; ++dx)
+    for (int dy = -r; dy <= r; ++dy)
+      for (int dz = -r; dz <= r; ++dz)
+        forEachInCell(c[0] + dx, c[1] + dy, c[2] + dz, collect);
+}
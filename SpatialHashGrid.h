@@ -0,0 +1,106 @@
+//
+//  Uniform grid over a point cloud for fixed-radius neighbourhood queries
+//
+//  Occupied cells are hashed to dense ids and the point indices are counting
+//  sorted by cell into compressed rows (CSR): the points of cell c are
+//  indices()[cellStart[c] .. cellStart[c+1]). The query methods mirror
+//  KdTree's, so both indices can be swapped in the same caller.
+//
+#pragma once
+
+#include "FlatHashMap.h"
+#include "PointCloud.h"
+
+#include <cmath>
+#include <utility>
+#include <vector>
+
+class SpatialHashGrid {
+public:
+  SpatialHashGrid(const PointCloud &cloud, float cellSize);
+
+  float cellSize() const { return m_cellSize; }
+  std::size_t cellCount() const { return m_cellStart.size() - 1; }
+  const PointCloud &cloud() const { return m_cloud; }
+
+  // Nearest-neighbour queries, see KdTree. The cloud is not reordered, so
+  // indices refer to its original order. They are exact for any radius/k,
+  // but cheapest while the answer lies within one cell of q.
+  int nearest(const QVector3D &q, float *dist2 = nullptr) const;
+  void knnSearch(const QVector3D &q, int k, std::vector<int> &indices,
+                 std::vector<float> &dist2) const; // sorted, closest first
+  void radiusSearch(const QVector3D &q, float radius, std::vector<int> &indices,
+                    std::vector<float> *dist2 = nullptr) const;
+
+  // Cell access: the points of cell c are indices()[cellStart()[c] ..
+  // cellStart()[c + 1]). cellId() is -1 for empty or outside cells.
+  const std::vector<int> &cellStart() const { return m_cellStart; }
+  const std::vector<int> &indices() const { return m_indices; }
+  void cellCoordinates(int cell, int c[3]) const {
+    std::uint64_t key = m_cellKeys[cell], mask = (1 << 21) - 1;
+    c[0] = int(key >> 42);
+    c[1] = int(key >> 21 & mask);
+    c[2] = int(key & mask);
+  }
+  int cellId(int x, int y, int z) const {
+    if (x < 0 || y < 0 || z < 0 || x >= m_dims[0] || y >= m_dims[1] ||
+        z >= m_dims[2])
+      return -1;
+    const int *cell = m_cells.find(packCell(x, y, z));
+    return cell ? *cell : -1;
+  }
+  void cellCoords(const QVector3D &q, int c[3]) const {
+    for (int k = 0; k < 3; ++k)
+      c[k] = int(std::floor((q[k] - m_origin[k]) * m_invCellSize));
+  }
+
+  // calls f(index, point) for every point in the 27 cells around q's cell
+  template <typename F>
+  void forEachNeighbour(const QVector3D &q, F &&f) const {
+    int c[3];
+    cellCoords(q, c);
+    for (int dx = -1; dx <= 1; ++dx) // z innermost: consecutive cell rows
+      for (int dy = -1; dy <= 1; ++dy)
+        for (int dz = -1; dz <= 1; ++dz)
+          forEachInCell(c[0] + dx, c[1] + dy, c[2] + dz, f);
+  }
+
+private:
+  const PointCloud &m_cloud;
+  float m_cellSize;
+  float m_invCellSize;
+  QVector3D m_origin;
+  int m_dims[3] = {0, 0, 0};
+
+  FlatHashMap<int> m_cells;        // packed cell coordinates -> cell id
+  std::vector<std::uint64_t> m_cellKeys; // packed coordinates per cell id
+  std::vector<int> m_cellStart;    // CSR row offsets, cellCount() + 1
+  std::vector<int> m_indices;      // point indices grouped by cell
+  std::vector<QVector3D> m_points; // the points in m_indices order
+
+  static std::uint64_t packCell(int x, int y, int z) {
+    return std::uint64_t(x) << 42 | std::uint64_t(y) << 21 | std::uint64_t(z);
+  }
+
+  template <typename F> void forEachInCell(int x, int y, int z, F &&f) const {
+    int cell = cellId(x, y, z);
+    if (cell < 0)
+      return;
+    for (int i = m_cellStart[cell]; i < m_cellStart[cell + 1]; ++i)
+      f(m_indices[i], m_points[i]);
+  }
+
+  // calls f(index, point) for the points in the cells at Chebyshev distance
+  // ring from cell c
+  template <typename F>
+  void forEachInRing(const int c[3], int ring, F &&f) const {
+    for (int dz = -ring; dz <= ring; ++dz)
+      for (int dy = -ring; dy <= ring; ++dy) {
+        bool face = std::abs(dz) == ring || std::abs(dy) == ring;
+        for (int dx = -ring; dx <= ring; dx += face ? 1 : 2 * ring)
+          forEachInCell(c[0] + dx, c[1] + dy, c[2] + dz, f);
+      }
+  }
+
+  int maxRing(const int c[3]) const;
+};
@@ -1,17 +1,37 @@
 #include "StereoCamera.h"
+#include "Triangulation.h"
 #include <cmath>
 #include <limits>
 
+void StereoCamera::beginFrame() {
+  m_leftImage.clear();
+  m_rightImage.clear();
+  m_hexahedra.clear();
+  m_reconstruction.clear();
+}
+
+void StereoCamera::project(const QVector4D *points, std::size_t n) {
+  const std::size_t first = m_leftImage.size();
+  m_leftImage.resize(first + n);
+  m_rightImage.resize(first + n);
+  left.project(points, n, m_leftImage.data() + first);
+  right.project(points, n, m_rightImage.data() + first);
+}
+
 void StereoCamera::projectHexahedron(const RenderCamera &renderer,
                                      const Hexahedron &hex, float lineWidth,
                                      const QColor &leftColor,
                                      const QColor &rightColor) {
-  PerspectiveCamera::drawHexahedron(
-      const_cast<PerspectiveCamera &>(leftCamera()), renderer, hex, leftColor,
-      lineWidth);
-  PerspectiveCamera::drawHexahedron(
-      const_cast<PerspectiveCamera &>(rightCamera()), renderer, hex, rightColor,
-      lineWidth);
+  QVector4D corners[8];
+  for (std::size_t i = 0; i < 8; ++i)
+    corners[i] = QVector4D(hex[i], 1.0f);
+  const std::size_t first = m_leftImage.size();
+  m_hexahedra.push_back(first);
+  project(corners, 8);
+  left.drawImageHexahedron(renderer, &m_leftImage[first], leftColor,
+                           lineWidth);
+  right.drawImageHexahedron(renderer, &m_rightImage[first], rightColor,
+                            lineWidth);
 }
 
 QMatrix4x4 StereoCamera::identityPose() {
@@ -19,37 +39,39 @@ QMatrix4x4 StereoCamera::identityPose() {
   pose.setToIdentity();
   return pose;
 }
-void StereoCamera::reconstruct(const RenderCamera &renderer,
-                               const QColor &color, float lineWidth) {
-  std::size_t n = std::min(left.planarHex.size(), right.planarHex.size());
-  const float B = baseline();
-  const float f = left.imagePlaneDistance;
-  const float k1 = 0.05f;
-
-  for (std::size_t h = 0; h < n; ++h) {
-    const Hexahedron &hexL = left.planarHex[h];
-    const Hexahedron &hexR = right.planarHex[h];
-    Hexahedron hexRec;
-    hexRec.clear();
-
-    for (std::size_t k = 0; k < hexL.size(); ++k) {
-      float xL = hexL[k].x() - left.center.x();
-      float yL = hexL[k].y() - left.center.y();
-      float xR = hexR[k].x() - right.center.x();
 
-      float disparity = xL - xR;
-      if (std::fabs(disparity) < 1e-6f)
-        disparity = 1e-6f;
-
-      float z = f * B / disparity;
-      float x = (z * xL) / f;
-      float y = z * yL / f;
-
-      float r2 = (xL * xL + yL * yL) / (f * f);
-      float d = 1.0f + k1 * r2;
+const std::vector<QVector3D> &StereoCamera::reconstruct() {
+  const std::size_t n = m_leftImage.size();
+  m_reconstruction.resize(n);
+  triangulate(m_leftImage.data(), m_rightImage.data(), n,
+              m_reconstruction.data());
+  return m_reconstruction;
+}
 
-      hexRec.push_back(QVector3D(x * d, y * d, z));
+void StereoCamera::drawReconstruction(const RenderCamera &renderer,
+                                      const QColor &color, float lineWidth,
+                                      float pointSize) const {
+  std::vector<bool> corner(m_reconstruction.size(), false);
+  for (std::size_t first : m_hexahedra) {
+    Hexahedron hex;
+    for (std::size_t k = 0; k < 8; ++k) {
+      hex[k] = m_reconstruction[first + k];
+      corner[first + k] = true;
     }
-    hexRec.draw(renderer, color, lineWidth);
+    hex.draw(renderer, color, lineWidth);
   }
+  QVector<QVector4D> points;
+  for (std::size_t i = 0; i < m_reconstruction.size(); ++i) {
+    const QVector3D &p = m_reconstruction[i];
+    if (!corner[i] && std::isfinite(p.x() + p.y() + p.z()))
+      points.push_back(QVector4D(p, 1.0f));
+  }
+  if (!points.isEmpty())
+    renderer.renderPCL(points, color, pointSize);
+}
+
+void StereoCamera::triangulate(const QVector2D *leftImage,
+                               const QVector2D *rightImage, std::size_t n,
+                               QVector3D *points) const {
+  ::triangulate(left, right, leftImage, rightImage, n, points);
 }
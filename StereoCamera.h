@@ -1,7 +1,9 @@
 #pragma once
 #include "PerspectiveCamera.h"
+#include "PointCloud.h"
 #include <QColor>
 #include <QVector2D>
+#include <vector>
 
 class StereoCamera : public SceneObject {
 public:
@@ -27,12 +29,33 @@ public:
     right.updateCamera();
   }
 
+  // Projections are collected per frame: beginFrame() clears them, the
+  // project methods append the image plane coordinates of points in both
+  // cameras, and reconstruct() triangulates all of them in one pass.
+  void beginFrame();
+  void project(const QVector4D *points, std::size_t n);
+  void project(const PointCloud &cloud) { project(cloud.data(), cloud.size()); }
+  // whether the scene also projects and reconstructs its point clouds every
+  // frame (see SceneManager::draw); off by default, as that costs a pass
+  // over every point and draws a second copy of each cloud
+  void setReconstructPointClouds(bool on) { m_pointClouds = on; }
+  bool reconstructsPointClouds() const { return m_pointClouds; }
+  // projects the corners and draws the projections on both image planes
   void projectHexahedron(const RenderCamera &renderer, const Hexahedron &hex,
                          float lineWidth, const QColor &leftColor,
                          const QColor &rightColor);
 
-  void reconstruct(const RenderCamera &renderer, const QColor &color,
-                   float lineWidth);
+  // the points projected in this frame in world coordinates, NaN where they
+  // are not visible
+  const std::vector<QVector3D> &reconstruct();
+  // the hexahedra as wireframes, the other points as a point cloud
+  void drawReconstruction(const RenderCamera &renderer, const QColor &color,
+                          float lineWidth, float pointSize) const;
+
+  // n world points from corresponding image plane coordinates, see
+  // ::triangulate
+  void triangulate(const QVector2D *left, const QVector2D *right,
+                   std::size_t n, QVector3D *points) const;
 
   const PerspectiveCamera &leftCamera() const noexcept { return left; }
   const PerspectiveCamera &rightCamera() const noexcept { return right; }
@@ -64,5 +87,11 @@ private:
   PerspectiveCamera left;
   PerspectiveCamera right;
 
+  // the current frame, see beginFrame()
+  std::vector<QVector2D> m_leftImage, m_rightImage;
+  std::vector<std::size_t> m_hexahedra; // first corner of each hexahedron
+  std::vector<QVector3D> m_reconstruction;
+  bool m_pointClouds = false;
+
   static QMatrix4x4 identityPose();
 };
@@ -0,0 +1,373 @@
+#include "TSDFVolume.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+constexpr int B = TSDFVolume::BLOCK_SIZE;
+
+int floorDiv(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+
+// the cube split into six tetrahedra around its diagonal 0-7; corner bits
+// are x, y, z, and along every tetrahedron edge the smaller corner's bits
+// are a subset of the larger one's
+const int TETRAHEDRA[6][4] = {{0, 1, 3, 7}, {0, 3, 2, 7}, {0, 2, 6, 7},
+                              {0, 6, 4, 7}, {0, 4, 5, 7}, {0, 5, 1, 7}};
+
+// a cube edge or diagonal: global voxel coordinates of its lower corner
+// (20 bits each, voxel coordinates are within +-2^19) and the direction
+std::uint64_t edgeKey(int x, int y, int z, int direction) {
+  const int o = 1 << 19;
+  return std::uint64_t(x + o) << 43 | std::uint64_t(y + o) << 23 |
+         std::uint64_t(z + o) << 3 | std::uint64_t(direction);
+}
+
+// triangles of one chunk of blocks, vertices shared within the chunk
+struct MeshPart {
+  FlatHashMap<int> vertexOf{4096};
+  std::vector<std::uint64_t> keys;
+  std::vector<QVector3D> vertices;
+  std::vector<int> indices;
+};
+
+} // namespace
+
+TSDFVolume::TSDFVolume(float voxelSize, float truncation, float maxWeight)
+    : m_voxelSize(voxelSize), m_truncation(truncation),
+      m_maxWeight(maxWeight) {
+  if (!(voxelSize > 0.0f) || !(truncation > 0.0f))
+    throw std::runtime_error("voxel size and truncation must be positive");
+}
+
+std::vector<int> TSDFVolume::allocate(const std::vector<std::uint64_t> &keys) {
+  std::vector<int> ids(keys.size());
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    if (const int *id = m_blockIndex.find(keys[i])) {
+      ids[i] = *id;
+      continue;
+    }
+    ids[i] = int(m_blocks.size());
+    m_blockIndex[keys[i]] = ids[i];
+    m_blockKeys.push_back(keys[i]);
+    m_blocks.emplace_back();
+  }
+  return ids;
+}
+
+const TSDFVolume::Voxel *TSDFVolume::voxel(int x, int y, int z) const {
+  int bx = floorDiv(x, B), by = floorDiv(y, B), bz = floorDiv(z, B);
+  const int *id = m_blockIndex.find(packBlock(bx, by, bz));
+  if (!id)
+    return nullptr;
+  return &m_blocks[*id][((z - bz * B) * B + (y - by * B)) * B + (x - bx * B)];
+}
+
+void TSDFVolume::integrate(const Image<float> &depth,
+                           const PerspectiveCamera &camera, float maxDepth) {
+  const int W = depth.width(), H = depth.height();
+  const float blockEdge = m_voxelSize * B;
+  const QVector3D eye(camera.center);
+  auto valid = [&](float d) { return d > 0.0f && d <= maxDepth; };
+
+  // blocks along the truncation band of every pixel ray, collected per
+  // chunk of rows
+  const unsigned chunks = parallelChunkCount(std::size_t(H), 8);
+  std::vector<std::vector<std::uint64_t>> touched(chunks);
+  parallelChunks(
+      std::size_t(H),
+      [&](std::size_t b, std::size_t e, unsigned c) {
+        FlatHashMap<char> seen;
+        const int steps =
+            std::max(1, int(std::ceil(4.0f * m_truncation / blockEdge)));
+        for (int y = int(b); y < int(e); ++y)
+          for (int x = 0; x < W; ++x) {
+            float d = depth(x, y);
+            if (!valid(d))
+              continue;
+            QVector3D p = camera.toWorld(camera.fromPixel(x, y, d, W, H));
+            QVector3D dir = (p - eye).normalized();
+            for (int s = 0; s <= steps; ++s) {
+              QVector3D q = p + dir * (m_truncation * (2.0f * s / steps - 1));
+              int k[3];
+              for (int a = 0; a < 3; ++a)
+                k[a] = int(std::floor(q[a] / blockEdge));
+              if (std::abs(k[0]) >= BLOCK_LIMIT ||
+                  std::abs(k[1]) >= BLOCK_LIMIT ||
+                  std::abs(k[2]) >= BLOCK_LIMIT)
+                continue;
+              std::uint64_t key = packBlock(k[0], k[1], k[2]);
+              char &flag = seen[key];
+              if (!flag) {
+                flag = 1;
+                touched[c].push_back(key);
+              }
+            }
+          }
+      },
+      8);
+  std::vector<std::uint64_t> keys;
+  for (auto &t : touched)
+    keys.insert(keys.end(), t.begin(), t.end());
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  const std::vector<int> ids = allocate(keys);
+
+  // every block is updated by one thread
+  parallelFor(
+      ids.size(),
+      [&](std::size_t i) {
+        Block &block = m_blocks[ids[i]];
+        int b[3];
+        unpackBlock(m_blockKeys[ids[i]], b);
+        for (int z = 0; z < B; ++z)
+          for (int y = 0; y < B; ++y)
+            for (int x = 0; x < B; ++x) {
+              QVector3D world((b[0] * B + x) * m_voxelSize,
+                              (b[1] * B + y) * m_voxelSize,
+                              (b[2] * B + z) * m_voxelSize);
+              QVector3D cam = camera.toCamera(world);
+              if (cam.z() <= 0.0f)
+                continue;
+              QVector2D px = camera.toPixel(cam, W, H);
+              int u = int(std::lround(px.x())), v = int(std::lround(px.y()));
+              if (!depth.contains(u, v) || !valid(depth(u, v)))
+                continue;
+              float sdf = depth(u, v) - cam.z();
+              if (sdf < -m_truncation)
+                continue; // occluded
+              Voxel &voxel = block[(z * B + y) * B + x];
+              float tsdf = std::min(1.0f, sdf / m_truncation);
+              voxel.tsdf = (voxel.tsdf * voxel.weight + tsdf) /
+                           (voxel.weight + 1.0f);
+              voxel.weight = std::min(voxel.weight + 1.0f, m_maxWeight);
+            }
+      },
+      1);
+}
+
+void TSDFVolume::integrate(const PointCloud &cloud) {
+  const std::vector<float> *nx = cloud.findAttribute("nx");
+  const std::vector<float> *ny = cloud.findAttribute("ny");
+  const std::vector<float> *nz = cloud.findAttribute("nz");
+  if (!nx || !ny || !nz)
+    throw std::runtime_error("point integration needs normals");
+  const QVector4D *pts = cloud.constData();
+  const std::size_t n = cloud.size();
+  const float blockEdge = m_voxelSize * B;
+
+  // (block, point) pairs for the blocks each point's band reaches
+  const unsigned chunks = parallelChunkCount(n);
+  std::vector<std::vector<std::pair<std::uint64_t, int>>> partial(chunks);
+  parallelChunks(n, [&](std::size_t b, std::size_t e, unsigned c) {
+    for (std::size_t i = b; i < e; ++i) {
+      int lo[3], hi[3];
+      bool inside = true;
+      for (int a = 0; a < 3; ++a) {
+        lo[a] = int(std::floor((pts[i][a] - m_truncation) / blockEdge));
+        hi[a] = int(std::floor((pts[i][a] + m_truncation) / blockEdge));
+        inside &=
+            std::abs(lo[a]) < BLOCK_LIMIT && std::abs(hi[a]) < BLOCK_LIMIT;
+      }
+      if (!inside)
+        continue;
+      for (int x = lo[0]; x <= hi[0]; ++x)
+        for (int y = lo[1]; y <= hi[1]; ++y)
+          for (int z = lo[2]; z <= hi[2]; ++z)
+            partial[c].emplace_back(packBlock(x, y, z), int(i));
+    }
+  });
+  std::vector<std::pair<std::uint64_t, int>> pairs;
+  for (auto &p : partial) {
+    pairs.insert(pairs.end(), p.begin(), p.end());
+    std::vector<std::pair<std::uint64_t, int>>().swap(p);
+  }
+  std::sort(pairs.begin(), pairs.end());
+  std::vector<std::uint64_t> keys;
+  std::vector<std::size_t> groupStart;
+  for (std::size_t i = 0; i < pairs.size(); ++i)
+    if (i == 0 || pairs[i].first != pairs[i - 1].first) {
+      keys.push_back(pairs[i].first);
+      groupStart.push_back(i);
+    }
+  groupStart.push_back(pairs.size());
+  const std::vector<int> ids = allocate(keys);
+
+  // voxels within the truncation distance of a point's tangent plane,
+  // weighted down with the tangential distance; one thread per block
+  const float trunc2 = m_truncation * m_truncation;
+  parallelFor(
+      ids.size(),
+      [&](std::size_t g) {
+        Block &block = m_blocks[ids[g]];
+        int b[3];
+        unpackBlock(keys[g], b);
+        std::array<float, B * B * B> sum{}, weight{};
+        for (std::size_t k = groupStart[g]; k < groupStart[g + 1]; ++k) {
+          const int i = pairs[k].second;
+          const QVector3D p(pts[i]);
+          const QVector3D normal((*nx)[i], (*ny)[i], (*nz)[i]);
+          int lo[3], hi[3];
+          for (int a = 0; a < 3; ++a) {
+            lo[a] = std::max(
+                b[a] * B,
+                int(std::ceil((p[a] - m_truncation) / m_voxelSize)));
+            hi[a] = std::min(
+                b[a] * B + B - 1,
+                int(std::floor((p[a] + m_truncation) / m_voxelSize)));
+          }
+          for (int z = lo[2]; z <= hi[2]; ++z)
+            for (int y = lo[1]; y <= hi[1]; ++y)
+              for (int x = lo[0]; x <= hi[0]; ++x) {
+                QVector3D diff =
+                    QVector3D(x, y, z) * m_voxelSize - p;
+                float d = QVector3D::dotProduct(normal, diff);
+                float t2 = diff.lengthSquared() - d * d;
+                if (t2 >= trunc2)
+                  continue;
+                float w = 1.0f - std::sqrt(std::max(t2, 0.0f)) / m_truncation;
+                int v = ((z - b[2] * B) * B + (y - b[1] * B)) * B +
+                        (x - b[0] * B);
+                sum[v] += w * std::clamp(d / m_truncation, -1.0f, 1.0f);
+                weight[v] += w;
+              }
+        }
+        for (int v = 0; v < B * B * B; ++v) {
+          if (weight[v] <= 0.0f)
+            continue;
+          Voxel &voxel = block[v];
+          voxel.tsdf = (voxel.tsdf * voxel.weight + sum[v]) /
+                       (voxel.weight + weight[v]);
+          voxel.weight = std::min(voxel.weight + weight[v], m_maxWeight);
+        }
+      },
+      1);
+}
+
+TriangleMesh TSDFVolume::extractMesh() const {
+  const std::size_t blocks = m_blocks.size();
+  std::vector<MeshPart> parts(parallelChunkCount(blocks, 16));
+  parallelChunks(
+      blocks,
+      [&](std::size_t begin, std::size_t end, unsigned c) {
+        MeshPart &part = parts[c];
+        for (std::size_t id = begin; id < end; ++id) {
+          int b[3];
+          unpackBlock(m_blockKeys[id], b);
+          // this block and its +x, +y, +z neighbours, for the cubes on
+          // the upper faces
+          const Block *around[8];
+          for (int k = 0; k < 8; ++k) {
+            const int *nb = m_blockIndex.find(
+                packBlock(b[0] + (k & 1), b[1] + (k >> 1 & 1),
+                          b[2] + (k >> 2 & 1)));
+            around[k] = nb ? &m_blocks[*nb] : nullptr;
+          }
+          auto at = [&](int x, int y, int z) -> const Voxel * {
+            int k = (x == B) | (y == B) << 1 | (z == B) << 2;
+            if (!around[k])
+              return nullptr;
+            return &(*around[k])[((z % B) * B + (y % B)) * B + (x % B)];
+          };
+
+          for (int z = 0; z < B; ++z)
+            for (int y = 0; y < B; ++y)
+              for (int x = 0; x < B; ++x) {
+                float value[8];
+                int g[8][3], inside = 0;
+                bool observed = true;
+                for (int k = 0; k < 8 && observed; ++k) {
+                  const Voxel *v =
+                      at(x + (k & 1), y + (k >> 1 & 1), z + (k >> 2 & 1));
+                  observed = v && v->weight > 0.0f;
+                  if (!observed)
+                    break;
+                  value[k] = v->tsdf;
+                  inside += value[k] < 0.0f;
+                  g[k][0] = b[0] * B + x + (k & 1);
+                  g[k][1] = b[1] * B + y + (k >> 1 & 1);
+                  g[k][2] = b[2] * B + z + (k >> 2 & 1);
+                }
+                if (!observed || inside == 0 || inside == 8)
+                  continue;
+
+                auto vertex = [&](int p, int q) {
+                  if (p > q)
+                    std::swap(p, q);
+                  std::uint64_t key = edgeKey(g[p][0], g[p][1], g[p][2], p ^ q);
+                  if (const int *found = part.vertexOf.find(key))
+                    return *found;
+                  float t = value[p] / (value[p] - value[q]);
+                  QVector3D a(g[p][0], g[p][1], g[p][2]);
+                  QVector3D bq(g[q][0], g[q][1], g[q][2]);
+                  int index = int(part.vertices.size());
+                  part.vertexOf[key] = index;
+                  part.keys.push_back(key);
+                  part.vertices.push_back((a + t * (bq - a)) * m_voxelSize);
+                  return index;
+                };
+                // oriented so that the normal points to positive distances
+                auto triangle = [&](int a, int b2, int c2,
+                                    const QVector3D &outward) {
+                  QVector3D n = QVector3D::crossProduct(
+                      part.vertices[b2] - part.vertices[a],
+                      part.vertices[c2] - part.vertices[a]);
+                  if (QVector3D::dotProduct(n, outward) < 0.0f)
+                    std::swap(b2, c2);
+                  part.indices.insert(part.indices.end(), {a, b2, c2});
+                };
+
+                for (const auto &tet : TETRAHEDRA) {
+                  int in[4], out[4], ni = 0, no = 0;
+                  QVector3D inSum, outSum;
+                  for (int k : tet) {
+                    QVector3D p(g[k][0], g[k][1], g[k][2]);
+                    if (value[k] < 0.0f) {
+                      in[ni++] = k;
+                      inSum += p;
+                    } else {
+                      out[no++] = k;
+                      outSum += p;
+                    }
+                  }
+                  if (ni == 0 || no == 0)
+                    continue;
+                  QVector3D outward = outSum / float(no) - inSum / float(ni);
+                  if (ni == 1 || no == 1) {
+                    const int lone = ni == 1 ? in[0] : out[0];
+                    const int *rest = ni == 1 ? out : in;
+                    triangle(vertex(lone, rest[0]), vertex(lone, rest[1]),
+                             vertex(lone, rest[2]), outward);
+                  } else { // quad across the four mixed edges
+                    int v0 = vertex(in[0], out[0]), v1 = vertex(in[0], out[1]);
+                    int v2 = vertex(in[1], out[1]), v3 = vertex(in[1], out[0]);
+                    triangle(v0, v1, v2, outward);
+                    triangle(v0, v2, v3, outward);
+                  }
+                }
+              }
+        }
+      },
+      16);
+
+  // merge the parts, sharing the vertices on block and chunk borders
+  TriangleMesh mesh;
+  FlatHashMap<int> vertexOf;
+  for (MeshPart &part : parts) {
+    std::vector<int> global(part.vertices.size());
+    for (std::size_t v = 0; v < part.vertices.size(); ++v) {
+      if (const int *found = vertexOf.find(part.keys[v])) {
+        global[v] = *found;
+        continue;
+      }
+      global[v] = int(mesh.vertices.size());
+      vertexOf[part.keys[v]] = global[v];
+      mesh.vertices.push_back(part.vertices[v]);
+    }
+    for (int index : part.indices)
+      mesh.indices.push_back(global[index]);
+  }
+  return mesh;
+}
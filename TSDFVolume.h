@@ -0,0 +1,77 @@
+//
+//  Truncated signed distance volume on sparse voxel blocks
+//
+//  Only the 8^3-voxel blocks near observed surfaces are allocated, found
+//  through a hash map from block coordinates, so memory grows with the
+//  surface area rather than with the bounding box.
+//
+#pragma once
+
+#include "FlatHashMap.h"
+#include "Image.h"
+#include "PerspectiveCamera.h"
+#include "PointCloud.h"
+#include "TriangleMesh.h"
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+class TSDFVolume {
+public:
+  static constexpr int BLOCK_SIZE = 8; // voxels per block edge
+
+  // truncation: distance band around the surface in scene units, a few
+  // voxels wide
+  TSDFVolume(float voxelSize, float truncation, float maxWeight = 64.0f);
+
+  // Fuses a depth map (depth along the viewing direction, <= 0 invalid) seen
+  // by camera, with pixels as in PerspectiveCamera::toPixel. Blocks along the
+  // truncation band of every pixel ray are allocated, then updated in
+  // parallel with the projective distance.
+  void integrate(const Image<float> &depth, const PerspectiveCamera &camera,
+                 float maxDepth = std::numeric_limits<float>::max());
+  // Fuses oriented points (attributes "nx", "ny", "nz", see estimateNormals):
+  // voxels near a point take the signed distance to its tangent plane.
+  void integrate(const PointCloud &cloud);
+
+  // zero crossing as a mesh, by marching tetrahedra run in parallel over the
+  // blocks; vertices are shared between triangles and blocks
+  TriangleMesh extractMesh() const;
+
+  float voxelSize() const { return m_voxelSize; }
+  std::size_t blockCount() const { return m_blocks.size(); }
+
+private:
+  struct Voxel {
+    float tsdf = 1.0f;   // distance / truncation, clamped to [-1, 1]
+    float weight = 0.0f; // 0: unobserved
+  };
+  using Block = std::array<Voxel, BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE>;
+
+  float m_voxelSize;
+  float m_truncation;
+  float m_maxWeight;
+  FlatHashMap<int> m_blockIndex;         // packed block coords -> block
+  std::vector<std::uint64_t> m_blockKeys; // per block
+  std::vector<Block> m_blocks;
+
+  // block coordinates are limited to +-2^16, i.e. 2^20 voxels per axis
+  static constexpr int BLOCK_LIMIT = 1 << 16;
+  static std::uint64_t packBlock(int x, int y, int z) {
+    const int o = 1 << 20;
+    return std::uint64_t(x + o) << 42 | std::uint64_t(y + o) << 21 |
+           std::uint64_t(z + o);
+  }
+  static void unpackBlock(std::uint64_t key, int b[3]) {
+    const int o = 1 << 20, mask = (1 << 21) - 1;
+    b[0] = int(key >> 42) - o;
+    b[1] = int(key >> 21 & mask) - o;
+    b[2] = int(key & mask) - o;
+  }
+
+  // ids of the blocks with the given keys, allocating missing ones
+  std::vector<int> allocate(const std::vector<std::uint64_t> &keys);
+  const Voxel *voxel(int x, int y, int z) const; // global voxel coordinates
+};
@@ -0,0 +1,29 @@
+//
+//  Indexed triangle mesh, e.g. a surface extracted from a TSDFVolume
+//
+#pragma once
+
+#include "SceneObject.h"
+
+#include <QVector3D>
+#include <vector>
+
+class TriangleMesh : public SceneObject {
+public:
+  std::vector<QVector3D> vertices;
+  std::vector<int> indices; // three vertex indices per triangle
+
+  TriangleMesh() { type = SceneObjectType::ST_TRIANGLE_MESH; }
+
+  std::size_t triangleCount() const { return indices.size() / 3; }
+
+  void affineMap(const QMatrix4x4 &M) override {
+    for (auto &v : vertices)
+      v = M.map(v);
+  }
+  void draw(const RenderCamera &renderer,
+            const QColor &colour = QColor(200, 200, 200),
+            float alpha = 1.0f) const override {
+    renderer.renderTriangles(vertices, indices, colour, alpha);
+  }
+};
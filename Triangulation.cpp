@@ -0,0 +1,105 @@
+#include "Triangulation.h"
+#include "Parallel.h"
+
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// point X from the observations x[k] by the cameras P[k]
+Eigen::Vector3d triangulatePoint(const Matrix34d *P, const Eigen::Vector2d *x,
+                                 int refinementIterations) {
+  Eigen::Matrix4d A;
+  for (int k = 0; k < 2; ++k) {
+    A.row(2 * k) = x[k].x() * P[k].row(2) - P[k].row(0);
+    A.row(2 * k + 1) = x[k].y() * P[k].row(2) - P[k].row(1);
+  }
+  for (int r = 0; r < 4; ++r) // equilibrated rows condition the system
+    A.row(r).normalize();
+  // A [X; 1] = 0 in the least-squares sense: a 3x3 Cholesky solve, and the
+  // null vector of A by SVD only when that fails, e.g. for parallel rays
+  Eigen::Vector3d X;
+  Eigen::LLT<Eigen::Matrix3d> llt(A.leftCols<3>().transpose() *
+                                  A.leftCols<3>());
+  if (llt.info() == Eigen::Success) {
+    X = llt.solve(-A.leftCols<3>().transpose() * A.col(3));
+  } else {
+    Eigen::JacobiSVD<Eigen::Matrix4d> svd(A, Eigen::ComputeFullV);
+    Eigen::Vector4d Xh = svd.matrixV().col(3);
+    X = Xh.head<3>() / Xh.w();
+  }
+
+  for (int it = 0; it < refinementIterations; ++it) {
+    Eigen::Matrix3d JtJ = Eigen::Matrix3d::Zero();
+    Eigen::Vector3d Jtr = Eigen::Vector3d::Zero();
+    for (int k = 0; k < 2; ++k) {
+      const auto M = P[k].leftCols<3>();
+      Eigen::Vector3d p = M * X + P[k].col(3);
+      Eigen::Vector2d projected = p.head<2>() / p.z();
+      Eigen::Matrix<double, 2, 3> J; // of the projection, w.r.t. X
+      J.row(0) = (M.row(0) - projected.x() * M.row(2)) / p.z();
+      J.row(1) = (M.row(1) - projected.y() * M.row(2)) / p.z();
+      JtJ += J.transpose() * J;
+      Jtr += J.transpose() * (x[k] - projected);
+    }
+    X += JtJ.ldlt().solve(Jtr);
+  }
+  return X;
+}
+
+// image plane coordinates p of the camera with its distortion removed
+Eigen::Vector2d pinhole(const PerspectiveCamera &camera, const QVector2D &p) {
+  if (camera.distortion.isZero())
+    return Eigen::Vector2d(p.x(), p.y());
+  const QVector2D &pp = camera.imagePrincipalPoint;
+  const float f = camera.imagePlaneDistance;
+  QVector2D n = camera.distortion.undistort((p - pp) * (1.0f / f));
+  return Eigen::Vector2d(pp.x() + f * n.x(), pp.y() + f * n.y());
+}
+
+} // namespace
+
+Matrix34d cameraMatrix(const PerspectiveCamera &camera) {
+  Eigen::Matrix3d Rt; // rows: the camera axes
+  for (int r = 0; r < 3; ++r)
+    for (int c = 0; c < 3; ++c)
+      Rt(r, c) = camera.pose(c, r);
+  Eigen::Vector3d center(camera.center.x(), camera.center.y(),
+                         camera.center.z());
+  Eigen::Matrix3d K = Eigen::Matrix3d::Identity();
+  K(0, 0) = K(1, 1) = camera.imagePlaneDistance;
+  K(0, 2) = camera.imagePrincipalPoint.x();
+  K(1, 2) = camera.imagePrincipalPoint.y();
+
+  Matrix34d P;
+  P.leftCols<3>() = K * Rt;
+  P.col(3) = -K * Rt * center;
+  return P;
+}
+
+void triangulate(const PerspectiveCamera &a, const PerspectiveCamera &b,
+                 const QVector2D *imageA, const QVector2D *imageB,
+                 std::size_t n, QVector3D *points, int refinementIterations,
+                 float *errors) {
+  const Matrix34d P[2] = {cameraMatrix(a), cameraMatrix(b)};
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  parallelFor(
+      n,
+      [&](std::size_t i) {
+        const Eigen::Vector2d x[2] = {pinhole(a, imageA[i]),
+                                      pinhole(b, imageB[i])};
+        Eigen::Vector3d X = triangulatePoint(P, x, refinementIterations);
+        double error2 = 0.0;
+        bool visible = X.allFinite();
+        for (int k = 0; k < 2 && visible; ++k) {
+          Eigen::Vector3d p = P[k].leftCols<3>() * X + P[k].col(3);
+          visible = p.z() > 0.0;
+          error2 += (x[k] - p.head<2>() / p.z()).squaredNorm();
+        }
+        points[i] = visible ? QVector3D(X.x(), X.y(), X.z())
+                            : QVector3D(nan, nan, nan);
+        if (errors)
+          errors[i] = visible ? float(std::sqrt(error2 / 2.0)) : nan;
+      },
+      1024);
+}
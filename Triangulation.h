@@ -0,0 +1,29 @@
+//
+//  Two-view triangulation from the poses and intrinsics of a pair of
+//  PerspectiveCameras, for rigs that need not be rectified
+//
+#pragma once
+
+#include "PerspectiveCamera.h"
+
+#include <Eigen/Dense>
+#include <cstddef>
+
+using Matrix34d = Eigen::Matrix<double, 3, 4>;
+
+// Camera matrix P = K [R^T | -R^T c] of a camera with centre c and the
+// camera axes (pose columns 0-2) as columns of R. It maps homogeneous world
+// points to homogeneous image plane coordinates, see PerspectiveCamera::
+// project; K holds imagePlaneDistance and the principal point.
+Matrix34d cameraMatrix(const PerspectiveCamera &camera);
+
+// Triangulates n correspondences given as image plane coordinates in a and
+// b, undistorted first where the cameras have a distortion. Each point is
+// the linear (DLT) least-squares solution of its 4x4 system, refined by
+// Gauss-Newton steps on the reprojection error in both images. Points that
+// end up behind a camera are NaN. The optional errors receive the RMS
+// reprojection error of each point.
+void triangulate(const PerspectiveCamera &a, const PerspectiveCamera &b,
+                 const QVector2D *imageA, const QVector2D *imageB,
+                 std::size_t n, QVector3D *points,
+                 int refinementIterations = 2, float *errors = nullptr);
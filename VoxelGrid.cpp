@@ -0,0 +1,153 @@
+#include "VoxelGrid.h"
+#include "FlatHashMap.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+struct VoxelAccumulator {
+  double x = 0, y = 0, z = 0;
+  std::uint32_t count = 0;
+  std::uint32_t nearest = 0; // index of the point closest to the centroid
+  float nearestDist2 = std::numeric_limits<float>::max();
+};
+
+using VoxelMap = FlatHashMap<VoxelAccumulator>;
+
+// spreads the lower 21 bits of v so that two zero bits follow each bit
+std::uint64_t splitBy3(std::uint32_t v) {
+  std::uint64_t x = v & 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffffULL;
+  x = (x | x << 16) & 0x1f0000ff0000ffULL;
+  x = (x | x << 8) & 0x100f00f00f00f00fULL;
+  x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+  x = (x | x << 2) & 0x1249249249249249ULL;
+  return x;
+}
+
+} // namespace
+
+std::uint64_t mortonEncode(std::uint32_t x, std::uint32_t y, std::uint32_t z) {
+  return splitBy3(x) | splitBy3(y) << 1 | splitBy3(z) << 2;
+}
+
+PointCloud voxelGridFilter(const PointCloud &cloud, float voxelSize,
+                           VoxelSample sample) {
+  if (!(voxelSize > 0.0f))
+    throw std::runtime_error("voxel size must be positive");
+
+  PointCloud result;
+  const std::size_t n = cloud.size();
+  if (n == 0)
+    return result;
+  const QVector4D *pts = cloud.data();
+
+  QVector3D mn, mx;
+  cloud.boundingBox(mn, mx);
+  const unsigned chunks = parallelChunkCount(n);
+  const float inv = 1.0f / voxelSize;
+  for (int k = 0; k < 3; ++k)
+    if ((mx[k] - mn[k]) * inv >= float(1 << 21))
+      throw std::runtime_error("voxel size too small for the cloud extent");
+
+  auto keyOf = [&](const QVector4D &p) {
+    return mortonEncode(std::uint32_t((p.x() - mn.x()) * inv),
+                        std::uint32_t((p.y() - mn.y()) * inv),
+                        std::uint32_t((p.z() - mn.z()) * inv));
+  };
+
+  // accumulate per chunk; consecutive points of a scan mostly share a voxel,
+  // so the last hit is cached to skip the hash lookup
+  std::vector<VoxelMap> maps(chunks);
+  parallelChunks(n, [&](std::size_t b, std::size_t e, unsigned c) {
+    VoxelMap &map = maps[c];
+    std::uint64_t lastKey = ~std::uint64_t(0);
+    VoxelAccumulator *acc = nullptr;
+    for (std::size_t i = b; i < e; ++i) {
+      const QVector4D &p = pts[i];
+      std::uint64_t key = keyOf(p);
+      if (key != lastKey) {
+        acc = &map[key];
+        lastKey = key;
+      }
+      acc->x += p.x();
+      acc->y += p.y();
+      acc->z += p.z();
+      ++acc->count;
+    }
+  });
+
+  VoxelMap &voxels = maps[0];
+  for (unsigned c = 1; c < chunks; ++c) {
+    maps[c].forEach([&](std::uint64_t key, const VoxelAccumulator &a) {
+      VoxelAccumulator &v = voxels[key];
+      v.x += a.x;
+      v.y += a.y;
+      v.z += a.z;
+      v.count += a.count;
+    });
+    maps[c].release();
+  }
+  voxels.forEach([](std::uint64_t, VoxelAccumulator &v) {
+    v.x /= v.count;
+    v.y /= v.count;
+    v.z /= v.count;
+  });
+
+  if (sample == VoxelSample::VS_NEAREST_TO_CENTROID) {
+    // the merged map is only read here; each chunk tracks its own winners
+    std::vector<VoxelMap> nearest(chunks);
+    parallelChunks(n, [&](std::size_t b, std::size_t e, unsigned c) {
+      VoxelMap &map = nearest[c];
+      for (std::size_t i = b; i < e; ++i) {
+        const QVector4D &p = pts[i];
+        std::uint64_t key = keyOf(p);
+        const VoxelAccumulator &v = *voxels.find(key);
+        float dx = p.x() - float(v.x), dy = p.y() - float(v.y),
+              dz = p.z() - float(v.z);
+        float d2 = dx * dx + dy * dy + dz * dz;
+        VoxelAccumulator &best = map[key];
+        if (d2 < best.nearestDist2) {
+          best.nearestDist2 = d2;
+          best.nearest = std::uint32_t(i);
+        }
+      }
+    });
+    for (unsigned c = 0; c < chunks; ++c) {
+      nearest[c].forEach([&](std::uint64_t key, const VoxelAccumulator &best) {
+        VoxelAccumulator &v = voxels[key];
+        if (best.nearestDist2 < v.nearestDist2) {
+          v.nearestDist2 = best.nearestDist2;
+          v.nearest = best.nearest;
+        }
+      });
+      nearest[c].release();
+    }
+  }
+
+  // emit in Morton order
+  std::vector<std::pair<std::uint64_t, const VoxelAccumulator *>> order;
+  order.reserve(voxels.size());
+  voxels.forEach([&](std::uint64_t key, const VoxelAccumulator &v) {
+    order.emplace_back(key, &v);
+  });
+  std::sort(order.begin(), order.end(),
+            [](const auto &a, const auto &b) { return a.first < b.first; });
+
+  QVector<QVector4D> points(qsizetype(order.size()));
+  QVector4D *out = points.data();
+  for (const auto &[key, acc] : order) {
+    const VoxelAccumulator &v = *acc;
+    if (sample == VoxelSample::VS_NEAREST_TO_CENTROID)
+      *out++ = pts[v.nearest];
+    else
+      *out++ = QVector4D(float(v.x), float(v.y), float(v.z), 1.0f);
+  }
+  result.setPoints(points);
+  result.setPointSize(cloud.getPointSize());
+  result.computeBounds();
+  return result;
+}
@@ -0,0 +1,24 @@
+//
+//  Voxel-grid downsampling of point clouds
+//
+#pragma once
+
+#include "PointCloud.h"
+
+#include <cstdint>
+
+// representative point kept for every occupied voxel
+enum class VoxelSample {
+  VS_CENTROID,           // mean of the voxel's points
+  VS_NEAREST_TO_CENTROID // input point closest to that mean
+};
+
+// 63-bit Morton code of the integer voxel coordinates (21 bits per axis)
+std::uint64_t mortonEncode(std::uint32_t x, std::uint32_t y, std::uint32_t z);
+
+// Reduces the cloud to one point per occupied voxel of edge length voxelSize.
+// Points are accumulated per chunk into hashed Morton keys, so the working set
+// grows with the number of occupied voxels rather than with the input size.
+// The result is ordered by Morton key, i.e. spatially coherent.
+PointCloud voxelGridFilter(const PointCloud &cloud, float voxelSize,
+                           VoxelSample sample = VoxelSample::VS_CENTROID);
@@ -3,8 +3,12 @@
 // (c) Georg Umlauf, 2021+2022+2024
 //
 #include "glwidget.h"
+#include "GlobalRegistration.h"
+#include "ICP.h"
 #include "KdTree.h"
+#include "NormalEstimation.h"
 #include "OctTree.h"
+#include "Sampling.h"
 #include "StereoCamera.h"
 #include <QtGui>
 
@@ -21,8 +25,11 @@
 #include <QMouseEvent>
 #include <QtGui>
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <iostream>
+#include <set>
 
 #include "Axes.h"
 #include "Hexahedron.h"
@@ -41,16 +48,10 @@ auto printHomegenousTransform = [](const QMatrix4x4 &M, const char *name) {
   }
 };
 
-GLWidget::GLWidget(QWidget *parent)
-    : QOpenGLWidget(parent), pointSize(5), kdDepth(3) {
-  // enable mouse-events, even if no mouse-button is pressed -> yields smoother
-  // mouse-move reactions
-  setMouseTracking(true);
-
-  renderer = new RenderCamera();
-  renderer->reset();
-  connect(renderer, &RenderCamera::changed, this, &GLWidget::onRendererChanged);
-
+//
+//  sets up the scene; runs on the thread of the scene worker
+//
+static void buildScene(SceneManager &sceneManager) {
   // TODO: Assignment 1, Part 1
   //       Add here your own new 3d scene objects, e.g. cubes, hexahedra, etc.,
 
@@ -84,38 +85,38 @@ GLWidget::GLWidget(QWidget *parent)
   pcl2->affineMap(R);
   printHomegenousTransform(R, "R");
 
-  Eigen::Vector3f c1, c2, L;
-  Eigen::Matrix3f V1, V2;
-  pcl->computePCA(c1, V1, L);
-  pcl2->computePCA(c2, V2, L);
-
-  Eigen::Matrix3f R12 = V2.transpose() * V1;
-  Eigen::Vector3f t12 = V2.transpose() * (c1 - c2);
-
-  QMatrix4x4 T12;
-  T12.setToIdentity();
-  for (int i = 0; i < 3; ++i)
-    for (int j = 0; j < 3; ++j)
-      T12(i, j) = R12(i, j);
-  T12(0, 3) = t12.x();
-  T12(1, 3) = t12.y();
-  T12(2, 3) = t12.z();
-
-  printHomegenousTransform(T12, "T ( coordinates in PCA₁  →  PCA₂ )");
-
-  Eigen::Matrix3f Rw = V2 * R12 * V1.transpose(); // 3×3 rotation in world
-  Eigen::Vector3f tw = c2 - Rw * c1;              // 3×1 translation in world
-
-  QMatrix4x4 Tw;
-  Tw.setToIdentity();
-  for (int i = 0; i < 3; ++i)
-    for (int j = 0; j < 3; ++j)
-      Tw(i, j) = Rw(i, j);
-  Tw(0, 3) = tw.x();
-  Tw(1, 3) = tw.y();
-  Tw(2, 3) = tw.z();
-
-  printHomegenousTransform(Tw, "T_world");
+  // register pcl2 onto pcl: FPFH matches between Poisson-disk subsets give
+  // an initial transform for any relative pose, which ICP refines
+  {
+    PointCloud source = pcl2->select(poissonDiskSampling(*pcl2, 0.015f));
+    PointCloud target = pcl->select(poissonDiskSampling(*pcl, 0.015f));
+    KdTree sourceTree(source, 24, 16), targetTree(target, 24, 16);
+    estimateNormals(source, sourceTree, 12, QVector3D(0, 0, 10));
+    estimateNormals(target, targetTree, 12, QVector3D(0, 0, 10));
+    GlobalRegistrationParameters parameters;
+    parameters.featureRadius = 0.075f;
+    parameters.maxCorrespondenceDistance = 0.02f;
+    GlobalRegistrationResult global =
+        registerGlobally(sourceTree, targetTree, parameters);
+    cout << "FPFH: " << global.descriptors << " descriptors in "
+         << 1000.0 * global.descriptorSeconds << " ms ("
+         << global.descriptorsPerSecond() << " /s), matching "
+         << 1000.0 * global.matchingSeconds << " ms, RANSAC "
+         << global.iterations << " samples in "
+         << 1000.0 * global.ransacSeconds << " ms, " << global.inliers
+         << " of " << global.correspondences << " matches inliers" << endl;
+
+    KdTree tree(*pcl, 24, 16);
+    ICPResult icp = ICP(tree).align(*pcl2, global.transform);
+    printHomegenousTransform(toQMatrix4x4(icp.transform),
+                             "T_icp ( pcl2  →  pcl )");
+    cout << "ICP: " << icp.iterations << " iterations in "
+         << 1000.0 * icp.seconds << " ms (" << icp.iterationsPerSecond()
+         << " it/s), RMSE " << icp.rmse << " over " << icp.correspondences
+         << " points" << (icp.converged ? "" : ", not converged") << endl;
+    cout << "global registration + ICP: "
+         << 1000.0 * (global.seconds() + icp.seconds) << " ms" << endl;
+  }
   sceneManager.push_back(pcl);
   sceneManager.push_back(pcl2);
 
@@ -175,10 +176,34 @@ GLWidget::GLWidget(QWidget *parent)
   //
 }
 
+GLWidget::GLWidget(QWidget *parent)
+    : QOpenGLWidget(parent), pointSize(5), kdDepth(3) {
+  // enable mouse-events, even if no mouse-button is pressed -> yields smoother
+  // mouse-move reactions
+  setMouseTracking(true);
+
+  renderer = new RenderCamera();
+  renderer->reset();
+  connect(renderer, &RenderCamera::changed, this, &GLWidget::onRendererChanged);
+
+  // the scene is built and updated by the worker, which queues a repaint for
+  // every snapshot it publishes; loading and registering the point clouds
+  // thus no longer delays the window
+  connect(&sceneWorker, &SceneWorker::published, this, [this] { update(); });
+  sceneWorker.post(buildScene);
+}
+
 //
-//  destructor has nothing to do, since it's under Qt control
+//  destructor stops the scene worker before the state its jobs use goes away
+//  and frees the GPU buffers while their context still exists, the rest is
+//  under Qt control
 //
-GLWidget::~GLWidget() {}
+GLWidget::~GLWidget() {
+  sceneWorker.stop();
+  makeCurrent();
+  renderer->releaseBuffers();
+  doneCurrent();
+}
 
 //
 //  initializes the canvas and OpenGL context
@@ -202,7 +227,15 @@ void GLWidget::paintGL() {
 
   renderer->setup();
 
-  sceneManager.draw(*renderer, COLOR_SCENE);
+  // the latest snapshot of the scene; it stays valid while the worker goes on
+  sceneWorker.snapshot()->replay(*renderer);
+
+  if (picked)
+    renderer->renderPoint(pickedPoint, QColorConstants::Magenta, 12.0f);
+
+  // buffers of clouds that were not drawn, e.g. deleted ones or those of
+  // replaced snapshots
+  renderer->releaseUnusedBuffers();
 }
 
 //
@@ -291,9 +324,13 @@ void GLWidget::keyPressEvent(QKeyEvent *event) {
   case Key_Z: {
     QMatrix4x4 A;
     A.translate(0.0f, 0.0f, event->modifiers() & ShiftModifier ? -0.1f : 0.1f);
-    for (auto s : sceneManager)
-      if (s->getType() == SceneObjectType::ST_POINT_CLOUD)
-        s->affineMap(A);
+    sceneWorker.post([this, A](SceneManager &sceneManager) {
+      for (auto s : sceneManager)
+        if (s->getType() == SceneObjectType::ST_POINT_CLOUD)
+          s->affineMap(A);
+      if (pickedCloud)
+        publishPick(sceneManager); // moved with its cloud
+    });
     break;
   }
     // quit application
@@ -333,6 +370,118 @@ void GLWidget::mouseMoveEvent(QMouseEvent *event) {
   }
 }
 
+//
+//  reacts on mouse-press events
+//
+void GLWidget::mousePressEvent(QMouseEvent *event) {
+  pressMousePosition = event->pos();
+  prevMousePosition = event->pos();
+}
+
+//
+//  reacts on mouse-release events: a left click without drag picks a point
+//
+void GLWidget::mouseReleaseEvent(QMouseEvent *event) {
+  if (event->button() == Qt::LeftButton &&
+      (event->pos() - pressMousePosition).manhattanLength() <= 2) {
+    pick(event->pos());
+    update();
+  }
+}
+
+//
+//  picks the point under the cursor: casts a narrow cone through the pixel
+//  against a spatial index of every point cloud in the scene, reusing the
+//  scene's kd- and oct-trees and building a kd-tree over a copy of the points
+//  otherwise; the point is shown once the scene worker has found it
+//
+void GLWidget::pick(const QPoint &pos) {
+  const float tolerance = 4.0f; // pick radius in pixels
+  float x = 2.0f * float(pos.x()) / float(width()) - 1.0f;
+  float y = 1.0f - 2.0f * float(pos.y()) / float(height());
+  Ray ray = renderer->pickRay(x, y);
+  Ray edge = renderer->pickRay(x + 2.0f * tolerance / float(width()), y);
+  float cosine = QVector3D::dotProduct(ray.direction, edge.direction);
+  float slope = std::sqrt(std::max(0.0f, 1.0f - cosine * cosine)) / cosine;
+  float radius = (edge.origin - ray.origin).length();
+
+  // the search runs on the worker, which owns the scene and the trees
+  sceneWorker.post([this, ray, radius, slope](SceneManager &sceneManager) {
+    RayHit best;
+    const PointCloud *bestCloud = nullptr;
+    auto keep = [&](const PointCloud *cloud, const RayHit &hit) {
+      if (hit.index >= 0 && hit.t < best.t) {
+        best = hit;
+        bestCloud = cloud;
+      }
+    };
+
+    std::set<const PointCloud *> indexed;
+    for (auto s : sceneManager)
+      if (s->getType() == SceneObjectType::ST_KD_TREE) {
+        auto *tree = static_cast<KdTree *>(s);
+        indexed.insert(&tree->cloud());
+        keep(&tree->cloud(), tree->raycast(ray, radius, slope));
+      } else if (s->getType() == SceneObjectType::ST_OCT_TREE) {
+        auto *tree = static_cast<OctTree *>(s);
+        indexed.insert(&tree->cloud());
+        keep(&tree->cloud(), tree->raycast(ray, radius, slope));
+      }
+    // the trees of clouds that have left the scene or got a tree in it
+    for (auto it = pickTrees.begin(); it != pickTrees.end();)
+      if (std::find(sceneManager.begin(), sceneManager.end(), it->first) ==
+              sceneManager.end() ||
+          indexed.count(it->first))
+        it = pickTrees.erase(it);
+      else
+        ++it;
+    for (auto s : sceneManager)
+      if (s->getType() == SceneObjectType::ST_POINT_CLOUD) {
+        auto *cloud = static_cast<PointCloud *>(s);
+        if (indexed.count(cloud))
+          continue;
+        PickTree &pick = pickTrees[cloud];
+        if (!pick.tree || pick.revision != cloud->revision()) {
+          pick.revision = cloud->revision();
+          pick.tree.reset();
+          pick.points = std::make_unique<PointCloud>();
+          pick.points->setPoints(cloud->points());
+          pick.tree = std::make_unique<KdTree>(*pick.points, 24, 32, 1,
+                                               &pick.order);
+        }
+        RayHit hit = pick.tree->raycast(ray, radius, slope);
+        if (hit.index >= 0)
+          hit.index = pick.order[hit.index];
+        keep(cloud, hit);
+      }
+
+    pickedCloud = bestCloud;
+    pickedIndex = best.index;
+    publishPick(sceneManager);
+  });
+}
+
+//
+//  hands the picked point, as it is in the scene now, to the GUI thread; for
+//  the jobs of the scene worker
+//
+void GLWidget::publishPick(const SceneManager &sceneManager) {
+  const bool found =
+      pickedCloud &&
+      std::find(sceneManager.begin(), sceneManager.end(), pickedCloud) !=
+          sceneManager.end() &&
+      pickedIndex >= 0 && pickedIndex < pickedCloud->size();
+  const QVector4D p = found ? (*pickedCloud)[pickedIndex] : QVector4D();
+  QMetaObject::invokeMethod(
+      this,
+      [this, found, p] {
+        picked = found;
+        pickedPoint = p;
+        update();
+      },
+      Qt::QueuedConnection);
+}
+
 //
 //  triggers re-draw, if renderer emits changed-signal
 //
@@ -344,40 +493,41 @@ void GLWidget::onRendererChanged() { update(); }
 void GLWidget::setPointSize(int size) {
   assert(size > 0);
   pointSize = size;
-  for (auto s : sceneManager)
-    if (s->getType() == SceneObjectType::ST_POINT_CLOUD)
-      reinterpret_cast<PointCloud *>(s)->setPointSize(unsigned(pointSize));
-  update();
+  sceneWorker.post([size](SceneManager &sceneManager) {
+    for (auto s : sceneManager)
+      if (s->getType() == SceneObjectType::ST_POINT_CLOUD)
+        reinterpret_cast<PointCloud *>(s)->setPointSize(unsigned(size));
+  });
 }
 
 void GLWidget::setKdDepth(int depth) {
   assert(depth > 0);
   kdDepth = depth;
-  for (auto s : sceneManager)
-    if (s->getType() == SceneObjectType::ST_KD_TREE)
-      reinterpret_cast<KdTree *>(s)->setVisualDepth(kdDepth);
-  update();
+  sceneWorker.post([depth](SceneManager &sceneManager) {
+    for (auto s : sceneManager)
+      if (s->getType() == SceneObjectType::ST_KD_TREE)
+        reinterpret_cast<KdTree *>(s)->setVisualDepth(depth);
+  });
 }
 
 // 1. reacts on push button click
 // 2. opens file dialog
-// 3. loads ply-file data to new point cloud
+// 3. loads ply-file data to new point cloud, on the scene worker
 // 4. attaches new point cloud to scene management
 //
 void GLWidget::openFileDialog() {
   const QString filePath = QFileDialog::getOpenFileName(
       this, tr("Open PLY file"), "../data", tr("PLY Files (*.ply)"));
-  PointCloud *pointCloud = new PointCloud;
+  if (filePath.isEmpty())
+    return;
 
-  if (!filePath.isEmpty() && pointCloud) {
-    cout << filePath.toStdString() << endl;
+  cout << filePath.toStdString() << endl;
+  sceneWorker.post([filePath, size = pointSize](SceneManager &sceneManager) {
+    auto pointCloud = std::make_unique<PointCloud>();
     pointCloud->loadPLY(filePath);
-    pointCloud->setPointSize(unsigned(pointSize));
-    sceneManager.push_back(pointCloud);
-    update();
-    return;
-  }
-  delete pointCloud;
+    pointCloud->setPointSize(unsigned(size));
+    sceneManager.push_back(pointCloud.release());
+  });
 }
 
 //
@@ -7,9 +7,17 @@
 #pragma once
 
 #include <QOpenGLWidget>
+#include <QVector4D>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
 
 #include "RenderCamera.h" // containes declaration of Renderer
-#include "SceneManager.h" // containes declaration of Scene Manager
+#include "SceneWorker.h"  // containes declaration of Scene Worker
+
+class KdTree;
+class PointCloud;
 
 class GLWidget : public QOpenGLWidget {
   Q_OBJECT
@@ -17,7 +25,7 @@ private:
   // scene and scene control
   int pointSize;
   int kdDepth;
-  SceneManager sceneManager;
+  SceneWorker sceneWorker; // owns the scene, paintGL draws its snapshots
 
 public:
   GLWidget(QWidget *parent = nullptr);
@@ -47,6 +55,10 @@ protected:
   void wheelEvent(QWheelEvent *event) Q_DECL_OVERRIDE; // handles wheel events
   void mouseMoveEvent(QMouseEvent *event)
       Q_DECL_OVERRIDE; // handles mouse-move  events
+  void mousePressEvent(QMouseEvent *event)
+      Q_DECL_OVERRIDE; // handles mouse-press events
+  void mouseReleaseEvent(QMouseEvent *event)
+      Q_DECL_OVERRIDE; // handles mouse-release events
 
 private slots:
   // handle changes of the renderer
@@ -57,6 +69,25 @@ private:
   bool X_Pressed = false;
   bool Y_Pressed = false;
   QPoint prevMousePosition;
+  QPoint pressMousePosition;
+
+  // point picking
+  void pick(const QPoint &pos); // picks the point under the cursor
+  bool picked = false;
+  QVector4D pickedPoint; // as last published by the scene worker
+  // used by the jobs of sceneWorker only: kd-trees over private copies of
+  // the clouds without a tree in the scene, so that picking leaves the order
+  // of their points alone; rebuilt once a cloud has changed
+  struct PickTree {
+    std::uint64_t revision = 0;
+    std::unique_ptr<PointCloud> points;
+    std::unique_ptr<KdTree> tree;
+    std::vector<int> order; // tree point i is cloud point order[i]
+  };
+  std::map<const PointCloud *, PickTree> pickTrees;
+  const PointCloud *pickedCloud = nullptr;
+  qsizetype pickedIndex = -1;
+  void publishPick(const SceneManager &sceneManager);
 
   // rendering control
   RenderCamera *renderer = nullptr;
@@ -1,11 +1,27 @@
 //
 // (c) Georg Umlauf, 2021
 //
+#include "RenderBenchmark.h"
 #include "mainwindow.h"
 
 #include <QtWidgets/QApplication>
+#include <cstring>
 
 int main(int argc, char *argv[]) {
+  // headless render benchmark, see RenderBenchmark.h
+  for (int i = 1; i < argc; ++i)
+    if (std::strcmp(argv[i], "--benchmark") == 0) {
+#ifdef Q_OS_LINUX
+      // no display: Qt's offscreen platform, e.g. with Mesa's software GL
+      if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM") &&
+          qEnvironmentVariableIsEmpty("DISPLAY") &&
+          qEnvironmentVariableIsEmpty("WAYLAND_DISPLAY"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+#endif
+      QGuiApplication app(argc, argv);
+      return runRenderBenchmark(app.arguments());
+    }
+
   QApplication app(argc, argv);
   MainWindow window;
   window.show();